@@ -0,0 +1,532 @@
+// Benchmark.cpp : Times the ray intersection kernels over fixed, seeded ray sets.
+//
+// Usage: RayTracerBenchmark [--rays N] [--repeat N] [--seed N] [--json File] [--model File.obj]
+// Results are printed as a table, and written as JSON when --json is given ("-" writes to stdout).
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AABB.h"
+#include "Cube.h"
+#include "FMath.h"
+#include "Intersection.h"
+#include "KDTree.h"
+#include "Mesh.h"
+#include "Plane.h"
+#include "Random.h"
+#include "RayPacket.h"
+#include "Sphere.h"
+#include "Triangle.h"
+#include "VectorRegister.h"
+
+static const char* MathBackend = RAYTRACER_SIMD_SSE ? "sse" : "scalar";
+
+/**
+* Settings read from the command line.
+*/
+struct FBenchmarkSettings
+{
+	uint32_t NumRays{ 1u << 16 };	/* Rays traced per repetition */
+	uint32_t NumRepeats{ 3 };		/* Timed repetitions, the fastest is reported */
+	uint32_t Seed{ 1 };				/* Seed for the ray sets and generated scenes */
+	std::string JsonFile;			/* JSON output file, "-" for stdout */
+	std::string ModelFile;			/* .obj model for the mesh benchmark, a generated model is used if empty */
+};
+
+/**
+* Timing results of one kernel.
+*/
+struct FBenchmarkResult
+{
+	std::string Name;
+	uint32_t NumHits;		/* Rays that hit, so results can be checked against a baseline */
+	double NsPerRay;		/* Fastest repetition */
+	double MeanNsPerRay;	/* Mean of all repetitions */
+};
+
+/**
+* Generates a point uniformly distributed on a unit sphere.
+*/
+static Vector3f RandomUnitVector(FRandom& Random)
+{
+	const float Z = 1.0f - 2.0f * Random.NextFloat();
+	const float R = std::sqrt(std::max(0.0f, 1.0f - Z * Z));
+	const float Phi = 2.0f * _PI * Random.NextFloat();
+	return Vector3f(R * std::cos(Phi), R * std::sin(Phi), Z);
+}
+
+/**
+* Generates rays that start outside of a box and point at random points within it.
+* @param Bounds - Box the rays are aimed at
+* @param NumRays - Number of rays to generate
+* @param Seed - Seed of the ray set
+*/
+static std::vector<FRay> GenerateRays(const AABB& Bounds, const uint32_t NumRays, const uint32_t Seed)
+{
+	FRandom Random(Seed);
+	const Vector3f Center = Bounds.GetCenter();
+	const Vector3f Extent = Bounds.GetDeminsions();
+	const float Radius = 2.0f * Extent.Length() + 1.0f;
+
+	std::vector<FRay> Rays;
+	Rays.reserve(NumRays);
+	for (uint32_t i = 0; i < NumRays; i++)
+	{
+		const Vector3f Origin = Center + RandomUnitVector(Random) * Radius;
+		const Vector3f Target(Bounds.Min.x + Random.NextFloat() * Extent.x,
+			Bounds.Min.y + Random.NextFloat() * Extent.y,
+			Bounds.Min.z + Random.NextFloat() * Extent.z);
+
+		Vector3f Direction = Target - Origin;
+		Direction.Normalize();
+		Rays.push_back(FRay(Origin, Direction));
+	}
+
+	return Rays;
+}
+
+/**
+* Generates the primary rays of a pinhole camera looking at a box from outside of it. The image is
+* square, and pixels are ordered in 4x4 blocks like the renderer's packets so neighbouring rays are coherent.
+* @param Bounds - Box the camera looks at, from twice the radius of its bounding sphere
+* @param NumRays - Approximate number of rays, rounded to whole blocks
+* @param Seed - Seed of the camera position
+*/
+static std::vector<FRay> GenerateCameraRays(const AABB& Bounds, const uint32_t NumRays, const uint32_t Seed)
+{
+	FRandom Random(Seed);
+	const Vector3f Center = Bounds.GetCenter();
+	const float Radius = 0.5f * Bounds.GetDeminsions().Length();
+	const Vector3f Eye = Center + RandomUnitVector(Random) * (2.0f * Radius);
+
+	// view basis, the image covers most of the box
+	Vector3f Forward = Center - Eye;
+	Forward.Normalize();
+	Vector3f Right = Vector3f::Cross(Forward, std::abs(Forward.y) < 0.9f ? Vector3f(0.0f, 1.0f, 0.0f) : Vector3f(1.0f, 0.0f, 0.0f));
+	Right.Normalize();
+	const Vector3f Up = Vector3f::Cross(Right, Forward);
+	const float PlaneSize = 0.35f;
+
+	const uint32_t Width = std::max(4u, ((uint32_t)std::sqrt((float)NumRays) + 3) & ~3u);
+	std::vector<FRay> Rays;
+	Rays.reserve(Width * Width);
+	for (uint32_t BlockY = 0; BlockY < Width; BlockY += 4)
+	{
+		for (uint32_t BlockX = 0; BlockX < Width; BlockX += 4)
+		{
+			for (uint32_t i = 0; i < 16; i++)
+			{
+				const uint32_t x = BlockX + ((i & 1) | ((i >> 1) & 2));
+				const uint32_t y = BlockY + (((i >> 1) & 1) | ((i >> 2) & 2));
+				const float U = PlaneSize * (2.0f * (x + 0.5f) / Width - 1.0f);
+				const float V = PlaneSize * (1.0f - 2.0f * (y + 0.5f) / Width);
+
+				Vector3f Direction = Forward + Right * U + Up * V;
+				Direction.Normalize();
+				Rays.push_back(FRay(Eye, Direction));
+			}
+		}
+	}
+
+	return Rays;
+}
+
+/**
+* Generates shadow rays from random points in a box towards a point light above it.
+* @param Bounds - Box the rays start in
+* @param Light - Position of the light, every ray ends there
+* @param NumRays - Number of rays to generate
+* @param Seed - Seed of the ray set
+*/
+static std::vector<FRay> GenerateShadowRays(const AABB& Bounds, const Vector3f& Light, const uint32_t NumRays, const uint32_t Seed)
+{
+	FRandom Random(Seed);
+	const Vector3f Extent = Bounds.GetDeminsions();
+
+	std::vector<FRay> Rays;
+	Rays.reserve(NumRays);
+	for (uint32_t i = 0; i < NumRays; i++)
+	{
+		const Vector3f Origin(Bounds.Min.x + Random.NextFloat() * Extent.x,
+			Bounds.Min.y + Random.NextFloat() * Extent.y,
+			Bounds.Min.z + Random.NextFloat() * Extent.z);
+
+		Vector3f Direction = Light - Origin;
+		Direction.Normalize();
+		Rays.push_back(FRay(Origin, Direction));
+	}
+
+	return Rays;
+}
+
+/**
+* Times a kernel that traces a whole ray set.
+* @param Name - Name of the kernel in the results
+* @param NumRays - Number of rays in the set
+* @param Settings - Benchmark settings
+* @param TraceRays - Traces every ray of the set, returns the number of hits
+*/
+static FBenchmarkResult RunTimed(const std::string& Name, const size_t NumRays, const FBenchmarkSettings& Settings, const std::function<uint32_t()>& TraceRays)
+{
+	// warm up caches and count hits
+	FBenchmarkResult Result{ Name, TraceRays(), 0.0, 0.0 };
+
+	double BestSeconds = std::numeric_limits<double>::max();
+	double TotalSeconds = 0.0;
+	for (uint32_t Repeat = 0; Repeat < Settings.NumRepeats; Repeat++)
+	{
+		const auto Start = std::chrono::steady_clock::now();
+		const uint32_t NumHits = TraceRays();
+		const std::chrono::duration<double> Elapsed = std::chrono::steady_clock::now() - Start;
+
+		if (NumHits != Result.NumHits)
+			std::cerr << Name << ": hit count changed between repetitions" << std::endl;
+
+		BestSeconds = std::min(BestSeconds, Elapsed.count());
+		TotalSeconds += Elapsed.count();
+	}
+
+	Result.NsPerRay = BestSeconds * 1e9 / NumRays;
+	Result.MeanNsPerRay = TotalSeconds * 1e9 / (NumRays * (double)Settings.NumRepeats);
+
+	std::cout << std::left << std::setw(24) << Name << std::right << std::fixed << std::setprecision(2)
+		<< std::setw(12) << Result.NsPerRay
+		<< std::setw(12) << 1000.0 / Result.NsPerRay
+		<< std::setw(12) << Result.NumHits << std::endl;
+
+	return Result;
+}
+
+/**
+* Times a kernel over a ray set.
+* @param Name - Name of the kernel in the results
+* @param Rays - Rays to trace
+* @param Settings - Benchmark settings
+* @param Kernel - Traces one ray, returns true on a hit
+*/
+static FBenchmarkResult RunBenchmark(const std::string& Name, const std::vector<FRay>& Rays, const FBenchmarkSettings& Settings, const std::function<bool(const FRay&)>& Kernel)
+{
+	return RunTimed(Name, Rays.size(), Settings, [&Rays, &Kernel]()
+	{
+		uint32_t NumHits = 0;
+		for (const FRay& Ray : Rays)
+		{
+			NumHits += Kernel(Ray) ? 1 : 0;
+		}
+		return NumHits;
+	});
+}
+
+/**
+* Times a kernel over a ray set split into packets.
+* @param Name - Name of the kernel in the results
+* @param Rays - Rays to trace, consecutive rays form a packet
+* @param PacketSize - Number of rays in a packet
+* @param Settings - Benchmark settings
+* @param Kernel - Traces one packet for the closest intersections, returns the mask of rays that hit
+*/
+static FBenchmarkResult RunPacketBenchmark(const std::string& Name, const std::vector<FRay>& Rays, const uint32_t PacketSize, const FBenchmarkSettings& Settings, const std::function<uint32_t(FRayPacket&, FIntersection*)>& Kernel)
+{
+	return RunTimed(Name, Rays.size(), Settings, [&Rays, PacketSize, &Kernel]()
+	{
+		uint32_t NumHits = 0;
+		FIntersection Intersections[FRayPacket::MaxSize];
+		for (size_t First = 0; First < Rays.size(); First += PacketSize)
+		{
+			FRayPacket Packet(&Rays[First], (uint32_t)std::min<size_t>(PacketSize, Rays.size() - First));
+			NumHits += FRayPacket::CountRays(Kernel(Packet, Intersections));
+		}
+		return NumHits;
+	});
+}
+
+/**
+* Traces a ray against a single object for the closest intersection.
+*/
+static bool TraceClosest(IDrawable& Object, const FRay& Ray)
+{
+	float tValue = std::numeric_limits<float>::max();
+	FIntersection Intersection;
+	return Object.IsIntersectingRay(Ray, &tValue, &Intersection);
+}
+
+/**
+* Builds a bumpy sphere mesh with about 2 * Rings * Segments triangles.
+*/
+static std::unique_ptr<FMesh> GenerateMesh(const uint32_t Rings, const uint32_t Segments)
+{
+	std::vector<Vector3f> Vertices;
+	for (uint32_t i = 0; i <= Rings; i++)
+	{
+		const float Theta = _PI * i / Rings;
+		for (uint32_t j = 0; j < Segments; j++)
+		{
+			const float Phi = 2.0f * _PI * j / Segments;
+			const float Radius = 1.0f + 0.1f * std::sin(7.0f * Theta) * std::cos(5.0f * Phi);
+			Vertices.push_back(Vector3f(Radius * std::sin(Theta) * std::cos(Phi), Radius * std::cos(Theta), Radius * std::sin(Theta) * std::sin(Phi)));
+		}
+	}
+
+	std::vector<uint32_t> Indices;
+	for (uint32_t i = 0; i < Rings; i++)
+	{
+		for (uint32_t j = 0; j < Segments; j++)
+		{
+			const uint32_t A = i * Segments + j;
+			const uint32_t B = i * Segments + (j + 1) % Segments;
+			const uint32_t C = (i + 1) * Segments + j;
+			const uint32_t D = (i + 1) * Segments + (j + 1) % Segments;
+
+			const uint32_t Quad[6] = { A, B, C, B, D, C };
+			Indices.insert(Indices.end(), Quad, Quad + 6);
+		}
+	}
+
+	return std::unique_ptr<FMesh>(new FMesh(Vertices, Indices));
+}
+
+/**
+* Builds a scene of randomly placed spheres, cubes and triangles.
+*/
+static std::vector<std::unique_ptr<IDrawable>> GenerateScene(const uint32_t NumObjects, const float SceneSize, const uint32_t Seed)
+{
+	FRandom Random(Seed);
+	std::vector<std::unique_ptr<IDrawable>> Objects;
+
+	for (uint32_t i = 0; i < NumObjects; i++)
+	{
+		const Vector3f Position(Random.NextFloat() * SceneSize, Random.NextFloat() * SceneSize, Random.NextFloat() * SceneSize);
+		const float Size = 0.5f + Random.NextFloat();
+
+		switch (i % 3)
+		{
+		case 0:
+			Objects.push_back(std::unique_ptr<IDrawable>(new FSphere(Position, Size, FMaterial())));
+			break;
+		case 1:
+		{
+			FMatrix4 Transform;
+			Transform.SetOrigin(Position);
+			Transform.Rotate(Vector3f(Random.NextFloat() * 90.0f, Random.NextFloat() * 90.0f, 0.0f));
+			Transform.Scale(Size);
+			Objects.push_back(std::unique_ptr<IDrawable>(new FCube(Vector3f(), FMaterial())));
+			Objects.back()->SetTransform(Transform);
+			break;
+		}
+		default:
+			Objects.push_back(std::unique_ptr<IDrawable>(new FTriangle(Position,
+				Position + RandomUnitVector(Random) * Size,
+				Position + RandomUnitVector(Random) * Size)));
+			break;
+		}
+	}
+
+	return Objects;
+}
+
+/**
+* Writes results as JSON.
+*/
+static void WriteJson(std::ostream& Out, const FBenchmarkSettings& Settings, const std::vector<FBenchmarkResult>& Results)
+{
+	Out << "{\n";
+	Out << "  \"seed\": " << Settings.Seed << ",\n";
+	Out << "  \"rays\": " << Settings.NumRays << ",\n";
+	Out << "  \"repeats\": " << Settings.NumRepeats << ",\n";
+	Out << "  \"math_backend\": \"" << MathBackend << "\",\n";
+	Out << "  \"results\": [\n";
+	for (size_t i = 0; i < Results.size(); i++)
+	{
+		const FBenchmarkResult& Result = Results[i];
+		Out << std::fixed << std::setprecision(3)
+			<< "    { \"name\": \"" << Result.Name << "\""
+			<< ", \"ns_per_ray\": " << Result.NsPerRay
+			<< ", \"mean_ns_per_ray\": " << Result.MeanNsPerRay
+			<< ", \"mrays_per_s\": " << 1000.0 / Result.NsPerRay
+			<< ", \"hits\": " << Result.NumHits << " }"
+			<< ((i + 1 < Results.size()) ? ",\n" : "\n");
+	}
+	Out << "  ]\n";
+	Out << "}\n";
+}
+
+int main(int argc, char* argv[])
+{
+	FBenchmarkSettings Settings;
+	for (int i = 1; i < argc; i++)
+	{
+		const bool HasValue = i + 1 < argc;
+		if (std::strcmp(argv[i], "--rays") == 0 && HasValue)
+			Settings.NumRays = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+		else if (std::strcmp(argv[i], "--repeat") == 0 && HasValue)
+			Settings.NumRepeats = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+		else if (std::strcmp(argv[i], "--seed") == 0 && HasValue)
+			Settings.Seed = std::strtoul(argv[++i], nullptr, 10);
+		else if (std::strcmp(argv[i], "--json") == 0 && HasValue)
+			Settings.JsonFile = argv[++i];
+		else if (std::strcmp(argv[i], "--model") == 0 && HasValue)
+			Settings.ModelFile = argv[++i];
+		else
+		{
+			std::cout << "Usage: " << argv[0] << " [--rays N] [--repeat N] [--seed N] [--json File] [--model File.obj]" << std::endl;
+			return 1;
+		}
+	}
+
+	// keep the table out of the JSON when it is written to stdout
+	std::ofstream NullStream;
+	std::streambuf* const CoutBuffer = std::cout.rdbuf();
+	if (Settings.JsonFile == "-")
+		std::cout.rdbuf(NullStream.rdbuf());
+
+	std::cout << "Math backend: " << MathBackend << std::endl;
+	std::cout << std::left << std::setw(24) << "Kernel" << std::right
+		<< std::setw(12) << "ns/ray" << std::setw(12) << "Mrays/s" << std::setw(12) << "Hits" << std::endl;
+
+	std::vector<FBenchmarkResult> Results;
+	const AABB UnitBounds(Vector3f(-1.0f, -1.0f, -1.0f), Vector3f(1.0f, 1.0f, 1.0f));
+	const std::vector<FRay> UnitRays = GenerateRays(UnitBounds, Settings.NumRays, Settings.Seed);
+
+	// math used by every intersection test, the ray origin and direction are the operands
+	Results.push_back(RunBenchmark("Vector3f Dot", UnitRays, Settings, [](const FRay& Ray) { return Vector3f::Dot(Ray.origin, Ray.direction) < 0.0f; }));
+	Results.push_back(RunBenchmark("Vector3f Cross", UnitRays, Settings, [](const FRay& Ray) { return Vector3f::Cross(Ray.origin, Ray.direction).x < 0.0f; }));
+
+	FMatrix4 Transform;
+	Transform.Rotate(Vector3f(20.0f, 30.0f, 40.0f));
+	Transform.Scale(Vector3f(1.0f, 2.0f, 3.0f));
+	Transform.SetOrigin(Vector3f(1.0f, -2.0f, 3.0f));
+	Results.push_back(RunBenchmark("FMatrix4 TransformRay", UnitRays, Settings, [&Transform](const FRay& Ray) { return Transform.TransformRay(Ray).direction.x < 0.0f; }));
+
+	FSphere Sphere(Vector3f(), 1.0f, FMaterial());
+	Results.push_back(RunBenchmark("FSphere", UnitRays, Settings, [&Sphere](const FRay& Ray) { return TraceClosest(Sphere, Ray); }));
+
+	FTriangle Triangle(Vector3f(-1.0f, -1.0f, 0.0f), Vector3f(1.0f, -1.0f, 0.0f), Vector3f(0.0f, 1.0f, 0.0f));
+	Results.push_back(RunBenchmark("FTriangle", UnitRays, Settings, [&Triangle](const FRay& Ray) { return TraceClosest(Triangle, Ray); }));
+
+	FPlane Plane(FMaterial(), Vector3f(0.0f, 1.0f, 0.0f), Vector3f());
+	Results.push_back(RunBenchmark("FPlane", UnitRays, Settings, [&Plane](const FRay& Ray) { return TraceClosest(Plane, Ray); }));
+
+	FCube Cube(Vector3f(0.0f, 0.0f, 0.0f), FMaterial());
+	FMatrix4 CubeTransform;
+	CubeTransform.Rotate(Vector3f(0.0f, 30.0f, 0.0f));
+	Cube.SetTransform(CubeTransform);
+	Results.push_back(RunBenchmark("FCube", UnitRays, Settings, [&Cube](const FRay& Ray) { return TraceClosest(Cube, Ray); }));
+
+	AABB Box(UnitBounds);
+	Results.push_back(RunBenchmark("AABB", UnitRays, Settings, [&Box](const FRay& Ray)
+	{
+		float tValue = std::numeric_limits<float>::max();
+		return Box.IsIntersectingRay(Ray, &tValue);
+	}));
+
+	// scene of mixed objects for the KD-tree
+	const uint32_t NumSceneObjects = 1000;
+	const float SceneSize = 100.0f;
+	const AABB SceneBounds(Vector3f(), Vector3f(SceneSize, SceneSize, SceneSize));
+	const std::vector<FRay> SceneRays = GenerateRays(SceneBounds, Settings.NumRays, Settings.Seed);
+
+	KDTree SAHTree;
+	std::vector<std::unique_ptr<IDrawable>> SAHObjects = GenerateScene(NumSceneObjects, SceneSize, Settings.Seed);
+	SAHTree.BuildSAHTree(SAHObjects);
+	Results.push_back(RunBenchmark("KDTree (SAH)", SceneRays, Settings, [&SAHTree](const FRay& Ray)
+	{
+		float tValue = std::numeric_limits<float>::max();
+		FIntersection Intersection;
+		return SAHTree.IsIntersectingRay(Ray, &tValue, &Intersection);
+	}));
+
+	KDTree MedianTree;
+	std::vector<std::unique_ptr<IDrawable>> MedianObjects = GenerateScene(NumSceneObjects, SceneSize, Settings.Seed);
+	MedianTree.BuildTree(MedianObjects, 10, 3);
+	Results.push_back(RunBenchmark("KDTree (Median)", SceneRays, Settings, [&MedianTree](const FRay& Ray)
+	{
+		float tValue = std::numeric_limits<float>::max();
+		FIntersection Intersection;
+		return MedianTree.IsIntersectingRay(Ray, &tValue, &Intersection);
+	}));
+
+	// mesh BVH, rays are aimed at the mesh bounds
+	std::unique_ptr<FMesh> Mesh = Settings.ModelFile.empty() ? GenerateMesh(300, 300) : std::unique_ptr<FMesh>(new FMesh(Settings.ModelFile));
+	const std::vector<FRay> MeshRays = GenerateRays(Mesh->GetWorldAABB(), Settings.NumRays, Settings.Seed);
+	Results.push_back(RunBenchmark("FMesh BVH", MeshRays, Settings, [&Mesh](const FRay& Ray) { return TraceClosest(*Mesh, Ray); }));
+
+	// coherent camera rays, traced one at a time and as packets
+	const std::vector<FRay> SceneCameraRays = GenerateCameraRays(SceneBounds, Settings.NumRays, Settings.Seed);
+	Results.push_back(RunBenchmark("KDTree camera", SceneCameraRays, Settings, [&SAHTree](const FRay& Ray)
+	{
+		float tValue = std::numeric_limits<float>::max();
+		FIntersection Intersection;
+		return SAHTree.IsIntersectingRay(Ray, &tValue, &Intersection);
+	}));
+
+	const std::vector<FRay> MeshCameraRays = GenerateCameraRays(Mesh->GetWorldAABB(), Settings.NumRays, Settings.Seed);
+	Results.push_back(RunBenchmark("FMesh camera", MeshCameraRays, Settings, [&Mesh](const FRay& Ray) { return TraceClosest(*Mesh, Ray); }));
+
+	// shadow rays, through the closest hit query the renderer used to share and the any-hit query
+	const Vector3f SceneLight(0.5f * SceneSize, 2.0f * SceneSize, 0.5f * SceneSize);
+	const std::vector<FRay> SceneShadowRays = GenerateShadowRays(SceneBounds, SceneLight, Settings.NumRays, Settings.Seed);
+	Results.push_back(RunBenchmark("KDTree shadow closest", SceneShadowRays, Settings, [&SAHTree, &SceneLight](const FRay& Ray)
+	{
+		float tValue = (SceneLight - Ray.origin).Length();
+		return SAHTree.IsIntersectingRay(Ray, &tValue);
+	}));
+	Results.push_back(RunBenchmark("KDTree shadow any-hit", SceneShadowRays, Settings, [&SAHTree, &SceneLight](const FRay& Ray)
+	{
+		return SAHTree.IsOccludingRay(Ray, (SceneLight - Ray.origin).Length());
+	}));
+
+	const AABB MeshBounds = Mesh->GetWorldAABB();
+	const Vector3f MeshLight = MeshBounds.GetCenter() + Vector3f(0.0f, 2.0f * MeshBounds.GetDeminsions().Length(), 0.0f);
+	const std::vector<FRay> MeshShadowRays = GenerateShadowRays(MeshBounds, MeshLight, Settings.NumRays, Settings.Seed);
+	Results.push_back(RunBenchmark("FMesh shadow closest", MeshShadowRays, Settings, [&Mesh, &MeshLight](const FRay& Ray)
+	{
+		float tValue = (MeshLight - Ray.origin).Length();
+		return Mesh->IsIntersectingRay(Ray, &tValue);
+	}));
+	Results.push_back(RunBenchmark("FMesh shadow any-hit", MeshShadowRays, Settings, [&Mesh, &MeshLight](const FRay& Ray)
+	{
+		return Mesh->IsOccludingRay(Ray, (MeshLight - Ray.origin).Length());
+	}));
+
+	for (const uint32_t PacketSize : { 4u, 16u })
+	{
+		const std::string Suffix = " packet " + std::to_string(PacketSize);
+		Results.push_back(RunPacketBenchmark("KDTree camera" + Suffix, SceneCameraRays, PacketSize, Settings, [&SAHTree](FRayPacket& Packet, FIntersection* Intersections)
+		{
+			return SAHTree.IsIntersectingPacket(Packet, Intersections);
+		}));
+		Results.push_back(RunPacketBenchmark("FMesh camera" + Suffix, MeshCameraRays, PacketSize, Settings, [&Mesh](FRayPacket& Packet, FIntersection* Intersections)
+		{
+			return Mesh->IsIntersectingPacket(Packet, Packet.GetFullMask(), Intersections);
+		}));
+	}
+
+	std::cout.rdbuf(CoutBuffer);
+
+	if (Settings.JsonFile == "-")
+	{
+		WriteJson(std::cout, Settings, Results);
+	}
+	else if (!Settings.JsonFile.empty())
+	{
+		std::ofstream JsonStream(Settings.JsonFile);
+		if (!JsonStream)
+		{
+			std::cout << Settings.JsonFile << " could not be opened." << std::endl;
+			return 1;
+		}
+		WriteJson(JsonStream, Settings, Results);
+	}
+
+	return 0;
+}
@@ -0,0 +1,350 @@
+// Convergence.cpp : Measures how fast the estimates of each sampler converge, on integrals like the ones
+// the renderer takes over pixels and area lights.
+//
+// Usage: RayTracerConvergence [--size N] [--seed N] [--json File]
+// Each integral is estimated once per pixel of a Size x Size image, with a pixel sampler as the renderer
+// uses, and the RMS error of the estimates is reported for each sampler and sample count. Pixels of a
+// 2x2 block share an integral, so the error left after averaging the block shows how the errors of
+// neighbouring pixels cancel out.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Random.h"
+#include "Sampler.h"
+
+static const ESampler Samplers[] = { ESampler::Jittered, ESampler::Halton, ESampler::Sobol, ESampler::BlueNoise };
+static const uint32_t NumSamplers = sizeof(Samplers) / sizeof(Samplers[0]);
+static const uint32_t SampleCounts[] = { 4, 5, 8, 9, 12, 16, 25, 32, 64 };
+/* Sample count of the jittered grid that the other samplers are measured against */
+static const uint32_t BaselineSamples = 16;
+
+/**
+* Settings read from the command line.
+*/
+struct FConvergenceSettings
+{
+	uint32_t Size{ 64 };		/* Width and height of the image of estimates */
+	uint32_t Seed{ 1 };			/* Seed for the integrals and the sample scrambles */
+	std::string JsonFile;		/* JSON output file, "-" for stdout */
+};
+
+/**
+* An integral over the unit square with a known value.
+*/
+struct FIntegral
+{
+	std::function<float(const Vector2f&)> Function;
+	double Value;
+};
+
+/**
+* A kind of integral, each pixel block gets its own integral of the kind.
+*/
+struct FIntegralKind
+{
+	std::string Name;
+	std::function<FIntegral(FRandom&)> Generate;
+};
+
+/**
+* Errors of one sampler and sample count.
+*/
+struct FConvergenceResult
+{
+	std::string Integral;
+	ESampler Sampler;
+	uint32_t NumSamples;
+	double RMSE;		/* Error of the pixel estimates */
+	double BlockRMSE;	/* Error of the 2x2 block averages of the estimates */
+};
+
+/**
+* Computes the area of the unit square on the inner side of a line, by clipping the square.
+* @param Point - Point on the line
+* @param Normal - Normal of the line, pointing away from the inner side
+*/
+static double ComputeClippedArea(const Vector2f& Point, const Vector2f& Normal)
+{
+	const double Corners[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+	std::vector<double> X, Y;
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		const double* A = Corners[i];
+		const double* B = Corners[(i + 1) % 4];
+		const double DistanceA = (A[0] - Point.x) * Normal.x + (A[1] - Point.y) * Normal.y;
+		const double DistanceB = (B[0] - Point.x) * Normal.x + (B[1] - Point.y) * Normal.y;
+		if (DistanceA <= 0.0)
+		{
+			X.push_back(A[0]);
+			Y.push_back(A[1]);
+		}
+		if ((DistanceA <= 0.0) != (DistanceB <= 0.0))
+		{
+			const double t = DistanceA / (DistanceA - DistanceB);
+			X.push_back(A[0] + t * (B[0] - A[0]));
+			Y.push_back(A[1] + t * (B[1] - A[1]));
+		}
+	}
+
+	// shoelace formula over the clipped polygon
+	double Area = 0.0;
+	for (size_t i = 0; i < X.size(); i++)
+	{
+		const size_t j = (i + 1) % X.size();
+		Area += X[i] * Y[j] - X[j] * Y[i];
+	}
+	return std::abs(Area) * 0.5;
+}
+
+/**
+* Integrates a gaussian over [0, 1].
+*/
+static double IntegrateGaussian(const double Center, const double Deviation)
+{
+	const double Scale = 1.0 / (Deviation * std::sqrt(2.0));
+	return Deviation * std::sqrt(3.14159265358979 / 2.0) * (std::erf((1.0 - Center) * Scale) + std::erf(Center * Scale));
+}
+
+/**
+* Gets the integrals the samplers are measured on.
+*/
+static std::vector<FIntegralKind> GetIntegralKinds()
+{
+	std::vector<FIntegralKind> Kinds;
+
+	// a pixel crossed by the edge of an object, or a light partly behind the edge of an occluder
+	Kinds.push_back({ "Edge", [](FRandom& Random)
+	{
+		const Vector2f Point(Random.NextFloat(), Random.NextFloat());
+		const float Angle = Random.NextFloat() * 6.2831853f;
+		const Vector2f Normal(std::cos(Angle), std::sin(Angle));
+		FIntegral Integral;
+		Integral.Function = [Point, Normal](const Vector2f& Sample)
+		{
+			return ((Sample.x - Point.x) * Normal.x + (Sample.y - Point.y) * Normal.y <= 0.0f) ? 1.0f : 0.0f;
+		};
+		Integral.Value = ComputeClippedArea(Point, Normal);
+		return Integral;
+	} });
+
+	// a small occluder in front of a light
+	Kinds.push_back({ "Disk", [](FRandom& Random)
+	{
+		const Vector2f Center(0.3f + 0.4f * Random.NextFloat(), 0.3f + 0.4f * Random.NextFloat());
+		const float Radius = 0.05f + 0.25f * Random.NextFloat();
+		FIntegral Integral;
+		Integral.Function = [Center, Radius](const Vector2f& Sample)
+		{
+			const float X = Sample.x - Center.x;
+			const float Y = Sample.y - Center.y;
+			return (X * X + Y * Y <= Radius * Radius) ? 1.0f : 0.0f;
+		};
+		Integral.Value = 3.14159265358979 * Radius * Radius;
+		return Integral;
+	} });
+
+	// smooth shading across a pixel
+	Kinds.push_back({ "Smooth", [](FRandom& Random)
+	{
+		const Vector2f Center(Random.NextFloat(), Random.NextFloat());
+		const float Deviation = 0.1f + 0.3f * Random.NextFloat();
+		FIntegral Integral;
+		Integral.Function = [Center, Deviation](const Vector2f& Sample)
+		{
+			const float X = Sample.x - Center.x;
+			const float Y = Sample.y - Center.y;
+			return std::exp(-(X * X + Y * Y) / (2.0f * Deviation * Deviation));
+		};
+		Integral.Value = IntegrateGaussian(Center.x, Deviation) * IntegrateGaussian(Center.y, Deviation);
+		return Integral;
+	} });
+
+	return Kinds;
+}
+
+/**
+* Estimates an integral in every pixel of the image and measures the errors.
+*/
+static FConvergenceResult RunConvergence(const FIntegralKind& Kind, const ESampler Sampler, const uint32_t NumSamples, const FConvergenceSettings& Settings)
+{
+	const Vector2i Resolution(Settings.Size, Settings.Size);
+	const uint32_t NumBlocks = Settings.Size / 2;
+
+	double SquaredError = 0.0;
+	double SquaredBlockError = 0.0;
+	for (uint32_t BlockY = 0; BlockY < NumBlocks; BlockY++)
+	{
+		for (uint32_t BlockX = 0; BlockX < NumBlocks; BlockX++)
+		{
+			FRandom IntegralRandom(Settings.Seed, BlockY * NumBlocks + BlockX);
+			const FIntegral Integral = Kind.Generate(IntegralRandom);
+
+			double BlockError = 0.0;
+			for (uint32_t i = 0; i < 4; i++)
+			{
+				const Vector2i Pixel(2 * BlockX + (i & 1), 2 * BlockY + (i >> 1));
+				FPixelSampler PixelSampler(Sampler, Settings.Seed, Pixel, Resolution, 0);
+				const FSampleSet Samples = PixelSampler.NextSet(NumSamples);
+
+				double Sum = 0.0;
+				for (uint32_t Sample = 0; Sample < NumSamples; Sample++)
+				{
+					Sum += Integral.Function(Samples.GetPoint(Sample));
+				}
+
+				const double Error = Sum / NumSamples - Integral.Value;
+				SquaredError += Error * Error;
+				BlockError += Error * 0.25;
+			}
+			SquaredBlockError += BlockError * BlockError;
+		}
+	}
+
+	FConvergenceResult Result;
+	Result.Integral = Kind.Name;
+	Result.Sampler = Sampler;
+	Result.NumSamples = NumSamples;
+	Result.RMSE = std::sqrt(SquaredError / (4.0 * NumBlocks * NumBlocks));
+	Result.BlockRMSE = std::sqrt(SquaredBlockError / ((double)NumBlocks * NumBlocks));
+	return Result;
+}
+
+/**
+* Finds the number of samples at which a sampler's error first falls to a target, interpolated
+* between the measured sample counts on a log-log scale.
+* @param Results - Results of every sampler, the sample counts of each sampler are NumSamplers apart
+* @param FirstResult - Result of the sampler with the fewest samples
+* @param TargetRMSE - Error to reach
+* @return The number of samples, or 0 if the error is never reached.
+*/
+static double FindMatchingSamples(const std::vector<FConvergenceResult>& Results, const size_t FirstResult, const double TargetRMSE)
+{
+	for (size_t r = FirstResult; r < Results.size(); r += NumSamplers)
+	{
+		if (Results[r].RMSE > TargetRMSE)
+			continue;
+		if (r == FirstResult)
+			return Results[r].NumSamples;
+
+		const FConvergenceResult& Before = Results[r - NumSamplers];
+		const double t = std::log(Before.RMSE / TargetRMSE) / std::log(Before.RMSE / Results[r].RMSE);
+		return Before.NumSamples * std::pow((double)Results[r].NumSamples / Before.NumSamples, t);
+	}
+	return 0.0;
+}
+
+/**
+* Writes results as JSON.
+*/
+static void WriteJson(std::ostream& Out, const FConvergenceSettings& Settings, const std::vector<FConvergenceResult>& Results)
+{
+	Out << "{\n";
+	Out << "  \"seed\": " << Settings.Seed << ",\n";
+	Out << "  \"size\": " << Settings.Size << ",\n";
+	Out << "  \"results\": [\n";
+	for (size_t i = 0; i < Results.size(); i++)
+	{
+		const FConvergenceResult& Result = Results[i];
+		Out << std::scientific << std::setprecision(4)
+			<< "    { \"integral\": \"" << Result.Integral << "\""
+			<< ", \"sampler\": \"" << FPixelSampler::GetName(Result.Sampler) << "\""
+			<< ", \"samples\": " << Result.NumSamples
+			<< ", \"rmse\": " << Result.RMSE
+			<< ", \"block_rmse\": " << Result.BlockRMSE << " }"
+			<< ((i + 1 < Results.size()) ? ",\n" : "\n");
+	}
+	Out << "  ]\n";
+	Out << "}\n";
+}
+
+int main(int argc, char* argv[])
+{
+	FConvergenceSettings Settings;
+	for (int i = 1; i < argc; i++)
+	{
+		const bool HasValue = i + 1 < argc;
+		if (std::strcmp(argv[i], "--size") == 0 && HasValue)
+			Settings.Size = std::max(2ul, std::strtoul(argv[++i], nullptr, 10)) & ~1u;
+		else if (std::strcmp(argv[i], "--seed") == 0 && HasValue)
+			Settings.Seed = std::strtoul(argv[++i], nullptr, 10);
+		else if (std::strcmp(argv[i], "--json") == 0 && HasValue)
+			Settings.JsonFile = argv[++i];
+		else
+		{
+			std::cout << "Usage: " << argv[0] << " [--size N] [--seed N] [--json File]" << std::endl;
+			return 1;
+		}
+	}
+
+	// keep the table out of the JSON when it is written to stdout
+	std::ofstream NullStream;
+	std::streambuf* const CoutBuffer = std::cout.rdbuf();
+	if (Settings.JsonFile == "-")
+		std::cout.rdbuf(NullStream.rdbuf());
+
+	std::vector<FConvergenceResult> Results;
+	for (const FIntegralKind& Kind : GetIntegralKinds())
+	{
+		std::cout << Kind.Name << ", RMS error of pixels (of 2x2 pixel averages)" << std::endl;
+		std::cout << std::left << std::setw(8) << "Samples" << std::right;
+		for (const ESampler Sampler : Samplers)
+			std::cout << std::setw(22) << FPixelSampler::GetName(Sampler);
+		std::cout << std::endl;
+
+		double BaselineRMSE = 0.0;
+		const size_t FirstResult = Results.size();
+		for (const uint32_t NumSamples : SampleCounts)
+		{
+			std::cout << std::left << std::setw(8) << NumSamples << std::right << std::fixed << std::setprecision(5);
+			for (const ESampler Sampler : Samplers)
+			{
+				Results.push_back(RunConvergence(Kind, Sampler, NumSamples, Settings));
+				std::cout << std::setw(12) << Results.back().RMSE << " (" << Results.back().BlockRMSE << ")";
+				if (Sampler == ESampler::Jittered && NumSamples == BaselineSamples)
+					BaselineRMSE = Results.back().RMSE;
+			}
+			std::cout << std::endl;
+		}
+
+		// the fewest samples each sampler needs to be as accurate as the jittered baseline
+		std::cout << "Samples to match " << BaselineSamples << " jittered samples:" << std::setprecision(1);
+		for (uint32_t s = 0; s < NumSamplers; s++)
+		{
+			std::cout << " " << FPixelSampler::GetName(Samplers[s]) << " ";
+			const double MatchingSamples = FindMatchingSamples(Results, FirstResult + s, BaselineRMSE);
+			if (MatchingSamples > 0.0)
+				std::cout << MatchingSamples;
+			else
+				std::cout << "-";
+		}
+		std::cout << std::endl << std::endl;
+	}
+
+	std::cout.rdbuf(CoutBuffer);
+
+	if (Settings.JsonFile == "-")
+	{
+		WriteJson(std::cout, Settings, Results);
+	}
+	else if (!Settings.JsonFile.empty())
+	{
+		std::ofstream JsonStream(Settings.JsonFile);
+		if (!JsonStream)
+		{
+			std::cout << Settings.JsonFile << " could not be opened." << std::endl;
+			return 1;
+		}
+		WriteJson(JsonStream, Settings, Results);
+	}
+
+	return 0;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <algorithm>
+#include <cmath>
 
 #include "Ray.h"
 #include "FMath.h"
@@ -27,6 +28,26 @@ public:
 	*/
 	bool IsIntersectingRay(FRay Ray, float* tValueOut = nullptr);
 
+	/**
+	* Clips a ray against the AABB.
+	* @param Ray - the ray to clip
+	* @param tMinOut - the t value where the ray enters the box, never less than 0
+	* @param tMaxOut - the t value where the ray leaves the box, the input value is used as the max t value
+	* @return True if any part of the ray is within the box.
+	*/
+	bool ClipRay(const FRay& Ray, float& tMinOut, float& tMaxOut) const;
+
+	/**
+	* Checks if a ray segment overlaps the AABB, using a precomputed inverse ray direction.
+	* Suited to testing one ray against many boxes.
+	* @param Origin - the origin of the ray
+	* @param InvDirection - the reciprocal of each component of the ray direction
+	* @param tMin - the t value where the segment starts
+	* @param tMax - the t value where the segment ends
+	* @return True if any part of the segment is within the box.
+	*/
+	bool IsOverlappingSegment(const Vector3f& Origin, const Vector3f& InvDirection, float tMin, float tMax) const;
+
 	/**
 	* Get the center point of the box.
 	*/
@@ -36,6 +57,16 @@ public:
 	* Get the length of each axis of the AABB
 	*/
 	Vector3f GetDeminsions() const { return Max - Min; }
+
+	/**
+	* Get the surface area of the box.
+	*/
+	float GetSurfaceArea() const;
+
+	/**
+	* Grows the box to enclose another box.
+	*/
+	void Expand(const AABB& Other);
 };
 
 
@@ -60,7 +91,7 @@ inline bool AABB::IsIntersectingRay(FRay Ray, float* tValueOut)
 
 	for (int i = 0; i < 3; i++)
 	{
-		if (abs(RayD[i]) < _EPSILON)
+		if (std::abs(RayD[i]) < _EPSILON)
 		{
 			//Ray is parallel to this slab, no hit unless origin is within slab
 			if (RayO[i] < Min[i] || RayO[i] > Max[i])
@@ -104,6 +135,77 @@ inline bool AABB::IsIntersectingRay(FRay Ray, float* tValueOut)
 	return true;
 }
 
+inline bool AABB::ClipRay(const FRay& Ray, float& tMinOut, float& tMaxOut) const
+{
+	float tMin = 0.0f;
+	float tMax = tMaxOut;
+
+	for (int i = 0; i < 3; i++)
+	{
+		if (std::abs(Ray.direction[i]) < _EPSILON)
+		{
+			//Ray is parallel to this slab, no hit unless origin is within slab
+			if (Ray.origin[i] < Min[i] || Ray.origin[i] > Max[i])
+				return false;
+		}
+		else
+		{
+			const float ood = 1.0f / Ray.direction[i];
+			float t1 = (Min[i] - Ray.origin[i]) * ood;
+			float t2 = (Max[i] - Ray.origin[i]) * ood;
+
+			if (t1 > t2)
+				std::swap(t1, t2);
+
+			tMin = std::max(tMin, t1);
+			tMax = std::min(tMax, t2);
+
+			if (tMin > tMax)
+				return false;
+		}
+	}
+
+	tMinOut = tMin;
+	tMaxOut = tMax;
+	return true;
+}
+
+inline bool AABB::IsOverlappingSegment(const Vector3f& Origin, const Vector3f& InvDirection, float tMin, float tMax) const
+{
+	for (int i = 0; i < 3; i++)
+	{
+		float t1 = (Min[i] - Origin[i]) * InvDirection[i];
+		float t2 = (Max[i] - Origin[i]) * InvDirection[i];
+
+		if (t1 > t2)
+			std::swap(t1, t2);
+
+		// written so a NaN from a ray parallel to the slab and touching it leaves the segment unchanged
+		tMin = (t1 > tMin) ? t1 : tMin;
+		tMax = (t2 < tMax) ? t2 : tMax;
+
+		if (tMin > tMax)
+			return false;
+	}
+
+	return true;
+}
+
+inline float AABB::GetSurfaceArea() const
+{
+	const Vector3f Extent = GetDeminsions();
+	return 2.0f * (Extent.x * Extent.y + Extent.y * Extent.z + Extent.z * Extent.x);
+}
+
+inline void AABB::Expand(const AABB& Other)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		Min[i] = std::min(Min[i], Other.Min[i]);
+		Max[i] = std::max(Max[i], Other.Max[i]);
+	}
+}
+
 inline Vector3f AABB::GetCenter() const
 {
 	return (Min + Max) * 0.5f;
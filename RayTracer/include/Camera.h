@@ -1,7 +1,6 @@
 #pragma once
 
 #include <cstdint>
-#include <vector>
 
 #include "Vector2.h"
 #include "Vector3.h"
@@ -35,14 +34,13 @@ public:
 	FRay GenerateRay(int32_t X, int32_t Y) const;
 
 	/**
-	* Generates a list of sample rays from the viewpoint 
-	* through a random selection of points within a screen pixel.
+	* Generates a sample ray from the viewpoint through a point within a screen pixel.
 	* @param X coordinate of the pixel
 	* @param Y coordinate of the pixel
-	* @param SamplingLevel This number squared is the number of samples taken.
-	* @return The generated list of rays in world coordinates
+	* @param PixelPoint Position of the point within the pixel, in [0, 1)^2 from its top left corner.
+	* @return The generated ray in world coordinates
 	*/
-	std::vector<FRay> GenerateSampleRays(int32_t X, int32_t Y, uint16_t SamplingLevel) const;
+	FRay GenerateSampleRay(int32_t X, int32_t Y, const Vector2f& PixelPoint) const;
 
 	/**
 	* Retrieves the horizontal FOV of the camera.
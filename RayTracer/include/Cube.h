@@ -24,12 +24,6 @@ public:
 	*/
 	bool IsIntersectingRay(FRay Ray, float* tValueOut = nullptr, FIntersection* IntersectionOut = nullptr) override;
 
-	/**
-	* Retrieves the material of a surface point for the cube object.
-	* @return The material
-	*/
-	FMaterial GetMaterial(Vector3f SurfacePoint) override;
-
 private:
 	/**
 	* Constructs intersection info at a given point of the cube.
@@ -25,13 +25,22 @@ public:
 	FRay GetRayToLight(const Vector3f& SurfacePoint) const override;
 
 	/**
-	* Generate a list of sample rays from a given point to an area light source.
-	* Used to take shadow samples for generating soft shadows.
+	* Sets up the frame used to take shadow samples of the light from a surface point.
+	* Sample directions are spread around the light direction, the frame does not depend on the point.
 	* @param SurfacePoint The destination point for the light
-	* @param NumSamples The number of sample to produce
-	* @return A list of sample rays from the surface point to the light position.
+	* @param NumSamples The number of samples requested
+	* @return The sample frame, its NumSamples is the number of samples the light takes.
 	*/
-	std::vector<FRay> GetRayToLightSamples(const Vector3f& SurfacePoint, int NumSamples) const override;
+	FLightSampleFrame GetSampleFrame(const Vector3f& SurfacePoint, uint32_t NumSamples) const override;
+
+	/**
+	* Generate one sample ray from a given point to the light.
+	* @param SurfacePoint The destination point for the light
+	* @param Frame Sample frame of the light for the surface point
+	* @param SamplePoint Point of a sample set, mapped to an offset of the light direction
+	* @return A sample ray from the surface point to the light.
+	*/
+	FRay GetRayToLightSample(const Vector3f& SurfacePoint, const FLightSampleFrame& Frame, const Vector2f& SamplePoint) const override;
 
 	/**
 	* Sets the direction of the light.
@@ -5,8 +5,11 @@
 #include "Matrix4.h"
 #include "Ray.h"
 
+#include <vector>
+
 class FTexture;
 struct FIntersection;
+struct FRayPacket;
 
 /**
 * Abstract class for all renderable objects.
@@ -22,10 +25,15 @@ public:
 	*/
 	explicit IDrawable(const FMaterial& LightingMaterial = FMaterial());
 
-	virtual ~IDrawable(){};
+	virtual ~IDrawable();
+
+	// Parent and child links can't be shared between objects
+	IDrawable(const IDrawable& Copy) = delete;
+	IDrawable& operator=(const IDrawable& Copy) = delete;
 
 	/**
-	* Checks if a ray intersects the primitive.
+	* Checks if a ray intersects the primitive. Rays never intersect the primitive
+	* set as their ignoreObject, objects made of many primitives only skip the ray's ignorePrimitive.
 	* If the intersection succeeds, the intersection properties and t value are output through
 	* an optional t value and intersection pointer.
 	* @param Ray - the ray to check for intersection
@@ -36,6 +44,27 @@ public:
 	*/
 	virtual bool IsIntersectingRay(FRay Ray, float* tValueOut = nullptr, FIntersection* IntersectionOut = nullptr) = 0;
 
+	/**
+	* Checks a packet of rays for intersections with the primitive. Closer intersections
+	* replace a ray's tMax value in the packet and its entry in IntersectionsOut.
+	* By default each ray is tested on its own with IsIntersectingRay.
+	* @param Packet - Rays to check for intersection
+	* @param ActiveMask - Rays of the packet to test
+	* @param IntersectionsOut - Closest intersection of each ray in the packet
+	* @return Mask of the tested rays that intersect the Primitive.
+	*/
+	virtual uint32_t IsIntersectingPacket(FRayPacket& Packet, uint32_t ActiveMask, FIntersection* IntersectionsOut);
+
+	/**
+	* Checks if a ray hits the primitive anywhere before a distance, as for a shadow ray.
+	* Any hit is enough, so the search may stop before the closest one is found.
+	* By default this is IsIntersectingRay without an intersection.
+	* @param Ray - the ray to check for a hit, its ignoreObject is skipped
+	* @param tMax - hits further along the ray are ignored
+	* @return True if the ray hits the Primitive within tMax.
+	*/
+	virtual bool IsOccludingRay(const FRay& Ray, float tMax);
+
 	/**
 	* Set the default material properties for the Primitives' surface.
 	* @param NewMaterial - The material for the Primitive
@@ -49,10 +78,12 @@ public:
 	FMaterial GetMaterial() const;
 
 	/**
-	* Retrieves the material for the Primitive at a point in world space.
-	* @return The material
+	* Evaluates the lighting properties of the Primitive at an intersection.
+	* Does not modify the Primitive, so it is safe to call from multiple threads.
+	* @param Intersection - An intersection with this Primitive
+	* @return The surface properties at the intersection
 	*/
-	virtual FMaterial GetMaterial(Vector3f SurfacePoint) = 0;
+	virtual FSurfaceProperties GetSurfaceProperties(const FIntersection& Intersection) const;
 
 	/**
 	* Retrieves the bounding box for the Primitive in object space.
@@ -72,24 +103,26 @@ public:
 	/**
 	* Gets the inverse transform of the object.
 	*/
-	FMatrix4 GetInvTransform() const;
+	const FMatrix4& GetInvTransform() const;
 
 	/**
 	* Gets the world inverse transform of the object. Includes
-	* parent transforms, if any.
+	* parent transforms, if any. The matrix is cached, so this is cheap
+	* enough to call for every ray.
 	*/
-	FMatrix4 GetWorldInvTransform() const;
+	const FMatrix4& GetWorldInvTransform() const;
 
 	/**
 	* Gets the transform of the object.
 	*/
-	FMatrix4 GetTransform() const;
+	const FMatrix4& GetTransform() const;
 
 	/**
 	* Gets the world transform of the object. Includes
-	* parent transforms, if any.
+	* parent transforms, if any. The matrix is cached, so this is cheap
+	* enough to call for every ray.
 	*/
-	FMatrix4 GetWorldTransform() const;
+	const FMatrix4& GetWorldTransform() const;
 
 	/**
 	* Sets the transform for the object.
@@ -123,18 +156,6 @@ public:
 	*/
 	Vector3f GetWorldOrigin() const;
 
-	/**
-	* Check if this object is enabled. Disabled objects
-	* do not intersect other objects.
-	*/
-	bool IsEnabled() const;
-
-	/**
-	* Set status of object. Disabled objects do not intersect
-	* other objects.
-	*/
-	void SetEnabled(bool IsEnabled);
-
 protected:
 	/**
 	* Sets the bounding box for the Primitive.
@@ -148,6 +169,12 @@ private:
 	*/
 	virtual void ConstructAABB(Vector3f Min = Vector3f(), Vector3f Max = Vector3f()) = 0;
 
+	/**
+	* Recomputes the cached world transforms of this object and all of its children.
+	* Called whenever the local transform or the parent changes.
+	*/
+	void UpdateWorldTransform();
+
 
 protected:
 	FMaterial mMaterial;			/* Lighting material properties for the Primitive */
@@ -157,6 +184,8 @@ private:
 	AABB mBoundingBox;				/* Bounding volume */
 	FMatrix4 mTransform;			/* Object space transform */
 	FMatrix4 mInvTransform;			/* Inverse transform of this object, takes object from world to object space */
-	bool mIsEnabled;				/* If the object is disabled, no intersections will take place on it */
+	FMatrix4 mWorldTransform;		/* Cached product of the parent world transform and mTransform */
+	FMatrix4 mWorldInvTransform;	/* Cached inverse of mWorldTransform */
+	std::vector<IDrawable*> mChildObjects; /* Objects that have this object as their parent */
 };
 
@@ -5,20 +5,46 @@
 #include <vector>
 #include <fstream>
 #include <cstdint>
+#include <atomic>
+#include <memory>
+#include <mutex>
 
-/* Used to write to a .ppm image file */
+/**
+* File formats of the output image.
+*/
+enum class EImageFormat
+{
+	PPM,	/* 8 bit binary .ppm, colors are clamped to 0-1 and rounded */
+	PFM		/* 32 bit float .pfm, colors are written as they were rendered */
+};
+
+/**
+* Framebuffer of a rendered image, written to a .ppm or .pfm image file.
+* Pixels are stored in one contiguous array, row by row. Once BeginImage has been called,
+* each row is converted and written to the file as soon as its last pixel is set, so the
+* image is written while the rest of it is still rendering.
+*/
 class FImage
 {
 public:
 	/**
 	* Constructs an Image with a filename and output resolution in pixels
-	* @param Filename - Name of the output image file
+	* @param Filename - Name of the output image file, without the extension
 	* @param OutputResolution - Resolution (in pixels) of the output image
+	* @param Format - File format of the output image
+	*/
+	FImage(const std::string& Filename, const Vector2i& OutputResolution, const EImageFormat Format = EImageFormat::PPM);
+
+	/**
+	* Opens the output image file and writes its header. Rows set after this are
+	* written to the file as soon as they are complete.
+	* @return False if the file could not be opened.
 	*/
-	FImage(const std::string& Filename, const Vector2i& OutputResolution);
+	bool BeginImage();
 
 	/**
-	* Sets the color value of a pixel.
+	* Sets the color value of a pixel. Can be called from several threads, as long as
+	* each pixel is set only once after BeginImage.
 	* @param X - x coordinate of the pixel
 	* @param Y - y coordinate of the pixel
 	* @param Color - The color of the pixel
@@ -26,14 +52,23 @@ public:
 	void SetPixel(const uint32_t& X, const uint32_t& Y, const FColor& Color);
 
 	/**
-	* Writes a .ppm image file with the rgb values currently stored for
-	* each pixel.
+	* Gets the color value of a pixel.
+	* @param X - x coordinate of the pixel
+	* @param Y - y coordinate of the pixel
+	*/
+	const FColor& GetPixel(const uint32_t& X, const uint32_t& Y) const;
+
+	/**
+	* Finishes the image file, writing every row that has not been written yet. The whole image
+	* is written if BeginImage was not called, to a temporary file that then replaces the output file.
+	* On Windows the image is then opened in the default viewer, unless built with RAYTRACER_HEADLESS.
+	* @param ShowImage - False to skip opening the viewer, for intermediate images of a render
 	*/
-	void WriteImage();
+	void WriteImage(const bool ShowImage = true);
 
 	/**
 	* Sets the filename for the output image file.
-	* @param Filename - Name of the output file
+	* @param Filename - Name of the output file, without the extension
 	*/
 	void SetFilename(const std::string& Filename);
 
@@ -44,10 +79,34 @@ public:
 	std::string GetFilename() const;
 
 private:
-	/* Color values for each pixel. Indexed by [HorizontalPosition][VerticalPosition] */
-	std::vector<std::vector<FColor>> mPixelColors;
+	/**
+	* Opens a file for the image and writes its header.
+	* @param Filepath - Path of the file to open
+	* @return False if the file could not be opened.
+	*/
+	bool OpenFile(const std::string& Filepath);
+
+	/**
+	* Converts a range of rows to the file format and writes them at their place in the open file.
+	* @param BeginRow - First row to write
+	* @param EndRow - One past the last row to write
+	*/
+	void WriteRows(const uint32_t BeginRow, const uint32_t EndRow);
+
+	/* Gets the size of a row in the file, in bytes */
+	size_t GetFileRowSize() const;
+
+	/* Color values for each pixel. Indexed by [VerticalPosition * Width + HorizontalPosition] */
+	std::vector<FColor> mPixels;
+
+	/* Number of pixels set in each row since BeginImage, a row is written when this reaches the width */
+	std::unique_ptr<std::atomic<uint32_t>[]> mRowPixelCounts;
 
 	std::string mFilename; /* Filename for the output image file */
 	Vector2i mOutputResolution; /* Resolution of the output image file */
-};
+	EImageFormat mFormat; /* File format of the output image */
 
+	std::ofstream mFileStream; /* Output image file, open between BeginImage and WriteImage */
+	std::streamoff mHeaderSize; /* Size of the file header, rows are written after it */
+	std::mutex mFileMutex; /* Guards writes to the file stream */
+};
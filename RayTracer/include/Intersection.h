@@ -1,5 +1,9 @@
 #pragma once
 
+#include "Vector2.h"
+#include "Vector3.h"
+#include "Ray.h"
+
 class IDrawable;
 
 /**
@@ -15,6 +19,8 @@ struct FIntersection
 		: object(nullptr)
 		, point()
 		, normal()
+		, uv()
+		, primitive(FRay::AllPrimitives)
 	{
 	}
 
@@ -24,11 +30,15 @@ struct FIntersection
 	* @param IntersectedObject Object of the intersection
 	* @param IntersectionPoint Point of intersection
 	* @param SurfaceNormal Normal at the intersection of the object
+	* @param SurfaceUV Texture coordinates of the object at the intersection
+	* @param Primitive Index of the intersected primitive within the object
 	*/
-	inline FIntersection(IDrawable& IntersectedObject, Vector3f IntersectionPoint, Vector3f SurfaceNormal)
+	inline FIntersection(IDrawable& IntersectedObject, Vector3f IntersectionPoint, Vector3f SurfaceNormal, Vector2f SurfaceUV = Vector2f(), uint32_t Primitive = FRay::AllPrimitives)
 		: object(&IntersectedObject)
 		, point(IntersectionPoint)
 		, normal(SurfaceNormal)
+		, uv(SurfaceUV)
+		, primitive(Primitive)
 	{
 	}
 
@@ -36,5 +46,7 @@ struct FIntersection
 	IDrawable* object;			/* The object of the intersection */
 	Vector3f point;				/* Point on the surface of the geometry */
 	Vector3f normal;			/* Surface normal at the point on the geometry */
+	Vector2f uv;				/* Texture coordinates at the point, before material UV scaling */
+	uint32_t primitive;			/* Primitive hit within the object, FRay::AllPrimitives for single primitive objects */
 };
 
@@ -5,13 +5,23 @@
 #include <memory>
 
 #include "Drawable.h"
+#include "RayPacket.h"
 
 struct KDNode
 {
 	std::unique_ptr<KDNode> Child[2]; // 0 = near, 1 = far
 	float SplitValue{ 0.0f }; // value on the splitting axis
 	uint8_t Axis{ 0 }; // x, y, or z splitting axis
-	std::vector<std::unique_ptr<IDrawable>> ObjectList; // list of Primitives within this node
+	std::vector<IDrawable*> ObjectList; // list of Primitives within this node, owned by the tree
+};
+
+/**
+* Selects the algorithm used to construct a KDTree.
+*/
+enum class EKDTreeBuilder
+{
+	Median,	/* Split at the median object center on round-robin axes, straddling objects stay in interior nodes */
+	SAH		/* Binned Surface Area Heuristic splits, objects are only referenced by leaves */
 };
 
 class KDTree
@@ -28,12 +38,21 @@ public:
 	*/
 	void BuildTree(std::vector<std::unique_ptr<IDrawable>>& Objects, uint32_t Depth, uint32_t MinObjectsPerNode);
 
+	/**
+	* Builds a KD-tree from a list of objects using the Surface Area Heuristic.
+	* Split candidates are evaluated at bin boundaries on each axis and a node is only
+	* split when the estimated traversal cost is lower than intersecting all of its objects.
+	* Objects that straddle a split are referenced by both children.
+	* @param Objects to build the tree from.
+	*/
+	void BuildSAHTree(std::vector<std::unique_ptr<IDrawable>>& Objects);
+
 	/**
 	* Checks if a ray intersects an object in the kdtree.
 	* If the intersection succeeds, the intersection properties and t value are output through
 	* an optional t value and intersection pointer. If an intersection pointer is not given, it is assumed
 	* that a single intersection is being checked for, so the function will return true with the first valid
-	* intersection.
+	* intersection. The ray's ignoreObject is skipped by the search, no object state is modified.
 	* @param Ray - the ray to check for intersection
 	* @param tValueOut(optional) - the smallest t parameter will be output to this
 	* @param IntersectionOut(optional) - intersection attributes will be assigned to this reference if
@@ -42,10 +61,45 @@ public:
 	*/
 	bool IsIntersectingRay(FRay Ray, float* tValueOut = nullptr, FIntersection* IntersectionOut = nullptr);
 
+	/**
+	* Finds the closest intersection of each ray in a packet. A coherent packet traverses
+	* the tree together, testing four rays at a time against each node's bounds. A ray left
+	* alone in a subtree continues with single ray traversal, and a packet whose rays point
+	* in different directions is traced one ray at a time.
+	* @param Packet - Rays to intersect, each ray's tMax is lowered to its closest intersection
+	* @param IntersectionsOut - Closest intersection of each ray in the packet
+	* @return Mask of the rays that intersect an object.
+	*/
+	uint32_t IsIntersectingPacket(FRayPacket& Packet, FIntersection* IntersectionsOut);
+
+	/**
+	* Checks if a ray hits any object in the kdtree before tMax, as for a shadow ray.
+	* The search stops at the first object hit, wherever it is in the traversal.
+	* The ray's ignoreObject is skipped by the search, no object state is modified.
+	* @param Ray - the ray to check for a hit
+	* @param tMax - hits further along the ray are ignored
+	* @param OccluderOut(optional) - the object that was hit is assigned to this if the function returns true
+	* @return True if the ray hits an object within tMax.
+	*/
+	bool IsOccludingRay(FRay Ray, float tMax, IDrawable** OccluderOut = nullptr);
+
 private:
+	/**
+	* Takes ownership of the objects for a new tree. Objects without finite bounds, such as
+	* planes, are kept out of the tree and tested against every ray.
+	* @return The objects that will be placed in the tree.
+	*/
+	std::vector<IDrawable*> ResetTree(std::vector<std::unique_ptr<IDrawable>>& Objects);
+
 	void BuildTreeHelper(KDNode& currentNode, uint32_t depth, uint32_t MinObjectsPerNode);
-	bool VisitNodesAgainstRay(KDNode* currentNode, FRay Ray, float* tValueOut = nullptr, FIntersection* IntersectionOut = nullptr);
+	void BuildSAHTreeHelper(KDNode& CurrentNode, const AABB& NodeBounds, const std::vector<uint32_t>& Objects, const std::vector<IDrawable*>& TreeObjects, const std::vector<AABB>& ObjectBounds, uint32_t Depth, uint32_t BadRefines);
+	bool VisitNodesAgainstRay(KDNode* currentNode, const FRay& Ray, float tMin, float tMax, float* tValueOut = nullptr, FIntersection* IntersectionOut = nullptr);
+	IDrawable* FindOccluderInNodes(const KDNode* CurrentNode, const FRay& Ray, float tMin, float tMax, float tRayMax);
+	uint32_t VisitNodesAgainstPacket(KDNode* CurrentNode, const AABB& NodeBounds, FRayPacket& Packet, uint32_t ActiveMask, FIntersection* IntersectionsOut);
 
 private:
 	KDNode mRoot;
+	AABB mBounds; /* Bounds of all objects in the tree */
+	std::vector<std::unique_ptr<IDrawable>> mObjects; /* All objects in the scene */
+	std::vector<IDrawable*> mUnboundedObjects; /* Objects that are tested outside of the tree */
 };
\ No newline at end of file
@@ -2,8 +2,20 @@
 #include "Color.h"
 #include "Vector3.h"
 #include "Ray.h"
+#include "Vector2.h"
+#include "Matrix4.h"
 
-#include <vector>
+#include <cstdint>
+
+/**
+* Frame of an area light as seen from one surface point. It is set up once per shading point
+* and reused for every shadow sample taken of the light from that point.
+*/
+struct FLightSampleFrame
+{
+	FMatrix4 Frame; /* From the sample plane of the light to world space */
+	uint32_t NumSamples; /* Number of samples the light takes from the point */
+};
 
 /* Base class of all scene lights */
 class ILight
@@ -30,13 +42,22 @@ public:
 	virtual FRay GetRayToLight(const Vector3f& SurfacePoint) const = 0;
 
 	/**
-	* Generate a list of sample rays from a given point to an area light source.
+	* Sets up the frame used to take shadow samples of an area light from a surface point.
+	* @param SurfacePoint The destination point for the light
+	* @param NumSamples The number of samples requested
+	* @return The sample frame, its NumSamples is the number of samples the light takes.
+	*/
+	virtual FLightSampleFrame GetSampleFrame(const Vector3f& SurfacePoint, uint32_t NumSamples) const = 0;
+
+	/**
+	* Generate one sample ray from a given point to an area light source.
 	* Used to take shadow samples for generating soft shadows.
 	* @param SurfacePoint The destination point for the light
-	* @param NumSamples The number of sample to produce
-	* @return A list of sample rays from the surface point to the light position.
+	* @param Frame Sample frame of the light for the surface point
+	* @param SamplePoint Point of a sample set, in [0, 1)^2, that is mapped onto the light
+	* @return A sample ray from the surface point to the light.
 	*/
-	virtual std::vector<FRay> GetRayToLightSamples(const Vector3f& SurfacePoint, int NumSamples) const = 0;
+	virtual FRay GetRayToLightSample(const Vector3f& SurfacePoint, const FLightSampleFrame& Frame, const Vector2f& SamplePoint) const = 0;
 
 	/**
 	* Retrieves the color intensity of the light at a point.
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/**
+* A read-only file mapped into memory. Pages are only read from disk when they
+* are first touched, so opening a large file is almost free.
+*/
+class FMappedFile
+{
+public:
+	FMappedFile();
+
+	~FMappedFile();
+
+	// A mapping has a single owner
+	FMappedFile(const FMappedFile& Copy) = delete;
+	FMappedFile& operator=(const FMappedFile& Copy) = delete;
+
+	/**
+	* Maps a whole file, closing any file that was already mapped.
+	* @param Filepath - The file to map
+	* @return True if the file was mapped.
+	*/
+	bool Open(const std::string& Filepath);
+
+	/**
+	* Unmaps the file. Pointers into the file are no longer valid.
+	*/
+	void Close();
+
+	/**
+	* Checks if a file is mapped.
+	*/
+	bool IsOpen() const;
+
+	/**
+	* Gets the contents of the file, null for an empty file.
+	*/
+	const char* GetData() const;
+
+	/**
+	* Gets the size of the file in bytes.
+	*/
+	size_t GetSize() const;
+
+private:
+	const char* mData; /* Start of the mapping */
+	size_t mSize; /* Size of the file */
+	bool mIsOpen; /* True while a file is mapped */
+#ifdef _WIN32
+	void* mFileHandle; /* Handle of the open file */
+	void* mMappingHandle; /* Handle of the file mapping */
+#endif
+};
@@ -2,6 +2,7 @@
 
 #include "Color.h"
 #include "Texture.h"
+#include "Vector2.h"
 #include <cassert>
 
 /**
@@ -14,6 +15,20 @@ struct FTextureInfo
 	float VAxisScale;
 };
 
+/**
+* Lighting properties of a material at a single surface point.
+* Produced for each shading hit, so it holds no texture references.
+*/
+struct FSurfaceProperties
+{
+	FColor Specular;		/* Specular color */
+	FColor Diffuse;			/* Diffuse color, alpha is the opacity of the surface */
+	FColor Ambient;			/* Ambient color */
+	float Glossiness;		/* Specular exponent */
+	float Reflectivity;		/* Mirror reflection factor [0-1] */
+	float RefractiveIndex;	/* Refractive index of the surface */
+};
+
 /**
 * Represents the lighting material for a specific surface
 */
@@ -117,6 +132,24 @@ public:
 		return mDiffuseTextureInfo;
 	}
 
+	/**
+	* Evaluates the material at a surface point. The diffuse texture, if any,
+	* is sampled with the UV coordinates scaled by the texture's axis scales.
+	* @param UV coordinates of the surface point
+	* @return The lighting properties at the point
+	*/
+	FSurfaceProperties GetSurfaceProperties(const Vector2f& UV) const
+	{
+		FSurfaceProperties Surface{ mSpecularColor, mDiffuseColor, mAmbientColor, mGlossiness, mReflectivity, mRefractiveIndex };
+
+		if (mDiffuseTextureInfo.Texture)
+		{
+			Surface.Diffuse = mDiffuseTextureInfo.Texture->GetSample(UV.x * mDiffuseTextureInfo.UAxisScale, UV.y * mDiffuseTextureInfo.VAxisScale);
+		}
+
+		return Surface;
+	}
+
 private:
 	FColor mSpecularColor;
 	FColor mDiffuseColor;
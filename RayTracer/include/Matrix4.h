@@ -8,8 +8,7 @@
 #include "Vector4.h"
 #include "Ray.h"
 #include "FMath.h"
-
-#include <mmintrin.h>
+#include "VectorRegister.h"
 
 /**
 *	4x4 floating-point column-matrix
@@ -18,7 +17,9 @@
 struct FMatrix4
 {
 	/** 
-	* Each row in the matrix is a vector.
+	* Each row in the matrix is a vector, loaded directly into vector registers. Matrices are
+	* members of heap allocated objects, which are not 16 byte aligned everywhere, so rows are
+	* loaded and stored unaligned.
 	*/
 	float M[4][4];
 
@@ -162,7 +163,7 @@ struct FMatrix4
 	/**
 	* Gets the scale vector from the matrix.
 	*/
-	Vector3f FMatrix4::GetScale() const;
+	Vector3f GetScale() const;
 
 	/**
 	* Retreive a Column of the matrix. Includes translation component.
@@ -176,6 +177,16 @@ struct FMatrix4
 	*/
 	Vector4f GetRow(int Row) const;
 
+	/**
+	* Loads each row of the matrix into a vector register.
+	*/
+	void LoadRows(VectorRegister Rows[4]) const;
+
+	/**
+	* Loads each column of the matrix into a vector register.
+	*/
+	void LoadColumns(VectorRegister Columns[4]) const;
+
 	/**
 	* Calculates the inverse of the matrix.
 	*/
@@ -224,13 +235,14 @@ inline FMatrix4 operator+(const FMatrix4& Lhs, const FMatrix4& Rhs)
 
 inline FMatrix4 operator*(const FMatrix4& Lhs, const FMatrix4& Rhs)
 {
+	VectorRegister RhsRows[4];
+	Rhs.LoadRows(RhsRows);
+
+	// each row of the result is the rows of Rhs weighted by the same row of Lhs
 	FMatrix4 Result;
 	for (int row = 0; row < 4; row++)
 	{
-		for (int col = 0; col < 4; col++)
-		{
-			Result.M[row][col] = Vector4f::Dot4(Lhs.GetRow(row), Rhs.GetColumn(col));
-		}
+		VectorStore(VectorLinearCombination(RhsRows, VectorLoad(Lhs.M[row])), Result.M[row]);
 	}
 	return Result;
 }
@@ -298,24 +310,7 @@ inline FMatrix4& FMatrix4::operator=(const FMatrix4& Other)
 
 inline FMatrix4& FMatrix4::operator*=(const FMatrix4& Rhs)
 {
-	float tempM[4][4];
-	for (int row = 0; row < 4; row++)
-	{
-		for (int col = 0; col < 4; col++)
-		{
-			tempM[row][col] = Vector4f::Dot4(GetRow(row), Rhs.GetColumn(col));
-		}
-	}
-
-	for (int row = 0; row < 4; row++)
-	{
-		for (int col = 0; col < 4; col++)
-		{
-			M[row][col] = tempM[row][col];
-		}
-	}
-
-
+	*this = *this * Rhs;
 	return *this;
 }
 
@@ -372,32 +367,35 @@ inline FMatrix4 FMatrix4::Transpose() const
 
 inline Vector3f FMatrix4::TransformDirection(const Vector3f& Direction) const
 {
-	Vector4f vec(Direction);
-	vec.w = 0.0f;
-	vec = TransformVector(vec);
-	return Vector3f(vec.x, vec.y, vec.z);
+	VectorRegister Columns[4];
+	LoadColumns(Columns);
+	return VectorToVector3(VectorLinearCombination(Columns, MakeVectorRegister(Direction, 0.0f)));
 }
 
 inline Vector3f FMatrix4::TransformPosition(const Vector3f& Position) const
 {
-	Vector4f vec(TransformVector(Position));
-	return Vector3f(vec.x, vec.y, vec.z);
+	VectorRegister Columns[4];
+	LoadColumns(Columns);
+	return VectorToVector3(VectorLinearCombination(Columns, MakeVectorRegister(Position, 1.0f)));
 }
 
 inline Vector4f FMatrix4::TransformVector(const Vector4f& Vector) const
 {
-	Vector4f transformed;
-	transformed.x = Vector4f::Dot4(GetRow(0), Vector);
-	transformed.y = Vector4f::Dot4(GetRow(1), Vector);
-	transformed.z = Vector4f::Dot4(GetRow(2), Vector);
-	transformed.w = Vector4f::Dot4(GetRow(3), Vector);
-	return transformed;
+	VectorRegister Columns[4];
+	LoadColumns(Columns);
+
+	RAYTRACER_ALIGN(16) float Transformed[4];
+	VectorStoreAligned(VectorLinearCombination(Columns, MakeVectorRegister(Vector.x, Vector.y, Vector.z, Vector.w)), Transformed);
+	return Vector4f(Transformed[0], Transformed[1], Transformed[2], Transformed[3]);
 }
 
 inline FRay FMatrix4::TransformRay(FRay Ray) const
 {
-	Ray.origin = TransformPosition(Ray.origin);
-	Ray.direction = TransformDirection(Ray.direction);
+	// share the transposed matrix between the origin and direction
+	VectorRegister Columns[4];
+	LoadColumns(Columns);
+	Ray.origin = VectorToVector3(VectorLinearCombination(Columns, MakeVectorRegister(Ray.origin, 1.0f)));
+	Ray.direction = VectorToVector3(VectorLinearCombination(Columns, MakeVectorRegister(Ray.direction, 0.0f)));
 	return Ray;
 }
 
@@ -545,6 +543,20 @@ inline Vector4f FMatrix4::GetRow(int Row) const
 	return Vector4f(M[Row][0], M[Row][1], M[Row][2], M[Row][3]);
 }
 
+inline void FMatrix4::LoadRows(VectorRegister Rows[4]) const
+{
+	for (int row = 0; row < 4; row++)
+	{
+		Rows[row] = VectorLoad(M[row]);
+	}
+}
+
+inline void FMatrix4::LoadColumns(VectorRegister Columns[4]) const
+{
+	LoadRows(Columns);
+	VectorTranspose4(Columns[0], Columns[1], Columns[2], Columns[3]);
+}
+
 inline Vector3f FMatrix4::GetOrigin() const
 {
 	return Vector3f(M[0][3], M[1][3], M[2][3]);
@@ -1,18 +1,25 @@
 #pragma once
 #include "Drawable.h"
-#include "Triangle.h"
+#include "MappedFile.h"
+#include "RayPacket.h"
 #include "Texture.h"
+#include "Vector2.h"
+#include "Vector3.h"
 
 #include <vector>
 #include <memory>
 #include <string>
 
 /**
-* A 3D triangle mesh
+* A 3D triangle mesh. The triangles and their BVH are kept in object space and can be
+* shared by many instances of the mesh, each with its own transform and material.
 */
 class FMesh : public IDrawable
 {
 public:
+	/* Default max number of triangles in a BVH leaf */
+	static const uint32_t DefaultMaxLeafTriangles = 4;
+
 	/**
 	* Default constructor. Creates an empty mesh.
 	*/
@@ -20,15 +27,38 @@ public:
 
 	/**
 	* Creates a triangle mesh from vertices and faces in a
-	* .obj file.
+	* .obj file. The triangles are placed in a BVH built with the
+	* Surface Area Heuristic.
+	* With UseCache, the triangles and BVH are memory mapped from a cache file next to the model
+	* (the model path with a .bvh extension appended) if it was built from the same model contents
+	* with the same settings. Otherwise the model is read and the cache file is written.
 	* @param ModelFilepath The file path of the model.
+	* @param MaxLeafTriangles Triangles allowed in a BVH leaf before it must be split.
+	* @param UseCache Load and save the built mesh in a cache file.
+	*/
+	FMesh(const std::string& ModelFilepath, const FMaterial& Material = FMaterial(), const uint32_t MaxLeafTriangles = DefaultMaxLeafTriangles, const bool UseCache = false);
+
+	/**
+	* Creates a triangle mesh from vertex positions and triangle vertex indices.
+	* @param Vertices Object space vertex positions.
+	* @param Indices Three vertex indices per triangle, in counterclockwise order.
+	* @param MaxLeafTriangles Triangles allowed in a BVH leaf before it must be split.
 	*/
-	FMesh(const std::string& ModelFilepath, const FMaterial& Material = FMaterial());
+	FMesh(const std::vector<Vector3f>& Vertices, const std::vector<uint32_t>& Indices, const FMaterial& Material = FMaterial(), const uint32_t MaxLeafTriangles = DefaultMaxLeafTriangles);
+
+	/**
+	* Creates an instance of another mesh. The instance shares the triangles and BVH of
+	* Source, so only its transform and material take up memory.
+	* @param Source The mesh to instance.
+	* @param Material The material of the instance.
+	*/
+	FMesh(const FMesh& Source, const FMaterial& Material);
 
 	~FMesh();
 
 	/**
 	* Checks if a ray intersects any triangles in the mesh.
+	* The intersection's primitive is the index of the intersected triangle.
 	* If the intersection succeeds, the intersection properties and t value are output through
 	* an optional t value and intersection pointer.
 	* @param Ray - the ray to check for intersection
@@ -40,34 +70,208 @@ public:
 	bool IsIntersectingRay(FRay Ray, float* tValueOut = nullptr, FIntersection* IntersectionOut = nullptr) override;
 
 	/**
-	* Retrieves the default material for the mesh.
+	* Checks a packet of rays against the triangles of the mesh. The rays of a coherent packet
+	* traverse the BVH together, and each node and triangle is tested against four rays at a time.
+	* Packets that are not coherent in object space, and rays spawned from this mesh, are tested
+	* one ray at a time.
+	* @param Packet - Rays to check for intersection
+	* @param ActiveMask - Rays of the packet to test
+	* @param IntersectionsOut - Closest intersection of each ray in the packet
+	* @return Mask of the tested rays that intersect the mesh.
+	*/
+	uint32_t IsIntersectingPacket(FRayPacket& Packet, uint32_t ActiveMask, FIntersection* IntersectionsOut) override;
+
+	/**
+	* Checks if a ray hits any triangle of the mesh before tMax. The BVH is traversed
+	* without tracking the closest hit, and the search ends at the first triangle hit.
+	* @param Ray - the ray to check for a hit
+	* @param tMax - hits further along the ray are ignored
+	* @return True if the ray hits a triangle within tMax.
+	*/
+	bool IsOccludingRay(const FRay& Ray, float tMax) override;
+
+	/**
+	* Get the number of triangles in the mesh.
+	*/
+	size_t GetNumTriangles() const;
+
+	/**
+	* Get the SAH cost of the mesh BVH. This is the expected cost of tracing a ray
+	* that hits the mesh bounds, in units of triangle intersection tests.
 	*/
-	FMaterial GetMaterial(Vector3f SurfacePoint) override;
+	float GetBVHCost() const;
+
+	/**
+	* Get the number of meshes that share this mesh's triangles, including this one.
+	*/
+	long GetNumInstances() const;
 
 private:
-	/** 
-	* Node for the bounding volume hierarchy used for
-	* meshes.
+	/**
+	* Node of the mesh BVH. Nodes are stored in depth first order, so the first
+	* child of an interior node is the next node in the array.
+	*/
+	struct FLinearBVHNode
+	{
+		AABB Bounds; /* Bounds of all triangles below the node */
+		union
+		{
+			uint32_t FirstTriangle; /* Leaf: index of the first triangle in the leaf */
+			uint32_t SecondChild; /* Interior: index of the second child */
+		};
+		uint16_t NumTriangles; /* Number of triangles in a leaf, 0 for interior nodes */
+		uint8_t Axis; /* Interior: axis the children were split on */
+		uint8_t Pad;
+	};
+	static_assert(sizeof(FLinearBVHNode) == 32, "BVH nodes should be 32 bytes");
+
+	/**
+	* Arrays that hold the geometry of a mesh while it is built from a model.
+	*/
+	struct FMeshBuffers
+	{
+		std::vector<FLinearBVHNode> BVHNodes;
+		std::vector<Vector3f> Vertices;
+		std::vector<Vector2f> UVs;
+		std::vector<uint32_t> VertexIndices;
+		std::vector<uint32_t> UVIndices;
+		std::vector<Vector3f> VertexNormals;
+		std::vector<uint32_t> NormalIndices;
+		std::vector<Vector3f> Edges1;
+		std::vector<Vector3f> Edges2;
+		std::vector<Vector3f> Normals;
+	};
+
+	/**
+	* Object space geometry of a mesh. The arrays point into the buffers the mesh was built in,
+	* or straight into a mapped cache file. They are only written while the mesh is constructed,
+	* after that they are shared by the mesh and its instances.
 	*/
-	struct FBVHNode
+	struct FMeshData
+	{
+		const FLinearBVHNode* BVHNodes{ nullptr }; /* Mesh BVH, the root is the first node */
+		const Vector3f* Vertices{ nullptr }; /* Object space vertex positions */
+		const Vector2f* UVs{ nullptr }; /* Vertex texture coordinates */
+		const Vector3f* VertexNormals{ nullptr }; /* Vertex normals used for smooth shading */
+
+		/* Triangle data, one entry per triangle in BVH leaf order */
+		const uint32_t* VertexIndices{ nullptr }; /* Three vertex indices per triangle */
+		const uint32_t* UVIndices{ nullptr }; /* Three UV indices per triangle, or NoUV */
+		const uint32_t* NormalIndices{ nullptr }; /* Three vertex normal indices per triangle, or NoNormal */
+		const Vector3f* Edges1{ nullptr }; /* Second vertex minus the first */
+		const Vector3f* Edges2{ nullptr }; /* Third vertex minus the first */
+		const Vector3f* Normals{ nullptr }; /* Unit face normals */
+
+		uint32_t NumBVHNodes{ 0 };
+		uint32_t NumVertices{ 0 };
+		uint32_t NumUVs{ 0 };
+		uint32_t NumVertexNormals{ 0 };
+		uint32_t NumTriangles{ 0 };
+		float BVHCost{ 0.0f }; /* SAH cost of the BVH */
+
+		FMeshBuffers Buffers; /* Storage of a mesh built from a model, empty for a cached mesh */
+		FMappedFile CacheFile; /* Storage of a mesh loaded from a cache file */
+	};
+
+	/* Triangle bounds used while the BVH is built */
+	struct FBuildTriangle
 	{
-		AABB BoundingVolume;
-		std::unique_ptr<FBVHNode> Child[2];
-		std::vector<std::unique_ptr<FTriangle>> Objects;
+		AABB Bounds;
+		Vector3f Center;
+		uint32_t Index; /* Index of the triangle before BVH ordering */
 	};
 
+	/* Value of a UV index for faces without texture coordinates */
+	static const uint32_t NoUV = 0xFFFFFFFF;
+	/* Value of a normal index for faces without vertex normals, they are shaded with the face normal */
+	static const uint32_t NoNormal = 0xFFFFFFFF;
+
 	void ConstructAABB(Vector3f Min = Vector3f(), Vector3f Max = Vector3f()) override;
 
 	/* Reads a .obj model into this object and constructs an AABB for the BVH root */
 	void ReadModel(const std::string& ModelFilepath);
 
-	void ConstructBVH(FBVHNode& Node, const uint8_t Depth);
+	/**
+	* Adds a triangle to the mesh and precomputes its edges and normal.
+	* Vertices are given in counterclockwise order.
+	*/
+	void AddTriangle(const uint32_t VertexIndices[3], const uint32_t UVIndices[3], const uint32_t NormalIndices[3]);
+
+	/**
+	* Points the arrays used by intersection tests at the build buffers.
+	*/
+	void BindBuffers();
+
+	/**
+	* Maps a cache file and points the arrays used by intersection tests into it.
+	* @param CacheFilepath - The cache file
+	* @param SourceHash - Hash of the model file contents the cache must have been built from
+	* @param MaxLeafTriangles - BVH leaf size the cache must have been built with
+	* @return True if the cache file is valid for the model and settings.
+	*/
+	bool ReadCache(const std::string& CacheFilepath, const uint64_t SourceHash, const uint32_t MaxLeafTriangles);
+
+	/**
+	* Writes the mesh to a cache file, replacing the file once it is complete.
+	* @param CacheFilepath - The cache file
+	* @param SourceHash - Hash of the model file contents the mesh was built from
+	* @param MaxLeafTriangles - BVH leaf size the mesh was built with
+	*/
+	void WriteCache(const std::string& CacheFilepath, const uint64_t SourceHash, const uint32_t MaxLeafTriangles) const;
+
+	/**
+	* Builds the BVH and reorders the triangles so every leaf refers to a contiguous range.
+	* @param MaxLeafTriangles - Triangles allowed in a leaf before it must be split
+	*/
+	void ConstructBVH(const uint32_t MaxLeafTriangles);
+
+	/**
+	* Recursively builds BVH nodes for a range of triangles with binned SAH splits.
+	* The range is partitioned in place.
+	* @param Triangles - Bounds of all triangles in the mesh
+	* @param Begin - First triangle in the range
+	* @param End - One past the last triangle in the range
+	* @param Depth - Depth of the new node
+	* @param MaxLeafTriangles - Triangles allowed in a leaf before it must be split
+	* @return The cost of the node's subtree weighted by the node's surface area.
+	*/
+	float ConstructBVHNode(std::vector<FBuildTriangle>& Triangles, const uint32_t Begin, const uint32_t End, const uint32_t Depth, const uint32_t MaxLeafTriangles);
+
+	/* Computes the bounds of a range of triangles */
+	static AABB ConstructBoundingVolume(const std::vector<FBuildTriangle>& Triangles, const uint32_t Begin, const uint32_t End);
+
+	/**
+	* Intersects an object space ray with a single triangle. Back faces are not intersected.
+	* @param Triangle - Index of the triangle
+	* @param Ray - the ray to check for intersection
+	* @param tMax - Intersections further than this are rejected
+	* @param tOut - t value of the intersection
+	* @param AlphaOut, BetaOut - barycentric coordinates of the second and third vertex at the intersection
+	* @return True if the ray intersects the triangle within tMax.
+	*/
+	bool IsIntersectingTriangle(const uint32_t Triangle, const FRay& Ray, const float tMax, float& tOut, float& AlphaOut, float& BetaOut) const;
 
-	void ConstructBoundingVolume(FBVHNode& Node);
+	/**
+	* Intersects the rays of a packet with a single triangle, four rays at a time. Each ray
+	* gets the same result as IsIntersectingTriangle.
+	* @param Triangle - Index of the triangle
+	* @param Packet - Object space rays, intersections further than a ray's tMax are rejected
+	* @param ActiveMask - Rays of the packet to test
+	* @param tOut - t values of the intersections, one per ray of the packet
+	* @param AlphaOut, BetaOut - barycentric coordinates of the second and third vertex at the intersections
+	* @return Mask of the tested rays that intersect the triangle.
+	*/
+	uint32_t IsIntersectingTrianglePacket(const uint32_t Triangle, const FRayPacket& Packet, const uint32_t ActiveMask, float* tOut, float* AlphaOut, float* BetaOut) const;
 
-	bool TraverseBVHAgainstRay(FBVHNode& Node, FRay Ray, float* tValueOut = nullptr, FIntersection* IntersectionOut = nullptr);
+	/**
+	* Fills in a world space intersection with a triangle.
+	* @param Triangle - Index of the intersected triangle
+	* @param Ray - Object space ray
+	* @param t - t value of the intersection
+	* @param Alpha, Beta - barycentric coordinates of the second and third vertex at the intersection
+	*/
+	void ConstructIntersection(const uint32_t Triangle, const FRay& Ray, const float t, const float Alpha, const float Beta, FIntersection& IntersectionOut);
 
 private:
-	FBVHNode mBVHRoot; /* Root node for the mesh BVH */
+	std::shared_ptr<FMeshData> mData; /* Triangles and BVH, shared with instances of the mesh */
 };
-
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Vector2.h"
+#include "Vector3.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+* Geometry of a Wavefront .obj model. The file is memory mapped and split into chunks that are
+* parsed on separate threads, with numbers read in place without copying the text.
+* Faces may have any number of corners, each with a position and optional texture coordinate
+* and normal (v, v/vt, v//vn or v/vt/vn). Negative indices count back from the last element
+* read, and polygons are split into a fan of triangles around their first corner.
+*/
+struct FObjModel
+{
+	/* Index of a texture coordinate or normal that a triangle corner doesn't have */
+	static const uint32_t NoIndex = 0xFFFFFFFF;
+
+	/**
+	* Reads a model, replacing any geometry already in this object.
+	* @param Filepath - The .obj file
+	* @param NumThreads - Threads to parse with, 0 for the hardware thread count
+	* @return False if the file could not be opened.
+	*/
+	bool Read(const std::string& Filepath, uint32_t NumThreads = 0);
+
+	/**
+	* Gets the number of triangles in the model.
+	*/
+	size_t GetNumTriangles() const;
+
+	std::vector<Vector3f> Vertices; /* Vertex positions */
+	std::vector<Vector2f> UVs; /* Texture coordinates */
+	std::vector<Vector3f> Normals; /* Vertex normals, as given in the file */
+
+	/* Three indices per triangle, corners are in the file's order */
+	std::vector<uint32_t> VertexIndices;
+	std::vector<uint32_t> UVIndices; /* NoIndex unless every corner has a texture coordinate */
+	std::vector<uint32_t> NormalIndices; /* NoIndex unless every corner has a normal */
+
+	uint32_t NumSkippedTriangles{ 0 }; /* Triangles dropped for referring to missing vertices */
+};
@@ -24,16 +24,10 @@ public:
 	*/
 	bool IsIntersectingRay(FRay Ray, float* tValueOut = nullptr, FIntersection* IntersectionOut = nullptr) override;
 
-	/**
-	* Retrieves the material for the plane.
-	* @return The material
-	*/
-	FMaterial GetMaterial(Vector3f SurfacePoint) override;
-
 private:
 	/**
 	* Constructs intersection properties for a point on this plane
-	* @param IntersectionPoint - the point of the intersection
+	* @param IntersectionPoint - the point of the intersection in object space
 	* @param IntersectionOut - intersection properties will be output through
 	*/
 	void ConstructIntersection(Vector3f IntersectionPoint, FIntersection& IntersectionOut);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+* Small, fast pseudo random number generator (PCG32 by Melissa O'Neill).
+* Each generator owns its state, so every thread or pixel can use its own
+* stream without locking. Generators built from the same seed and stream
+* always produce the same sequence.
+*/
+class FRandom
+{
+public:
+	/**
+	* Constructs a generator.
+	* @param Seed - Starting state of the sequence
+	* @param Stream - Selects one of 2^63 independent sequences for the seed
+	*/
+	FRandom(uint64_t Seed = 0, uint64_t Stream = 0);
+
+	/**
+	* Generates the next number in the sequence.
+	* @return A uniformly distributed 32 bit integer
+	*/
+	uint32_t NextUInt();
+
+	/**
+	* Generates the next number in the sequence as a float.
+	* @return A uniformly distributed value in [0, 1)
+	*/
+	float NextFloat();
+
+private:
+	uint64_t mState; /* Current state of the generator */
+	uint64_t mIncrement; /* Stream selector, always odd */
+};
+
+
+inline FRandom::FRandom(uint64_t Seed, uint64_t Stream)
+	: mState(0)
+	, mIncrement((Stream << 1u) | 1u)
+{
+	NextUInt();
+	mState += Seed;
+	NextUInt();
+}
+
+inline uint32_t FRandom::NextUInt()
+{
+	const uint64_t OldState = mState;
+	mState = OldState * 6364136223846793005ULL + mIncrement;
+
+	// permute the old state with a random rotation of an xorshift
+	const uint32_t XorShifted = (uint32_t)(((OldState >> 18u) ^ OldState) >> 27u);
+	const uint32_t Rotation = (uint32_t)(OldState >> 59u);
+	return (XorShifted >> Rotation) | (XorShifted << ((0u - Rotation) & 31u));
+}
+
+inline float FRandom::NextFloat()
+{
+	// use the upper 24 bits so every value is exactly representable
+	return (NextUInt() >> 8) * (1.0f / 16777216.0f);
+}
+
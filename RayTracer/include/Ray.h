@@ -1,21 +1,33 @@
 #pragma once
 #include "Vector3.h"
 #include <limits>
+#include <cstdint>
+
+class IDrawable;
 
 /**
 * Class for representing a ray in 3D space.
 */
 struct FRay
 {
+	/* Value of ignorePrimitive that ignores every primitive of the ignored object */
+	static const uint32_t AllPrimitives = 0xFFFFFFFF;
+
 	/**
 	* Constructs a ray from an origin point that points in a 
 	* given direction.
 	* @param OriginiPoint - The origin of the ray
 	* @param DirectionVector - A direction for the ray (not normalized on construction)
+	* @param IgnoredObject - (optional) A primitive the ray will never intersect, usually
+	*						the surface the ray is spawned from
+	* @param IgnoredPrimitive - (optional) Index of the primitive within IgnoredObject to skip,
+	*						for objects made of many primitives such as meshes
 	*/
-	inline FRay(Vector3f OriginPoint = Vector3f(), Vector3f DirectionVector = Vector3f())
+	inline FRay(Vector3f OriginPoint = Vector3f(), Vector3f DirectionVector = Vector3f(), const IDrawable* IgnoredObject = nullptr, uint32_t IgnoredPrimitive = AllPrimitives)
 		: origin(OriginPoint)
 		, direction(DirectionVector)
+		, ignoreObject(IgnoredObject)
+		, ignorePrimitive(IgnoredPrimitive)
 	{
 	}
 
@@ -32,5 +44,7 @@ struct FRay
 
 	Vector3f origin;		/* Origin or ray */
 	Vector3f direction;		/* Direction of ray */
+	const IDrawable* ignoreObject;	/* Primitive that is skipped during intersection tests */
+	uint32_t ignorePrimitive;		/* Primitive of ignoreObject that is skipped, or AllPrimitives */
 };
 
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "AABB.h"
+#include "Ray.h"
+#include "VectorRegister.h"
+
+#include <bitset>
+#include <cstdint>
+#include <limits>
+
+/**
+* A bundle of up to 16 coherent rays, such as the primary rays of neighbouring pixels,
+* that are traced through the scene together. Rays are kept as FRays for objects that are
+* intersected one ray at a time, and as arrays of components so groups of four rays can be
+* tested against a box or triangle with one SIMD instruction per operation.
+* Sets of rays are passed around as bit masks, bit i selects ray i.
+*/
+struct FRayPacket
+{
+	/* Largest number of rays in a packet */
+	static const uint32_t MaxSize = 16;
+
+	/* Number of rays in a SIMD group */
+	static const uint32_t GroupSize = 4;
+
+	/**
+	* Creates a packet from a list of rays.
+	* @param PacketRays - Rays of the packet
+	* @param NumRays - Number of rays, between 1 and MaxSize
+	* @param tMaxValue - Initial closest intersection t value of every ray
+	*/
+	FRayPacket(const FRay* PacketRays, uint32_t NumRays, float tMaxValue = std::numeric_limits<float>::max());
+
+	/**
+	* Gets the mask that selects every ray in the packet.
+	*/
+	uint32_t GetFullMask() const;
+
+	/**
+	* Finds the rays that overlap a box between t = 0 and their closest intersection.
+	* The packet must be coherent.
+	* @param Bounds - Box to test
+	* @param ActiveMask - Rays to test
+	* @return Mask of the tested rays that overlap the box.
+	*/
+	uint32_t GetOverlappingRays(const AABB& Bounds, uint32_t ActiveMask) const;
+
+	/**
+	* Counts the rays in a mask.
+	*/
+	static uint32_t CountRays(uint32_t Mask);
+
+	/**
+	* Gets the index of the lowest ray in a non-empty mask.
+	*/
+	static uint32_t GetFirstRay(uint32_t Mask);
+
+	FRay Rays[MaxSize]; /* Rays of the packet */
+
+	/* Ray components, ray i is at index i. Unused entries repeat the last ray. */
+	RAYTRACER_ALIGN(16) float OriginX[MaxSize];
+	RAYTRACER_ALIGN(16) float OriginY[MaxSize];
+	RAYTRACER_ALIGN(16) float OriginZ[MaxSize];
+	RAYTRACER_ALIGN(16) float DirectionX[MaxSize];
+	RAYTRACER_ALIGN(16) float DirectionY[MaxSize];
+	RAYTRACER_ALIGN(16) float DirectionZ[MaxSize];
+	RAYTRACER_ALIGN(16) float InvDirectionX[MaxSize];
+	RAYTRACER_ALIGN(16) float InvDirectionY[MaxSize];
+	RAYTRACER_ALIGN(16) float InvDirectionZ[MaxSize];
+	RAYTRACER_ALIGN(16) float tMax[MaxSize]; /* t value of the closest intersection found for each ray */
+
+	uint32_t Size; /* Number of rays in the packet */
+	bool IsCoherent; /* True if every ray has the same direction sign on each axis */
+	bool IsDirectionNegative[3]; /* Direction signs shared by the rays of a coherent packet */
+};
+
+
+inline FRayPacket::FRayPacket(const FRay* PacketRays, uint32_t NumRays, float tMaxValue)
+	: Size(NumRays)
+	, IsCoherent(true)
+{
+	for (uint32_t i = 0; i < MaxSize; i++)
+	{
+		const FRay& Ray = PacketRays[(i < NumRays) ? i : NumRays - 1];
+		Rays[i] = Ray;
+		OriginX[i] = Ray.origin.x;
+		OriginY[i] = Ray.origin.y;
+		OriginZ[i] = Ray.origin.z;
+		DirectionX[i] = Ray.direction.x;
+		DirectionY[i] = Ray.direction.y;
+		DirectionZ[i] = Ray.direction.z;
+		InvDirectionX[i] = 1.0f / Ray.direction.x;
+		InvDirectionY[i] = 1.0f / Ray.direction.y;
+		InvDirectionZ[i] = 1.0f / Ray.direction.z;
+		tMax[i] = tMaxValue;
+	}
+
+	const float* InvDirections[3] = { InvDirectionX, InvDirectionY, InvDirectionZ };
+	for (int Axis = 0; Axis < 3; Axis++)
+	{
+		IsDirectionNegative[Axis] = InvDirections[Axis][0] < 0.0f;
+		for (uint32_t i = 1; i < NumRays; i++)
+		{
+			IsCoherent &= (InvDirections[Axis][i] < 0.0f) == IsDirectionNegative[Axis];
+		}
+	}
+}
+
+inline uint32_t FRayPacket::GetFullMask() const
+{
+	return (1u << Size) - 1;
+}
+
+inline uint32_t FRayPacket::GetOverlappingRays(const AABB& Bounds, uint32_t ActiveMask) const
+{
+	// the near and far slab of each axis are picked from the shared direction signs
+	const float* Origins[3] = { OriginX, OriginY, OriginZ };
+	const float* InvDirections[3] = { InvDirectionX, InvDirectionY, InvDirectionZ };
+	VectorRegister NearPlanes[3], FarPlanes[3];
+	for (int Axis = 0; Axis < 3; Axis++)
+	{
+		NearPlanes[Axis] = VectorSetFloat1(IsDirectionNegative[Axis] ? Bounds.Max[Axis] : Bounds.Min[Axis]);
+		FarPlanes[Axis] = VectorSetFloat1(IsDirectionNegative[Axis] ? Bounds.Min[Axis] : Bounds.Max[Axis]);
+	}
+
+	uint32_t OverlapMask = 0;
+	for (uint32_t Group = 0; Group * GroupSize < Size; Group++)
+	{
+		const uint32_t First = Group * GroupSize;
+		if (((ActiveMask >> First) & 0xF) == 0)
+			continue;
+
+		// same slab test as AABB::IsOverlappingSegment, NaNs leave the segment unchanged
+		VectorRegister tNear = VectorSetFloat1(0.0f);
+		VectorRegister tFar = VectorLoadAligned(&tMax[First]);
+		for (int Axis = 0; Axis < 3; Axis++)
+		{
+			const VectorRegister Origin = VectorLoadAligned(&Origins[Axis][First]);
+			const VectorRegister InvDirection = VectorLoadAligned(&InvDirections[Axis][First]);
+			tNear = VectorMax(VectorMultiply(VectorSubtract(NearPlanes[Axis], Origin), InvDirection), tNear);
+			tFar = VectorMin(VectorMultiply(VectorSubtract(FarPlanes[Axis], Origin), InvDirection), tFar);
+		}
+
+		OverlapMask |= VectorMaskBits(VectorCompareLE(tNear, tFar)) << First;
+	}
+
+	return OverlapMask & ActiveMask;
+}
+
+inline uint32_t FRayPacket::CountRays(uint32_t Mask)
+{
+	return (uint32_t)std::bitset<32>(Mask).count();
+}
+
+inline uint32_t FRayPacket::GetFirstRay(uint32_t Mask)
+{
+	uint32_t Ray = 0;
+	while (!(Mask & (1u << Ray)))
+		Ray++;
+	return Ray;
+}
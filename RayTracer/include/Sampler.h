@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Vector2.h"
+#include "Random.h"
+
+#include <cstdint>
+#include <string>
+
+/**
+* Sequences that camera and light samples are drawn from.
+*/
+enum class ESampler
+{
+	Jittered,	/* One random point in each cell of a square grid */
+	Halton,		/* Halton sequence in bases 2 and 3, shifted by a random offset */
+	Sobol,		/* Sobol (0,2)-sequence with a random Owen scramble */
+	BlueNoise	/* Owen scrambled Sobol sequence shared by neighbouring pixels, so their errors form blue noise */
+};
+
+/**
+* A set of 2D sample points in [0, 1)^2. One set is drawn for each group of samples that
+* estimate the same integral, such as the camera samples of a pixel or the shadow samples
+* of a light from one surface point. Points are computed from their index, so they can be
+* taken in any order, and any number of them is well spread over the square.
+*/
+struct FSampleSet
+{
+	/**
+	* Gets a point of the set.
+	* @param Sample - Index of the point, less than NumSamples
+	* @return The point in [0, 1)^2.
+	*/
+	Vector2f GetPoint(uint32_t Sample) const;
+
+	ESampler Sampler; /* Sequence the points are taken from */
+	uint32_t NumSamples; /* Number of points in the set */
+	uint32_t NumRows; /* Jittered: rows of the grid, the first NumSamples % NumRows rows have a column more than the others */
+	uint32_t Scramble; /* Seed of the random scramble of the sequence */
+	uint32_t FirstIndex; /* Halton, Sobol and BlueNoise: index of the set's first point in the sequence */
+	Vector2f Offset; /* Halton: toroidal shift of every point */
+};
+
+/**
+* Draws the sample sets of one pixel. Each pixel has its own scramble of the sequence,
+* so pixels don't share the same error pattern. With blue noise sampling, neighbouring
+* pixels instead take neighbouring parts of one sequence, which spreads their error as high frequency noise.
+*/
+class FPixelSampler
+{
+public:
+	/**
+	* Constructs a sampler for a pixel.
+	* @param Sampler - Sequence to take samples from
+	* @param Seed - Seed of the render, the same seed gives the same samples
+	* @param Pixel - Coordinates of the pixel
+	* @param Resolution - Resolution of the image, in pixels
+	* @param Pass - Render pass the pixel is traced in, each pass draws different sets
+	*/
+	FPixelSampler(ESampler Sampler, uint32_t Seed, const Vector2i& Pixel, const Vector2i& Resolution, uint32_t Pass);
+
+	/**
+	* Gets the set of points that the pixel's camera samples are taken at. The set is the same
+	* in every pass, so passes can take different samples of it.
+	* @param NumSamples - Number of camera samples of the pixel
+	* @param Round - Renders that take more samples than that take them in rounds of NumSamples, each round
+	*				continues the sequence of the ones before it, or scrambles a jittered grid again
+	*/
+	FSampleSet GetPixelSet(uint32_t NumSamples, uint32_t Round = 0) const;
+
+	/**
+	* Draws a new set of points, such as the shadow samples of a light from a surface point.
+	* @param NumSamples - Number of points in the set
+	*/
+	FSampleSet NextSet(uint32_t NumSamples);
+
+	/**
+	* Gets the name of a sampler, as it is written in the image config.
+	*/
+	static const char* GetName(ESampler Sampler);
+
+	/**
+	* Looks up a sampler by name.
+	* @param Name - Name of the sampler, as returned by GetName
+	* @param SamplerOut - Receives the sampler
+	* @return False if no sampler has the name.
+	*/
+	static bool FindSampler(const std::string& Name, ESampler& SamplerOut);
+
+private:
+	/**
+	* Sets up a set with the given scramble of the sequence.
+	* @param NumSamples - Number of points in the set
+	* @param Scramble - Seed of the scramble
+	*/
+	FSampleSet MakeSet(uint32_t NumSamples, uint32_t Scramble) const;
+
+	ESampler mSampler; /* Sequence to take samples from */
+	uint32_t mSeed; /* Seed of the render */
+	Vector2i mPixel; /* Coordinates of the pixel */
+	uint32_t mPass; /* Render pass the pixel is traced in */
+	uint32_t mNumSets; /* Sets drawn with NextSet so far */
+	FRandom mRandom; /* Scrambles of the pixel's sets */
+};
@@ -5,10 +5,36 @@
 #include "KDTree.h"
 #include "Light.h"
 #include "Drawable.h"
+#include "Mesh.h"
+#include "Sampler.h"
 
 #include <vector>
 #include <memory>
 #include <istream>
+#include <atomic>
+#include <mutex>
+
+/**
+* Selects how the rays of an image are traced and shaded.
+*/
+enum class EIntegrator
+{
+	Recursive,	/* Each camera ray is traced and shaded depth first by TraceRay */
+	Wavefront	/* The rays of a tile are traced a bounce at a time, as streams of camera, shadow and secondary rays */
+};
+
+/**
+* Number of rays cast during a render.
+*/
+struct FRayStats
+{
+	uint64_t CameraRays;
+	uint64_t ShadowRays;
+	uint64_t ShadowTests;	/* Times a surface point was tested for shadows from a light, each test casts one or more shadow rays */
+	uint64_t SecondaryRays;	/* Reflection and refraction rays that were traced */
+	uint64_t SkippedRays;	/* Reflection and refraction rays that were not traced because their weight was below the threshold */
+	uint64_t ReusedRays;	/* Traces saved by sharing one reflection or refraction ray between all lights of a hit */
+};
 
 /** 
 * Represents a scene that will be raytraced 
@@ -20,10 +46,30 @@ public:
 	using PrimitivePtr = std::unique_ptr<IDrawable>;
 	using LightPtr = std::unique_ptr<ILight>;
 
+	/* Default weight below which reflection and refraction rays are not traced */
+	static const float DefaultMinRayWeight;
+
+	/* Default contrast above which adaptive supersampling takes every sample of a pixel */
+	static const float DefaultSuperSamplingThreshold;
+
 	/**
 	* Default constructor.
+	* @param PacketSize - Number of camera rays traced together as a packet, 0 or 1 traces them one at a time
+	* @param Integrator - How the rays of the image are traced and shaded
+	* @param MinRayWeight - Reflection and refraction rays whose estimated contribution to the pixel is below this are not traced
+	* @param ImageFormat - File format of the output image
+	* @param UseAdaptiveShadows - Soft shadows start with a few probe samples, the rest are only taken if the probes disagree
+	* @param UseAdaptiveSuperSampling - Pixels start with a few camera samples, the rest are only taken where the image varies
+	* @param SuperSamplingThreshold - Contrast with a neighbour, or deviation between samples, above which a pixel takes every sample
+	* @param Sampler - Sequence the camera and light samples are taken from
+	* @param TimeBudget - Seconds a progressive render may take, 0 for no limit
+	* @param TargetNoise - Standard error of a pixel's color below which a progressive render stops tracing it, 0 for no target
+	* @param WriteInterval - Seconds between the intermediate images of a progressive render, 0 to only write the final image
 	*/
-	FScene(const std::string& OutputName, const Vector2i& OutputResolution, const uint16_t NumShadowSamples, const uint16_t SuperSamplingLevel);
+	FScene(const std::string& OutputName, const Vector2i& OutputResolution, const uint16_t NumShadowSamples, const uint16_t SuperSamplingLevel, const uint16_t NumThreads, const uint32_t Seed,
+		const uint32_t PacketSize = 0, const EIntegrator Integrator = EIntegrator::Recursive, const float MinRayWeight = DefaultMinRayWeight, const EImageFormat ImageFormat = EImageFormat::PPM,
+		const bool UseAdaptiveShadows = false, const bool UseAdaptiveSuperSampling = false, const float SuperSamplingThreshold = DefaultSuperSamplingThreshold,
+		const ESampler Sampler = ESampler::Jittered, const float TimeBudget = 0.0f, const float TargetNoise = 0.0f, const float WriteInterval = 0.0f);
 
 	// Don't allow copies of a scene
 	FScene& operator=(const FScene& Copy) = delete;
@@ -32,24 +78,373 @@ public:
 	* Builds the scene. 
 	* Add the camera, lights, and geometry to the scene.
 	* @param SceneConfig - Scene setup file stream
+	* @param TreeBuilder - Algorithm used to build the scene KD-tree
+	* @param MeshLeafTriangles - Max triangles in a leaf of each model's BVH
+	* @param UseMeshCache - Load and save each model's triangles and BVH in a cache file next to the model
 	*/
-	void BuildScene(std::istream& SceneConfig);
+	void BuildScene(std::istream& SceneConfig, EKDTreeBuilder TreeBuilder = EKDTreeBuilder::SAH, uint32_t MeshLeafTriangles = FMesh::DefaultMaxLeafTriangles, bool UseMeshCache = false);
 
 	/**
 	* Traces a ray into the scene and computes the resulting color
 	* from the source point.
 	* @param CameraRay - A ray generated from the viewpoint through a pixel
 	*						on the screen.
+	* @param Depth - Number of reflection and refraction bounces left
+	* @param Sampler - Sampler of the source pixel, used for soft shadow samples
+	* @param Stats - Receives the number of rays cast
+	* @param Weight - Estimated largest contribution of the ray's color to the pixel
 	* @return The resulting color for the source pixel.
 	*/
-	FColor TraceRay(const FRay& CameraRay, int32_t Depth);
+	FColor TraceRay(const FRay& CameraRay, int32_t Depth, FPixelSampler& Sampler, FRayStats& Stats, float Weight = 1.0f);
+
+	/**
+	* Computes the color seen by a ray from its closest intersection.
+	* @param CameraRay - The ray that was intersected with the scene
+	* @param ClosestIntersection - Closest intersection of the ray, the background is seen if it has no object
+	* @param Depth - Number of reflection and refraction bounces left
+	* @param Sampler - Sampler of the source pixel, used for soft shadow samples
+	* @param Stats - Receives the number of rays cast
+	* @param Weight - Estimated largest contribution of the ray's color to the pixel
+	* @return The resulting color for the ray.
+	*/
+	FColor ShadeIntersection(const FRay& CameraRay, FIntersection ClosestIntersection, int32_t Depth, FPixelSampler& Sampler, FRayStats& Stats, float Weight = 1.0f);
 
 	/**
-	* Renders the scene to an image.
+	* Renders the scene to an image. The image is split into tiles that
+	* are handed out to a pool of worker threads. Rows of the image are written
+	* to the output file as soon as they are finished.
+	* With adaptive supersampling, a first pass traces a few samples of every pixel and a
+	* second pass traces the rest of the samples of pixels that differ from their neighbours
+	* or whose samples disagree.
+	* With a time budget or a target noise, the render is progressive instead, see RenderProgressive.
 	*/
 	void RenderScene();
 
+	/**
+	* Gets the number of rays cast by the last render.
+	*/
+	FRayStats GetRayStats() const;
+
 private:
+	/**
+	* Camera samples traced by one pass over the image. The samples of a pixel are numbered
+	* in the order they are taken, and each pass traces a range of them.
+	*/
+	struct FRenderPass
+	{
+		uint32_t Index;				/* Each pass draws from its own random stream of each pixel */
+		uint32_t FirstSample;		/* First sample of each pixel traced by the pass */
+		uint32_t NumSamples;		/* Samples traced for each pixel */
+		const uint8_t* PixelMask;	/* Pixels with a zero entry are not traced, every pixel is traced if null */
+		uint32_t NumPixels;			/* Pixels traced by the pass */
+		bool IsFinal;				/* Pixels are written to the output image at the end of this pass */
+	};
+
+	/* Sum of the camera samples a pass traced for a pixel */
+	struct FPixelSamples
+	{
+		FColor Sum;
+		FColor SquaredSum;	/* Sum of the squared samples, for the variance of the pixel */
+		uint32_t Count;
+
+		FPixelSamples() : Sum(), SquaredSum(), Count(0) {}
+
+		void Add(const FColor& Sample)
+		{
+			Sum += Sample;
+			SquaredSum += Sample * Sample;
+			Count++;
+		}
+	};
+
+	/* Rays of a wavefront bounce, stored as separate arrays so each kernel walks contiguous memory */
+	struct FRayStream
+	{
+		std::vector<FRay> Rays;
+		std::vector<uint32_t> Samples;	/* Camera sample each ray was spawned for */
+		std::vector<uint32_t> Targets;	/* Slot of the previous bounce that receives the color of each ray */
+		std::vector<float> Weights;		/* Estimated largest contribution of each ray to its pixel */
+
+		void Add(const FRay& Ray, uint32_t Sample, uint32_t Target, float Weight)
+		{
+			Rays.push_back(Ray);
+			Samples.push_back(Sample);
+			Targets.push_back(Target);
+			Weights.push_back(Weight);
+		}
+
+		void Clear()
+		{
+			Rays.clear();
+			Samples.clear();
+			Targets.clear();
+			Weights.clear();
+		}
+	};
+
+	/* A shaded hit, waiting on the colors of its reflection and refraction rays */
+	struct FStreamHit
+	{
+		Vector3f Point;
+		Vector3f Normal;
+		Vector3f RayDirection;		/* Direction of the ray that hit the surface */
+		FSurfaceProperties Surface;
+		const IDrawable* Object;
+		uint32_t Primitive;
+		uint32_t Sample;			/* Camera sample the hit contributes to */
+		uint32_t Target;			/* Slot of the previous bounce that receives the color of the hit */
+		float Weight;				/* Weight of the ray that hit the surface */
+		uint32_t FirstLight;		/* Range of the bounce's light colors that reach the hit */
+		uint32_t NumLights;
+	};
+
+	/* A light seen from a hit, with the range of shadow rays that decide how much of it arrives */
+	struct FStreamLight
+	{
+		uint32_t Hit;
+		FColor Color;
+		Vector3f Direction;
+		float Distance;
+		const ILight* Source;
+		FLightSampleFrame SampleFrame;	/* Frame of the light's soft shadow samples */
+		FSampleSet SampleSet;		/* Points of the light's soft shadow samples */
+		uint32_t FirstShadowRay;	/* Shadow rays of the light in the stream being traced */
+		uint32_t NumShadowRays;
+		uint32_t NumSamples;		/* Shadow rays traced for the light so far */
+		uint32_t NumShadowed;		/* Traced shadow rays that were blocked */
+	};
+
+	/* Hits of one bounce of a wavefront */
+	struct FStreamBounce
+	{
+		std::vector<FStreamHit> Hits;
+		std::vector<FColor> LightColors;		/* Direct light of each light that reaches a hit, grouped by hit */
+		std::vector<FColor> SecondaryColors;	/* Reflection and refraction color of each hit */
+	};
+
+	/**
+	* Renders the image progressively. Each pass adds one sample on each row and column of the
+	* supersampling grid to every pixel, and later passes continue the pixels' sample sequences past
+	* the grid. Passes stop when the next one is expected to take the render past its time budget, or
+	* when every pixel is below the target noise, pixels below it are not traced by later passes.
+	* The image is written every write interval, and once the render stops.
+	*/
+	void RenderProgressive();
+
+	/**
+	* Checks if the render is progressive, which it is with a time budget or a target noise.
+	*/
+	bool IsProgressive() const;
+
+	/**
+	* Writes the average of every pixel's samples so far to the output image file.
+	* @param IsFinal - False for an intermediate image, which is not opened in a viewer
+	*/
+	void WriteAveragedImage(const bool IsFinal);
+
+	/**
+	* Traces the camera samples of a render pass for every pixel of the image, a tile at a time
+	* on the worker threads.
+	* @param Pass - Samples to trace
+	*/
+	void RenderPass(const FRenderPass& Pass);
+
+	/**
+	* Renders a rectangular region of the output image.
+	* @param Start - Top left pixel of the region (inclusive)
+	* @param End - Bottom right pixel of the region (exclusive)
+	* @param Pass - Samples to trace
+	*/
+	void RenderTile(const Vector2i& Start, const Vector2i& End, const FRenderPass& Pass);
+
+	/**
+	* Renders a rectangular region of the output image, tracing the camera rays of
+	* small blocks of pixels as packets. The image is the same as RenderTile's.
+	* @param Start - Top left pixel of the region (inclusive)
+	* @param End - Bottom right pixel of the region (exclusive)
+	* @param Pass - Samples to trace
+	* @param Stats - Receives the number of rays cast
+	*/
+	void RenderTilePackets(const Vector2i& Start, const Vector2i& End, const FRenderPass& Pass, FRayStats& Stats);
+
+	/**
+	* Renders a rectangular region of the output image with the wavefront integrator. The
+	* region is rendered a tile at a time with TraceRayStreams.
+	* @param Start - Top left pixel of the region (inclusive)
+	* @param End - Bottom right pixel of the region (exclusive)
+	* @param Pass - Samples to trace
+	* @param Stats - Receives the number of rays cast
+	*/
+	void RenderTileWavefront(const Vector2i& Start, const Vector2i& End, const FRenderPass& Pass, FRayStats& Stats);
+
+	/**
+	* Traces a batch of camera rays a bounce at a time. Each bounce intersects its whole ray stream,
+	* traces the shadow rays of every hit as a second stream, and queues the reflection and refraction
+	* rays of the hits as the stream of the next bounce. Rays that miss are dropped from the streams.
+	* Colors are resolved from the last bounce back to the camera once every bounce is traced, with
+	* the same shading steps as TraceRay.
+	* @param CameraRays - Camera rays, the samples of each pixel are next to each other
+	* @param PixelSamplers - Sampler of each pixel, used for soft shadow samples. Every pixel has the same number of samples.
+	* @param SampleColorsOut - Color of each camera ray
+	* @param Stats - Receives the number of rays cast
+	*/
+	void TraceRayStreams(const std::vector<FRay>& CameraRays, std::vector<FPixelSampler>& PixelSamplers, std::vector<FColor>& SampleColorsOut, FRayStats& Stats);
+
+	/**
+	* Generates the camera rays of a region, in 4x4 pixel blocks that are each gathered in Morton order.
+	* @param Start - Top left pixel of the region (inclusive)
+	* @param End - Bottom right pixel of the region (exclusive)
+	* @param Pass - Samples to generate, pixels outside the pass mask are left out
+	* @param PixelsOut - Pixels of the region in the order their rays were added
+	* @param SamplersOut - Sampler of each pixel
+	* @param RaysOut - Camera rays of each pixel, next to each other
+	*/
+	void GatherCameraRays(const Vector2i& Start, const Vector2i& End, const FRenderPass& Pass, std::vector<Vector2i>& PixelsOut, std::vector<FPixelSampler>& SamplersOut, std::vector<FRay>& RaysOut);
+
+	/**
+	* Finds the closest intersection of each ray in a list.
+	* @param Rays - Rays to intersect
+	* @param IsCoherent - True if neighbouring rays are coherent enough to be traced as packets
+	* @param IntersectionsOut - Closest intersection of each ray
+	*/
+	void IntersectRays(const std::vector<FRay>& Rays, const bool IsCoherent, std::vector<FIntersection>& IntersectionsOut);
+
+	/**
+	* Adds the sample colors of each pixel to the pixels with AddPixelSamples.
+	* @param Pixels - Pixels that were traced
+	* @param SampleColors - Colors of the samples of each pixel, next to each other
+	* @param Pass - The pass that traced the samples
+	*/
+	void WritePixels(const std::vector<Vector2i>& Pixels, const std::vector<FColor>& SampleColors, const FRenderPass& Pass);
+
+	/**
+	* Adds the samples a pass traced for a pixel to the samples of earlier passes. After the final
+	* pass, the average of all samples of the pixel is written to the output image.
+	* @param X - x coordinate of the pixel
+	* @param Y - y coordinate of the pixel
+	* @param Samples - Samples of the pixel traced by the pass
+	* @param Pass - The pass that traced the samples
+	*/
+	void AddPixelSamples(int32_t X, int32_t Y, const FPixelSamples& Samples, const FRenderPass& Pass);
+
+	/**
+	* Writes the pixels of a region that the final pass did not trace to the output image.
+	* @param Start - Top left pixel of the region (inclusive)
+	* @param End - Bottom right pixel of the region (exclusive)
+	* @param Pass - The final pass
+	*/
+	void WriteUntracedPixels(const Vector2i& Start, const Vector2i& End, const FRenderPass& Pass);
+
+	/**
+	* Traces the camera samples of a pass for a single pixel.
+	* @param X - x coordinate of the pixel
+	* @param Y - y coordinate of the pixel
+	* @param Pass - Samples to trace
+	* @param Stats - Receives the number of rays cast
+	* @return The samples taken for the pixel
+	*/
+	FPixelSamples RenderPixel(int32_t X, int32_t Y, const FRenderPass& Pass, FRayStats& Stats);
+
+	/**
+	* Gets the sampler of a pixel for a pass. The camera samples of every pass are taken from
+	* the pixel's set, and shading draws new sets from it.
+	*/
+	FPixelSampler GetPixelSampler(int32_t X, int32_t Y, const FRenderPass& Pass) const;
+
+	/**
+	* Gets the sample set of a pixel's camera samples in a pass. Samples past the supersampling
+	* grid are taken from later rounds of the pixel's set.
+	*/
+	FSampleSet GetCameraSampleSet(const FPixelSampler& Sampler, const FRenderPass& Pass) const;
+
+	/**
+	* Generates a camera ray of a pixel. Without supersampling, the ray goes through the pixel's center
+	* unless the render is progressive, where every pass takes a new point of the pixel's set.
+	* @param Sample - Index of the sample in the order the pixel's samples are taken
+	* @param PixelSet - Sample set of the pixel's camera samples, from GetCameraSampleSet
+	*/
+	FRay GenerateCameraRay(int32_t X, int32_t Y, uint32_t Sample, const FSampleSet& PixelSet) const;
+
+	/**
+	* Marks the pixels that adaptive supersampling takes every sample of, from the samples of the first pass.
+	* A pixel is refined when the deviation of its samples, or the difference between its color and a
+	* neighbour's, is above the supersampling threshold in any channel.
+	* @param PixelMaskOut - One entry per pixel, nonzero for pixels that are refined
+	* @return The number of refined pixels.
+	*/
+	uint32_t FindPixelsToRefine(std::vector<uint8_t>& PixelMaskOut) const;
+
+	/**
+	* Marks the pixels of a progressive render that are above the target noise. The noise of a pixel
+	* is the standard error of its average color, in the channel where it is highest. Samples of a
+	* sequence are spread more evenly than random ones, so this overestimates their error.
+	* @param PixelMaskOut - One entry per pixel, nonzero for pixels above the target noise
+	* @param NoiseOut - Receives the root mean square noise of all pixels
+	* @return The number of pixels above the target noise.
+	*/
+	uint32_t FindNoisyPixels(std::vector<uint8_t>& PixelMaskOut, float& NoiseOut) const;
+
+	/**
+	* Adds the rays a worker cast for a tile to the counts of the render. Workers count rays
+	* locally and add them once per tile, so they don't contend on the shared counters.
+	*/
+	void AddRayStats(const FRayStats& Stats);
+
+	/**
+	* Adds a number of finished pixels to the render progress and
+	* displays the progress to the console. Progressive renders report each pass instead.
+	* @param NumPixels - Number of pixels that were completed
+	*/
+	void ReportProgress(uint32_t NumPixels);
+
+	/**
+	* Computes the diffuse and specular light reflected towards the viewer from a single light.
+	* @param SurfaceNormal - The Normalized surface normal
+	* @param ViewerDirection - The Normalized direction of the viewer
+	* @param LightDirection - The Normalized direction of the light
+	* @param LightColor - Color of the light that arrives at the surface
+	* @param Surface - Material properties of the surface
+	* @return The reflected color.
+	*/
+	FColor ComputeDirectLight(const Vector3f& SurfaceNormal, const Vector3f& ViewerDirection, const Vector3f& LightDirection, const FColor& LightColor, const FSurfaceProperties& Surface) const;
+
+	/**
+	* Combines the direct light of each light that reaches a surface with the reflection and
+	* refraction seen from it. Each light mixes in the refraction and adds a reflection scaled
+	* by the color so far, in the order of the lights.
+	* @param LightColors - Direct light of each light that reaches the surface, from ComputeDirectLight
+	* @param NumLights - Number of light colors
+	* @param Reflection - Color seen in the mirror direction
+	* @param Refraction - Color seen through the surface, only used by transparent surfaces
+	* @param Surface - Material properties of the surface
+	* @return The surface color without ambient light.
+	*/
+	FColor CombineLighting(const FColor* LightColors, const uint32_t NumLights, const FColor& Reflection, const FColor& Refraction, const FSurfaceProperties& Surface) const;
+
+	/**
+	* Estimates the largest contribution of a surface's reflection and refraction rays to the pixel.
+	* The reflection scales the lit color of the surface, which is estimated from the direct light.
+	* @param LightColors - Direct light of each light that reaches the surface
+	* @param NumLights - Number of light colors
+	* @param Surface - Material properties of the surface
+	* @param Weight - Weight of the ray that hit the surface
+	* @param ReflectionWeightOut - Weight of the reflection ray
+	* @param RefractionWeightOut - Weight of the refraction ray
+	*/
+	void ComputeSecondaryWeights(const FColor* LightColors, const uint32_t NumLights, const FSurfaceProperties& Surface, const float Weight, float& ReflectionWeightOut, float& RefractionWeightOut) const;
+
+	/**
+	* Traces a reflection or refraction ray that is shared by the lights of a hit, unless its weight is too low.
+	* @param Ray - The secondary ray
+	* @param Depth - Number of reflection and refraction bounces left, including this ray
+	* @param Sampler - Sampler of the source pixel
+	* @param Stats - Receives the number of rays cast
+	* @param Weight - Estimated largest contribution of the ray to the pixel
+	* @param NumLights - Number of lights of the hit that see the ray
+	* @return The color seen by the ray, black if it was skipped.
+	*/
+	FColor TraceSecondaryRay(const FRay& Ray, int32_t Depth, FPixelSampler& Sampler, FRayStats& Stats, float Weight, uint32_t NumLights);
+
 	/**
 	* Computes a specular reflection based on the Blinn Model for Specular Reflection.
 	* @param LightDirection - The Normalized direction of the light
@@ -71,19 +466,27 @@ private:
 	* Checks if a light ray is blocked by another object.
 	* @param LightRay - A ray from the surface point on the Primitive to the light source
 	* @param MaxDistance of the light ray
+	* @param LastOccluder(optional) - Object that blocked an earlier ray from the same point. It is tested
+	*							before the tree and replaced by the blocking object when the point is in a shadow.
 	* @return True if the point is in a shadow
 	*
 	*/
-	bool IsInShadow(const FRay& LightRay, float MaxDistance);
+	bool IsInShadow(const FRay& LightRay, float MaxDistance, IDrawable** LastOccluder = nullptr);
 
 	/**
-	* Computes the factor of a light that is visible to a surface point.
+	* Computes the factor of a light that is visible to a surface point. With adaptive shadows, a few
+	* probe samples spread over the light are taken first, and if they all agree the point is
+	* treated as fully lit or fully shadowed.
 	* @param Light to check against
 	* @param SurfacePoint to test
+	* @param SurfaceObject that the point lies on, it is ignored by the shadow rays
+	* @param SurfacePrimitive of SurfaceObject that the point lies on
+	* @param Sampler Sampler of the source pixel, the shadow samples are a new set drawn from it
+	* @param Stats Receives the number of shadow rays cast
 	* @return Value between 0-1 for the factor of light that is visible to the surface 
 	*
 	*/
-	float ComputeShadeFactor(const ILight& Light, const Vector3f& SurfacePoint);
+	float ComputeShadeFactor(const ILight& Light, const Vector3f& SurfacePoint, const IDrawable* SurfaceObject, const uint32_t SurfacePrimitive, FPixelSampler& Sampler, FRayStats& Stats);
 
 private:
 	FImage mOutputImage; /* Output image for the rendered scene */
@@ -95,5 +498,34 @@ private:
 
 	uint16_t mNumberOfShadowSamples; /* Number of samples to use when generating shadows */
 	uint16_t mSuperSamplingLevel; /* The number of rays generated per pixel is squared this number */
+	uint16_t mNumberOfThreads; /* Number of worker threads used to render the image tiles */
+	uint32_t mSeed; /* Seed for the sample scrambles, each pixel has its own so renders are repeatable */
+	ESampler mSampler; /* Sequence the camera and light samples are taken from */
+	uint32_t mPacketSize; /* Number of camera rays in a packet, packets are not used if this is 1 */
+	EIntegrator mIntegrator; /* How the rays of the image are traced and shaded */
+	float mMinRayWeight; /* Reflection and refraction rays with a lower weight are not traced */
+	bool mUseAdaptiveShadows; /* Soft shadows are probed with a few samples before the rest are taken */
+	bool mUseAdaptiveSuperSampling; /* Pixels take a few camera samples first, and the rest only where the image varies */
+	float mSuperSamplingThreshold; /* Contrast or sample deviation above which a pixel takes every camera sample */
+	float mTimeBudget; /* Seconds a progressive render may take, 0 for no limit */
+	float mTargetNoise; /* Standard error of a pixel's color below which a progressive render stops tracing it, 0 for no target */
+	float mWriteInterval; /* Seconds between the intermediate images of a progressive render, 0 for none */
 	Vector2i mOutputResolution; /* Resolution of the image to be rendered. */
+
+	/* Samples taken for each pixel by the passes of a render, only kept when a render has several passes */
+	std::vector<FColor> mSampleSums;
+	std::vector<FColor> mSquaredSampleSums;
+	std::vector<uint32_t> mSampleCounts;
+
+	std::atomic<uint32_t> mCompletedPixels; /* Number of pixels of the current pass rendered so far */
+	uint32_t mPassPixels; /* Number of pixels traced by the current pass */
+	std::mutex mProgressMutex; /* Serializes progress output from the worker threads */
+
+	/* Ray counts of the current render, see FRayStats */
+	std::atomic<uint64_t> mCameraRays;
+	std::atomic<uint64_t> mShadowRays;
+	std::atomic<uint64_t> mShadowTests;
+	std::atomic<uint64_t> mSecondaryRays;
+	std::atomic<uint64_t> mSkippedRays;
+	std::atomic<uint64_t> mReusedRays;
 };
\ No newline at end of file
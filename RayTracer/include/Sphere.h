@@ -40,19 +40,21 @@ public:
 	*/
 	void SetRadius(const float& Radius);
 
-	/**
-	* Retrieves the material for the sphere.
-	* @return The material
-	*/
-	FMaterial GetMaterial(Vector3f SurfacePoint) override;
-
 private:
 	/**
 	* Constructs intersection properties for a point on this sphere
 	* @param IntersectionPoint - the point of the intersection
+	* @param UV - texture coordinates at the point of the intersection
 	* @param IntersectionOut - intersection properties will be output through
 	*/
-	void ConstructIntersection(Vector3f IntersectionPoint, FIntersection& IntersectionOut);
+	void ConstructIntersection(Vector3f IntersectionPoint, const Vector2f& UV, FIntersection& IntersectionOut);
+
+	/**
+	* Computes the spherical texture coordinates of a point on the sphere.
+	* @param ObjectSpacePoint - the point on the sphere in object space
+	* @return The UV coordinates of the point
+	*/
+	Vector2f ComputeUV(Vector3f ObjectSpacePoint) const;
 
 	void ConstructAABB(Vector3f Min = Vector3f(), Vector3f Max = Vector3f()) override;
 
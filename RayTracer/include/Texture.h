@@ -32,7 +32,7 @@ public:
 	*/
 	FColor GetSample(float U, float V) const;
 
-	friend static bool ReadTGAImage(FTexture& Texture, const std::string& Filename);
+	friend bool ReadTGAImage(FTexture& Texture, const std::string& Filename);
 
 private:
 	std::vector<FColor> mPixels;
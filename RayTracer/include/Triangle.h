@@ -40,12 +40,6 @@ public:
 	*/
 	bool IsIntersectingRay(FRay Ray, float* tValueOut = nullptr, FIntersection* IntersectionOut = nullptr) override;
 
-	/**
-	* Retrieves the material for the triangle.
-	* @return The material
-	*/
-	FMaterial GetMaterial(Vector3f SurfacePoint) override;
-
 	/**
 	* Set the UV texture coordinates for each vertex in the triangle.
 	* @param UV0 First vertex UV
@@ -58,9 +52,10 @@ private:
 	/**
 	* Constructs intersection properties for a point on this triangle
 	* @param IntersectionPoint - the point of the intersection
+	* @param UV - texture coordinates at the point of the intersection
 	* @param IntersectionOut - intersection properties will be output through
 	*/
-	void ConstructIntersection(Vector3f IntersectionPoint, FIntersection* IntersectionOut);
+	void ConstructIntersection(Vector3f IntersectionPoint, const Vector2f& UV, FIntersection* IntersectionOut);
 
 	void ConstructAABB(Vector3f Min = Vector3f(), Vector3f Max = Vector3f()) override;
 
@@ -110,7 +110,7 @@ using Vector2f = TVector2<float>; /* Vector type for floats */
 /////////////////////////////////////////////////////
 
 template <typename T>
-TVector2<T>::TVector2(T X = 0, T Y = 0)
+TVector2<T>::TVector2(T X, T Y)
 	: x(X), y(Y) {}
 
 template <typename T>
@@ -152,7 +152,7 @@ using Vector4f = TVector4<float>; /* Vector type for floats */
 ///////////////////////////////////////////////////////////////////////////
 
 template <typename T>
-TVector4<T>::TVector4(T X = 0.0f, T Y = 0.0f, T Z = 0.0f, T W = 1.0f)
+TVector4<T>::TVector4(T X, T Y, T Z, T W)
 	: x(X), y(Y), z(Z), w(W){}
 
 template <typename T>
@@ -0,0 +1,350 @@
+#pragma once
+
+#include "Vector3.h"
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+/**
+* Four-wide float vector operations used by the math types. The SSE backend is used
+* when the target supports SSE2, otherwise a scalar implementation with the same
+* results is used. Define RAYTRACER_NO_SIMD to force the scalar backend.
+*/
+#if !defined(RAYTRACER_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define RAYTRACER_SIMD_SSE 1
+#else
+#define RAYTRACER_SIMD_SSE 0
+#endif
+
+/* Aligns a variable or member, Visual Studio 2013 has no alignas */
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define RAYTRACER_ALIGN(Bytes) __declspec(align(Bytes))
+#else
+#define RAYTRACER_ALIGN(Bytes) alignas(Bytes)
+#endif
+
+#if RAYTRACER_SIMD_SSE
+
+#include <xmmintrin.h>
+
+/* Four floats held in a SIMD register */
+using VectorRegister = __m128;
+
+/**
+* Creates a register from four components.
+*/
+inline VectorRegister MakeVectorRegister(float X, float Y, float Z, float W)
+{
+	return _mm_setr_ps(X, Y, Z, W);
+}
+
+/**
+* Loads four floats from 16 byte aligned memory.
+*/
+inline VectorRegister VectorLoadAligned(const float* Ptr)
+{
+	return _mm_load_ps(Ptr);
+}
+
+/**
+* Stores a register to 16 byte aligned memory.
+*/
+inline void VectorStoreAligned(const VectorRegister& Vector, float* Ptr)
+{
+	_mm_store_ps(Ptr, Vector);
+}
+
+/**
+* Loads four floats from memory with any alignment, such as members of heap allocated objects.
+*/
+inline VectorRegister VectorLoad(const float* Ptr)
+{
+	return _mm_loadu_ps(Ptr);
+}
+
+/**
+* Stores a register to memory with any alignment.
+*/
+inline void VectorStore(const VectorRegister& Vector, float* Ptr)
+{
+	_mm_storeu_ps(Ptr, Vector);
+}
+
+/**
+* Copies one component of a register to all four components.
+*/
+template <int Component>
+inline VectorRegister VectorReplicate(const VectorRegister& Vector)
+{
+	return _mm_shuffle_ps(Vector, Vector, _MM_SHUFFLE(Component, Component, Component, Component));
+}
+
+inline VectorRegister VectorAdd(const VectorRegister& Lhs, const VectorRegister& Rhs)
+{
+	return _mm_add_ps(Lhs, Rhs);
+}
+
+inline VectorRegister VectorMultiply(const VectorRegister& Lhs, const VectorRegister& Rhs)
+{
+	return _mm_mul_ps(Lhs, Rhs);
+}
+
+/**
+* Transposes four registers holding the rows of a 4x4 matrix.
+*/
+inline void VectorTranspose4(VectorRegister& Row0, VectorRegister& Row1, VectorRegister& Row2, VectorRegister& Row3)
+{
+	_MM_TRANSPOSE4_PS(Row0, Row1, Row2, Row3);
+}
+
+/**
+* Copies a float to all four components.
+*/
+inline VectorRegister VectorSetFloat1(float Value)
+{
+	return _mm_set1_ps(Value);
+}
+
+inline VectorRegister VectorSubtract(const VectorRegister& Lhs, const VectorRegister& Rhs)
+{
+	return _mm_sub_ps(Lhs, Rhs);
+}
+
+inline VectorRegister VectorDivide(const VectorRegister& Lhs, const VectorRegister& Rhs)
+{
+	return _mm_div_ps(Lhs, Rhs);
+}
+
+/**
+* Componentwise Lhs < Rhs ? Lhs : Rhs, so Rhs is returned when either is NaN.
+*/
+inline VectorRegister VectorMin(const VectorRegister& Lhs, const VectorRegister& Rhs)
+{
+	return _mm_min_ps(Lhs, Rhs);
+}
+
+/**
+* Componentwise Lhs > Rhs ? Lhs : Rhs, so Rhs is returned when either is NaN.
+*/
+inline VectorRegister VectorMax(const VectorRegister& Lhs, const VectorRegister& Rhs)
+{
+	return _mm_max_ps(Lhs, Rhs);
+}
+
+/**
+* Comparisons set every bit of a component where the comparison is true, and clear them otherwise.
+*/
+inline VectorRegister VectorCompareLT(const VectorRegister& Lhs, const VectorRegister& Rhs)
+{
+	return _mm_cmplt_ps(Lhs, Rhs);
+}
+
+inline VectorRegister VectorCompareLE(const VectorRegister& Lhs, const VectorRegister& Rhs)
+{
+	return _mm_cmple_ps(Lhs, Rhs);
+}
+
+inline VectorRegister VectorCompareGE(const VectorRegister& Lhs, const VectorRegister& Rhs)
+{
+	return _mm_cmpge_ps(Lhs, Rhs);
+}
+
+inline VectorRegister VectorBitwiseAnd(const VectorRegister& Lhs, const VectorRegister& Rhs)
+{
+	return _mm_and_ps(Lhs, Rhs);
+}
+
+/**
+* Gets a bit mask with bit i set if the sign bit of component i is set.
+*/
+inline uint32_t VectorMaskBits(const VectorRegister& Vector)
+{
+	return (uint32_t)_mm_movemask_ps(Vector);
+}
+
+#else
+
+/* Four floats, operated on one component at a time */
+struct VectorRegister
+{
+	float V[4];
+};
+
+inline VectorRegister MakeVectorRegister(float X, float Y, float Z, float W)
+{
+	return VectorRegister{ { X, Y, Z, W } };
+}
+
+inline VectorRegister VectorLoadAligned(const float* Ptr)
+{
+	return VectorRegister{ { Ptr[0], Ptr[1], Ptr[2], Ptr[3] } };
+}
+
+inline void VectorStoreAligned(const VectorRegister& Vector, float* Ptr)
+{
+	for (int i = 0; i < 4; i++)
+		Ptr[i] = Vector.V[i];
+}
+
+inline VectorRegister VectorLoad(const float* Ptr)
+{
+	return VectorLoadAligned(Ptr);
+}
+
+inline void VectorStore(const VectorRegister& Vector, float* Ptr)
+{
+	VectorStoreAligned(Vector, Ptr);
+}
+
+template <int Component>
+inline VectorRegister VectorReplicate(const VectorRegister& Vector)
+{
+	const float Value = Vector.V[Component];
+	return VectorRegister{ { Value, Value, Value, Value } };
+}
+
+inline VectorRegister VectorAdd(const VectorRegister& Lhs, const VectorRegister& Rhs)
+{
+	return VectorRegister{ { Lhs.V[0] + Rhs.V[0], Lhs.V[1] + Rhs.V[1], Lhs.V[2] + Rhs.V[2], Lhs.V[3] + Rhs.V[3] } };
+}
+
+inline VectorRegister VectorMultiply(const VectorRegister& Lhs, const VectorRegister& Rhs)
+{
+	return VectorRegister{ { Lhs.V[0] * Rhs.V[0], Lhs.V[1] * Rhs.V[1], Lhs.V[2] * Rhs.V[2], Lhs.V[3] * Rhs.V[3] } };
+}
+
+inline void VectorTranspose4(VectorRegister& Row0, VectorRegister& Row1, VectorRegister& Row2, VectorRegister& Row3)
+{
+	VectorRegister* Rows[4] = { &Row0, &Row1, &Row2, &Row3 };
+	for (int row = 0; row < 4; row++)
+	{
+		for (int col = row + 1; col < 4; col++)
+		{
+			std::swap(Rows[row]->V[col], Rows[col]->V[row]);
+		}
+	}
+}
+
+inline VectorRegister VectorSetFloat1(float Value)
+{
+	return VectorRegister{ { Value, Value, Value, Value } };
+}
+
+inline VectorRegister VectorSubtract(const VectorRegister& Lhs, const VectorRegister& Rhs)
+{
+	return VectorRegister{ { Lhs.V[0] - Rhs.V[0], Lhs.V[1] - Rhs.V[1], Lhs.V[2] - Rhs.V[2], Lhs.V[3] - Rhs.V[3] } };
+}
+
+inline VectorRegister VectorDivide(const VectorRegister& Lhs, const VectorRegister& Rhs)
+{
+	return VectorRegister{ { Lhs.V[0] / Rhs.V[0], Lhs.V[1] / Rhs.V[1], Lhs.V[2] / Rhs.V[2], Lhs.V[3] / Rhs.V[3] } };
+}
+
+inline VectorRegister VectorMin(const VectorRegister& Lhs, const VectorRegister& Rhs)
+{
+	VectorRegister Result;
+	for (int i = 0; i < 4; i++)
+		Result.V[i] = (Lhs.V[i] < Rhs.V[i]) ? Lhs.V[i] : Rhs.V[i];
+	return Result;
+}
+
+inline VectorRegister VectorMax(const VectorRegister& Lhs, const VectorRegister& Rhs)
+{
+	VectorRegister Result;
+	for (int i = 0; i < 4; i++)
+		Result.V[i] = (Lhs.V[i] > Rhs.V[i]) ? Lhs.V[i] : Rhs.V[i];
+	return Result;
+}
+
+/* Component with every bit set or cleared, as written by the comparisons */
+inline float VectorMaskComponent(bool IsSet)
+{
+	const uint32_t Bits = IsSet ? 0xFFFFFFFF : 0;
+	float Component;
+	std::memcpy(&Component, &Bits, sizeof(float));
+	return Component;
+}
+
+inline VectorRegister VectorCompareLT(const VectorRegister& Lhs, const VectorRegister& Rhs)
+{
+	VectorRegister Result;
+	for (int i = 0; i < 4; i++)
+		Result.V[i] = VectorMaskComponent(Lhs.V[i] < Rhs.V[i]);
+	return Result;
+}
+
+inline VectorRegister VectorCompareLE(const VectorRegister& Lhs, const VectorRegister& Rhs)
+{
+	VectorRegister Result;
+	for (int i = 0; i < 4; i++)
+		Result.V[i] = VectorMaskComponent(Lhs.V[i] <= Rhs.V[i]);
+	return Result;
+}
+
+inline VectorRegister VectorCompareGE(const VectorRegister& Lhs, const VectorRegister& Rhs)
+{
+	VectorRegister Result;
+	for (int i = 0; i < 4; i++)
+		Result.V[i] = VectorMaskComponent(Lhs.V[i] >= Rhs.V[i]);
+	return Result;
+}
+
+inline VectorRegister VectorBitwiseAnd(const VectorRegister& Lhs, const VectorRegister& Rhs)
+{
+	VectorRegister Result;
+	for (int i = 0; i < 4; i++)
+	{
+		uint32_t LhsBits, RhsBits;
+		std::memcpy(&LhsBits, &Lhs.V[i], sizeof(float));
+		std::memcpy(&RhsBits, &Rhs.V[i], sizeof(float));
+		LhsBits &= RhsBits;
+		std::memcpy(&Result.V[i], &LhsBits, sizeof(float));
+	}
+	return Result;
+}
+
+inline uint32_t VectorMaskBits(const VectorRegister& Vector)
+{
+	uint32_t Mask = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		uint32_t Bits;
+		std::memcpy(&Bits, &Vector.V[i], sizeof(float));
+		Mask |= (Bits >> 31) << i;
+	}
+	return Mask;
+}
+
+#endif
+
+/**
+* Creates a register from a 3D vector and a w component.
+*/
+inline VectorRegister MakeVectorRegister(const Vector3f& Vector, float W)
+{
+	return MakeVectorRegister(Vector.x, Vector.y, Vector.z, W);
+}
+
+/**
+* Gets the first three components of a register as a 3D vector.
+*/
+inline Vector3f VectorToVector3(const VectorRegister& Vector)
+{
+	RAYTRACER_ALIGN(16) float Components[4];
+	VectorStoreAligned(Vector, Components);
+	return Vector3f(Components[0], Components[1], Components[2]);
+}
+
+/**
+* Computes Vectors[0] * Weights.x + Vectors[1] * Weights.y + Vectors[2] * Weights.z + Vectors[3] * Weights.w,
+* summed in that order so each component matches a scalar dot product.
+*/
+inline VectorRegister VectorLinearCombination(const VectorRegister Vectors[4], const VectorRegister& Weights)
+{
+	VectorRegister Result = VectorMultiply(Vectors[0], VectorReplicate<0>(Weights));
+	Result = VectorAdd(Result, VectorMultiply(Vectors[1], VectorReplicate<1>(Weights)));
+	Result = VectorAdd(Result, VectorMultiply(Vectors[2], VectorReplicate<2>(Weights)));
+	Result = VectorAdd(Result, VectorMultiply(Vectors[3], VectorReplicate<3>(Weights)));
+	return Result;
+}
@@ -28,45 +28,18 @@ FRay FCamera::GenerateRay(int32_t X, int32_t Y) const
 	return mViewTransform.TransformRay(PixelRay);
 }
 
-std::vector<FRay> FCamera::GenerateSampleRays(int32_t X, int32_t Y, uint16_t SamplingLevel) const
+FRay FCamera::GenerateSampleRay(int32_t X, int32_t Y, const Vector2f& PixelPoint) const
 {
-	// adjust output resolution according to division of current pixels and
-	// store the inverse of this for use in UV calculations
-	const float InvOutputResX = 1.0f / (mOutputResolution.x * SamplingLevel);
-	const float InvOutputResY = 1.0f / (mOutputResolution.y * SamplingLevel);
-	const float InvHundred = 1.0f / 100.0f; // store for random UV offsets
+	// Calculate coordinates of the point on screen plane (u, v, d)
+	const float U = -1 + (2 * (X + PixelPoint.x)) / mOutputResolution.x;
+	const float V = mAspectRatio - (2 * mAspectRatio * (Y + PixelPoint.y)) / mOutputResolution.y;
 
-	// we are simulating more pixels with the UV, so adjust our current pixels
-	X *= SamplingLevel; Y *= SamplingLevel;
-
-	std::vector<FRay> SampleRays;
-	for (int i = 0; i < SamplingLevel; i++)
-	{
-		for (int j = 0; j < SamplingLevel; j++)
-		{
-			// Get random U and V offsets within the pixel
-			const float UOffset = (std::rand() % 100 + 1) * InvHundred;
-			const float VOffset = (std::rand() % 100 + 1) * InvHundred;
-
-			// Calculate coordinates of pixel on screen plane (u, v, d)
-			const float U = -1 + (2 * (X + UOffset)) * InvOutputResX;
-			const float V = mAspectRatio - (2 * mAspectRatio * (Y + VOffset)) * InvOutputResY;
-
-			// Compute direction of ray in world space
-			Vector3f RayDirection = Vector3f(-U, V, -mDistanceFromScreenPlane);
-
-			// Take ray into world space
-			FRay PixelRay(Vector3f(), RayDirection.Normalize());
-			PixelRay = mViewTransform.TransformRay(PixelRay);
-
-			SampleRays.push_back(PixelRay);
-			X++;
-		}
-		Y++;
-		X -= SamplingLevel; // reset X for next row
-	}
+	// Compute direction of ray in world space
+	Vector3f RayDirection = Vector3f(-U, V, -mDistanceFromScreenPlane);
 
-	return SampleRays;
+	// Take ray into world space
+	const FRay PixelRay(Vector3f(), RayDirection.Normalize());
+	return mViewTransform.TransformRay(PixelRay);
 }
 
 float FCamera::GetFOV() const
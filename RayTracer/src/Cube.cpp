@@ -2,6 +2,7 @@
 #include "Intersection.h"
 
 #include <limits>
+#include <cmath>
 
 
 FCube::FCube(Vector3f Center, FMaterial LightingMaterial)
@@ -13,7 +14,8 @@ FCube::FCube(Vector3f Center, FMaterial LightingMaterial)
 
 bool FCube::IsIntersectingRay(FRay Ray, float* tValueOut, FIntersection* IntersectionOut)
 {
-	if (!IsEnabled())
+	// skip the surface the ray was spawned from
+	if (Ray.ignoreObject == this)
 		return false;
 
 	// just use bounding box as intersection test
@@ -53,9 +55,9 @@ void FCube::ConstructIntersection(const Vector3f& IntersectionPoint, FIntersecti
 	for (int i = 0; i < 3; i++)
 	{
 		// get axis with largest length
-		if (abs(IntersectionInObjectSpace[i]) > LargestSide)
+		if (std::abs(IntersectionInObjectSpace[i]) > LargestSide)
 		{
-			LargestSide = abs(IntersectionInObjectSpace[i]);
+			LargestSide = std::abs(IntersectionInObjectSpace[i]);
 			IntersectionSide = (IntersectionInObjectSpace[i] < 0.0f) ? -1 : 1;
 			IntersectionAxis = i;
 		}
@@ -67,51 +69,39 @@ void FCube::ConstructIntersection(const Vector3f& IntersectionPoint, FIntersecti
 
 	IntersectionOut->normal = Normal;
 	IntersectionOut->object = this;
+	IntersectionOut->primitive = FRay::AllPrimitives;
 
 	// make sure point not inside of the object
 	IntersectionOut->point = IntersectionPoint + (Normal * _EPSILON);
-}
-
-void FCube::ConstructAABB(Vector3f Min, Vector3f Max)
-{
-	Min = Vector3f(-1, -1, -1);
-	Max = Vector3f(1, 1, 1);
-
-	SetBoundingBox(AABB{ Min, Max });
-}
 
-FMaterial FCube::GetMaterial(Vector3f SurfacePoint)
-{
-	const FTextureInfo& DiffuseInfo = mMaterial.GetDiffuseTexture();
-	if (!DiffuseInfo.Texture)
-		return mMaterial;
-
-	SurfacePoint = GetWorldInvTransform().TransformPosition(SurfacePoint);
+	// map the intersected face to UVs, scaled by the object so textures aren't stretched
 	const Vector3f& Scale = GetWorldTransform().GetScale();
+	const Vector3f& P = IntersectionInObjectSpace;
+	Vector2f& UV = IntersectionOut->uv;
 
-	float U = 0.0f, V = 0.0f;
-	if (1.0f - abs(SurfacePoint.x) < _EPSILON)
+	if (IntersectionAxis == 0)
 	{
-		U = Scale.z * (SurfacePoint.z + 1.0f) / 2.0f;
-		V = Scale.y * (SurfacePoint.y + 1.0f) / 2.0f;
+		UV.x = Scale.z * (P.z + 1.0f) / 2.0f;
+		UV.y = Scale.y * (P.y + 1.0f) / 2.0f;
 	}
-	else if (1.0f - abs(SurfacePoint.y)< _EPSILON)
+	else if (IntersectionAxis == 1)
 	{
-		U = Scale.x * (SurfacePoint.x + 1.0f) / 2.0f;
-		V = Scale.z * (SurfacePoint.z + 1.0f) / 2.0f;
+		UV.x = Scale.x * (P.x + 1.0f) / 2.0f;
+		UV.y = Scale.z * (P.z + 1.0f) / 2.0f;
 	}
 	else
 	{
-		U = Scale.x * (SurfacePoint.x + 1.0f) / 2.0f;
-		V = Scale.y * (SurfacePoint.y + 1.0f) / 2.0f;
+		UV.x = Scale.x * (P.x + 1.0f) / 2.0f;
+		UV.y = Scale.y * (P.y + 1.0f) / 2.0f;
 	}
+}
 
-	U *= DiffuseInfo.UAxisScale;
-	V *= DiffuseInfo.VAxisScale;
-
-	mMaterial.SetDiffuse(DiffuseInfo.Texture->GetSample(U, V));
+void FCube::ConstructAABB(Vector3f Min, Vector3f Max)
+{
+	Min = Vector3f(-1, -1, -1);
+	Max = Vector3f(1, 1, 1);
 
-	return mMaterial;
+	SetBoundingBox(AABB{ Min, Max });
 }
 
 FCube::~FCube()
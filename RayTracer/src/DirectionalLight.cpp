@@ -1,8 +1,8 @@
 #include "DirectionalLight.h"
 #include "Matrix4.h"
 
-#include <cstdlib>
 #include <limits>
+#include <cmath>
 
 FDirectionalLight::FDirectionalLight()
 	: ILight()
@@ -23,15 +23,17 @@ FRay FDirectionalLight::GetRayToLight(const Vector3f& SurfacePoint) const
 	return FRay(SurfacePoint, -mLightDirection);
 }
 
-std::vector<FRay> FDirectionalLight::GetRayToLightSamples(const Vector3f& SurfacePoint, int NumSamples) const
+FLightSampleFrame FDirectionalLight::GetSampleFrame(const Vector3f& SurfacePoint, uint32_t NumSamples) const
 {
+	SurfacePoint; // turn off compiler warning
+
 	// make a new frame that points in the direction of the light
 	const Vector3f N = mLightDirection;
 
 	//  let the up direction be the smallest component of the light direction
 	int ShortestDirection = 0;
 	for (int i = 1; i < 3; i++)
-		if (abs(N[i]) < abs(N[ShortestDirection]))
+		if (std::abs(N[i]) < std::abs(N[ShortestDirection]))
 			ShortestDirection = i;
 
 	// calculate basis vectors for the frame
@@ -41,26 +43,26 @@ std::vector<FRay> FDirectionalLight::GetRayToLightSamples(const Vector3f& Surfac
 	const Vector3f RightVector(Vector3f::Cross(N, vUp).Normalize());
 	vUp = Vector3f::Cross(RightVector, N).Normalize();
 
-	const FMatrix4 LightFrame(RightVector, vUp, N);
-	std::vector<FRay> RaySamples;
-
-	// randomly move the direction vector small amounts for each sample
-	//const float MaxMovement = 0.1f;
-	for (int i = 0; i < NumSamples; i++)
-	{
-		const float XMovement = std::rand() % 100 / 1000.0f;
-		const float ZMovement = std::rand() % 100 / 1000.0f;
-		Vector3f SampleDirectionOffset(XMovement, 0.0f, ZMovement);
-		SampleDirectionOffset = LightFrame.TransformPosition(SampleDirectionOffset);
-
-		// turn the ray to the direction of the light and add the normal
-		// to the ray origin so we are sure that we are not under the surface
-		FRay SampleRay(SurfacePoint, (-mLightDirection + SampleDirectionOffset).Normalize());
-		SampleRay.origin += SampleRay.direction * _EPSILON;
-		RaySamples.push_back(SampleRay);
-	}
-
-	return RaySamples;
+	FLightSampleFrame SampleFrame;
+	SampleFrame.Frame = FMatrix4(RightVector, vUp, N);
+	SampleFrame.NumSamples = NumSamples;
+	return SampleFrame;
+}
+
+FRay FDirectionalLight::GetRayToLightSample(const Vector3f& SurfacePoint, const FLightSampleFrame& Frame, const Vector2f& SamplePoint) const
+{
+	// move the direction vector small amounts for each sample
+	const float MaxMovement = 0.1f;
+	const float XMovement = SamplePoint.x * MaxMovement;
+	const float ZMovement = SamplePoint.y * MaxMovement;
+	Vector3f SampleDirectionOffset(XMovement, 0.0f, ZMovement);
+	SampleDirectionOffset = Frame.Frame.TransformPosition(SampleDirectionOffset);
+
+	// turn the ray to the direction of the light and add the normal
+	// to the ray origin so we are sure that we are not under the surface
+	FRay SampleRay(SurfacePoint, (-mLightDirection + SampleDirectionOffset).Normalize());
+	SampleRay.origin += SampleRay.direction * _EPSILON;
+	return SampleRay;
 }
 
 void FDirectionalLight::setLightDirection(const Vector3f& LightDirection)
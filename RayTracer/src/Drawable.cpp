@@ -1,4 +1,8 @@
 #include "Drawable.h"
+#include "Intersection.h"
+#include "RayPacket.h"
+
+#include <algorithm>
 
 IDrawable::IDrawable(const FMaterial& LightingMaterial)
 	: mTransform()
@@ -6,9 +10,43 @@ IDrawable::IDrawable(const FMaterial& LightingMaterial)
 	, mParentObject(nullptr)
 	, mBoundingBox()
 	, mInvTransform()
-	, mIsEnabled(true)
+	, mWorldTransform()
+	, mWorldInvTransform()
+	, mChildObjects()
+{
+
+}
+
+IDrawable::~IDrawable()
+{
+	if (mParentObject)
+	{
+		auto& Siblings = mParentObject->mChildObjects;
+		Siblings.erase(std::remove(Siblings.begin(), Siblings.end(), this), Siblings.end());
+	}
+
+	for (IDrawable* Child : mChildObjects)
+	{
+		Child->mParentObject = nullptr;
+		Child->UpdateWorldTransform();
+	}
+}
+
+uint32_t IDrawable::IsIntersectingPacket(FRayPacket& Packet, uint32_t ActiveMask, FIntersection* IntersectionsOut)
 {
+	uint32_t HitMask = 0;
+	for (uint32_t i = 0; i < Packet.Size; i++)
+	{
+		if ((ActiveMask & (1u << i)) && IsIntersectingRay(Packet.Rays[i], &Packet.tMax[i], &IntersectionsOut[i]))
+			HitMask |= 1u << i;
+	}
+
+	return HitMask;
+}
 
+bool IDrawable::IsOccludingRay(const FRay& Ray, float tMax)
+{
+	return IsIntersectingRay(Ray, &tMax);
 }
 
 void IDrawable::SetMaterial(const FMaterial& NewMaterial)
@@ -21,6 +59,11 @@ FMaterial IDrawable::GetMaterial() const
 	return mMaterial;
 }
 
+FSurfaceProperties IDrawable::GetSurfaceProperties(const FIntersection& Intersection) const
+{
+	return mMaterial.GetSurfaceProperties(Intersection.uv);
+}
+
 AABB IDrawable::GetBoundingBox() const
 {
 	return mBoundingBox;
@@ -135,78 +178,88 @@ void IDrawable::SetBoundingBox(AABB boundingBox)
 
 void IDrawable::SetParent(IDrawable& Parent)
 {
+	if (mParentObject)
+	{
+		auto& Siblings = mParentObject->mChildObjects;
+		Siblings.erase(std::remove(Siblings.begin(), Siblings.end(), this), Siblings.end());
+	}
+
 	mParentObject = &Parent;
+	Parent.mChildObjects.push_back(this);
+	UpdateWorldTransform();
 }
 
-FMatrix4 IDrawable::GetInvTransform() const
+const FMatrix4& IDrawable::GetInvTransform() const
 {
 	return mInvTransform;
 }
 
-FMatrix4 IDrawable::GetWorldInvTransform() const
+const FMatrix4& IDrawable::GetWorldInvTransform() const
 {
-	if (mParentObject)
-		return mParentObject->GetWorldInvTransform() * mInvTransform;
-
-	return mInvTransform;
+	return mWorldInvTransform;
 }
 
-FMatrix4 IDrawable::GetTransform() const
+const FMatrix4& IDrawable::GetTransform() const
 {
 	return mTransform;
 }
 
-FMatrix4 IDrawable::GetWorldTransform() const
+const FMatrix4& IDrawable::GetWorldTransform() const
 {
-	if (mParentObject)
-		return mParentObject->GetWorldTransform() * mTransform;
-
-	return mTransform;
+	return mWorldTransform;
 }
 
 void IDrawable::SetTransform(const FMatrix4& Transform)
 {
 	mTransform = Transform;
 	mInvTransform = Transform.GetInverse();
+	UpdateWorldTransform();
 }
 
 void IDrawable::Rotate(EAxis Axis, float Degrees)
 {
 	mTransform.Rotate(Axis, Degrees);
 	mInvTransform = mTransform.GetInverse();
+	UpdateWorldTransform();
 }
 
 void IDrawable::Scale(EAxis Axis, float Scale)
 {
 	mTransform.Scale(Axis, Scale);
 	mInvTransform = mTransform.GetInverse();
+	UpdateWorldTransform();
 }
 
 void IDrawable::SetLocalOrigin(const Vector3f& Origin)
 {
 	mTransform.SetOrigin(Origin);
 	mInvTransform = mTransform.GetInverse();
+	UpdateWorldTransform();
 }
 
-Vector3f IDrawable::GetLocalOrigin() const
-{
-	return mTransform.GetOrigin();
-}
-
-Vector3f IDrawable::GetWorldOrigin() const
+void IDrawable::UpdateWorldTransform()
 {
 	if (mParentObject)
-		return mParentObject->GetWorldOrigin() + mTransform.GetOrigin();
+	{
+		mWorldTransform = mParentObject->mWorldTransform * mTransform;
+		mWorldInvTransform = mInvTransform * mParentObject->mWorldInvTransform;
+	}
+	else
+	{
+		mWorldTransform = mTransform;
+		mWorldInvTransform = mInvTransform;
+	}
 
-	return mTransform.GetOrigin();
+	for (IDrawable* Child : mChildObjects)
+		Child->UpdateWorldTransform();
 }
 
-bool IDrawable::IsEnabled() const
+Vector3f IDrawable::GetLocalOrigin() const
 {
-	return mIsEnabled;
+	return mTransform.GetOrigin();
 }
 
-void IDrawable::SetEnabled(bool IsEnabled)
+Vector3f IDrawable::GetWorldOrigin() const
 {
-	mIsEnabled = IsEnabled;
+	return mWorldTransform.GetOrigin();
 }
\ No newline at end of file
@@ -1,49 +1,215 @@
 #include "Image.h"
+#if defined(_WIN32) && !defined(RAYTRACER_HEADLESS)
 #include "Windows.h"
+#endif
 #include <sstream>
 #include <cassert>
-#include <limits>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
 
-FImage::FImage(const std::string& Filename, const Vector2i& OutputResolution)
-	: mPixelColors(OutputResolution.y)
-	, mOutputResolution(OutputResolution)
+/* Number of rows converted at a time when the whole image is written at once */
+static const uint32_t WriteBatchRows = 64;
+
+/**
+* Converts a color component to an 8 bit value, rounded to the nearest value.
+*/
+static uint8_t ToByte(const float Value)
+{
+	return (uint8_t)(std::min(std::max(Value, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+/**
+* Moves a file over another one.
+* @return False if the file could not be moved.
+*/
+static bool MoveOverFile(const std::string& SourceFilepath, const std::string& DestFilepath)
+{
+	// rename doesn't replace an existing file on every platform
+	if (std::rename(SourceFilepath.c_str(), DestFilepath.c_str()) == 0)
+		return true;
+
+	std::remove(DestFilepath.c_str());
+	return std::rename(SourceFilepath.c_str(), DestFilepath.c_str()) == 0;
+}
+
+/**
+* Checks the byte order of floats written to a .pfm file.
+*/
+static bool IsLittleEndian()
+{
+	const uint32_t One = 1;
+	uint8_t FirstByte;
+	std::memcpy(&FirstByte, &One, 1);
+	return FirstByte == 1;
+}
+
+FImage::FImage(const std::string& Filename, const Vector2i& OutputResolution, const EImageFormat Format)
+	: mPixels((size_t)OutputResolution.x * OutputResolution.y)
+	, mRowPixelCounts(new std::atomic<uint32_t>[OutputResolution.y])
 	, mFilename(Filename)
+	, mOutputResolution(OutputResolution)
+	, mFormat(Format)
+	, mFileStream()
+	, mHeaderSize(0)
+	, mFileMutex()
+{
+	for (int32_t y = 0; y < mOutputResolution.y; y++)
+		mRowPixelCounts[y] = 0;
+}
+
+bool FImage::BeginImage()
+{
+	return OpenFile(GetFilename());
+}
+
+bool FImage::OpenFile(const std::string& Filepath)
 {
-	// Resize each vector to the amount of vertical pixels
-	for (auto& row : mPixelColors)
-		row.resize(OutputResolution.x);
+	std::ostringstream HeaderStream;
+	if (mFormat == EImageFormat::PFM)
+	{
+		// a negative scale marks little endian floats
+		HeaderStream << "PF\n" << mOutputResolution.x << ' ' << mOutputResolution.y << '\n';
+		HeaderStream << (IsLittleEndian() ? "-1.0\n" : "1.0\n");
+	}
+	else
+	{
+		HeaderStream << "P6\n" << mOutputResolution.x << ' ' << mOutputResolution.y << '\n';
+		HeaderStream << "255\n";
+	}
+
+	mFileStream.open(Filepath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!mFileStream.is_open())
+	{
+		std::cout << "Could not open output image file: " << Filepath << std::endl;
+		return false;
+	}
+
+	const std::string Header = HeaderStream.str();
+	mFileStream.write(Header.data(), Header.size());
+	mHeaderSize = (std::streamoff)Header.size();
+
+	for (int32_t y = 0; y < mOutputResolution.y; y++)
+		mRowPixelCounts[y] = 0;
+
+	return true;
 }
 
 void FImage::SetPixel(const uint32_t& X, const uint32_t& Y, const FColor& Color)
 {
-	assert(Y < mPixelColors.capacity());
-	assert(X < mPixelColors[Y].capacity());
-	mPixelColors[Y][X] = Color;
+	assert(Y < (uint32_t)mOutputResolution.y);
+	assert(X < (uint32_t)mOutputResolution.x);
+	mPixels[(size_t)Y * mOutputResolution.x + X] = Color;
+
+	// the thread that finishes a row writes it, the count orders the row's pixels before the write
+	if (mRowPixelCounts[Y].fetch_add(1, std::memory_order_acq_rel) + 1 == (uint32_t)mOutputResolution.x && mFileStream.is_open())
+		WriteRows(Y, Y + 1);
+}
+
+const FColor& FImage::GetPixel(const uint32_t& X, const uint32_t& Y) const
+{
+	assert(Y < (uint32_t)mOutputResolution.y);
+	assert(X < (uint32_t)mOutputResolution.x);
+	return mPixels[(size_t)Y * mOutputResolution.x + X];
 }
 
-void FImage::WriteImage()
+void FImage::WriteImage(const bool ShowImage)
 {
-	// Write to a .ppm image
-	mFilename += ".ppm";
-	std::ostringstream headerStream;
-	headerStream << "P6\n";
-	headerStream << mOutputResolution.x << ' ' << mOutputResolution.y << '\n';
-	headerStream << "255\n";
-	std::ofstream fileStream(mFilename, std::ios::out | std::ios::binary);
-	fileStream << headerStream.str();
+	const std::string Filename = GetFilename();
+	if (!mFileStream.is_open())
+	{
+		// the whole image goes to a temporary file first, so a viewer never reads a half written image
+		const std::string TempFilename = Filename + ".tmp";
+		if (!OpenFile(TempFilename))
+			return;
+
+		for (uint32_t y = 0; y < (uint32_t)mOutputResolution.y; y += WriteBatchRows)
+			WriteRows(y, std::min(y + WriteBatchRows, (uint32_t)mOutputResolution.y));
+
+		mFileStream.close();
+		if (!mFileStream || !MoveOverFile(TempFilename, Filename))
+		{
+			std::remove(TempFilename.c_str());
+			std::cout << "Could not write output image file: " << Filename << std::endl;
+			return;
+		}
+	}
+	else
+	{
+		// rows that were never completed still get whatever they hold
+		for (uint32_t y = 0; y < (uint32_t)mOutputResolution.y; y++)
+		{
+			if (mRowPixelCounts[y] < (uint32_t)mOutputResolution.x)
+				WriteRows(y, y + 1);
+		}
 
-	for (const auto& row : mPixelColors)
-		for (const auto& pixel : row)
-			fileStream << static_cast<unsigned char>(pixel.R * 255) 
-				<< static_cast<unsigned char>(pixel.G * 255)
-				<< static_cast<unsigned char>(pixel.B * 255);
+		mFileStream.close();
+	}
 
-	fileStream.flush();
-	fileStream.close();
+	if (!ShowImage)
+		return;
 
+#if defined(_WIN32) && !defined(RAYTRACER_HEADLESS)
 	// open the new image
-	const std::wstring WFilename(mFilename.begin(), mFilename.end());
+	const std::wstring WFilename(Filename.begin(), Filename.end());
 	ShellExecute(0, 0, WFilename.c_str(), 0, 0, SW_SHOW);
+#endif
+}
+
+void FImage::WriteRows(const uint32_t BeginRow, const uint32_t EndRow)
+{
+	const size_t RowSize = GetFileRowSize();
+	std::vector<char> Buffer(RowSize * (EndRow - BeginRow));
+
+	char* Out = Buffer.data();
+	for (uint32_t y = BeginRow; y < EndRow; y++)
+	{
+		const FColor* Row = &mPixels[(size_t)y * mOutputResolution.x];
+		if (mFormat == EImageFormat::PFM)
+		{
+			float* RowOut = reinterpret_cast<float*>(Out);
+			for (int32_t x = 0; x < mOutputResolution.x; x++)
+			{
+				*RowOut++ = Row[x].R;
+				*RowOut++ = Row[x].G;
+				*RowOut++ = Row[x].B;
+			}
+		}
+		else
+		{
+			uint8_t* RowOut = reinterpret_cast<uint8_t*>(Out);
+			for (int32_t x = 0; x < mOutputResolution.x; x++)
+			{
+				*RowOut++ = ToByte(Row[x].R);
+				*RowOut++ = ToByte(Row[x].G);
+				*RowOut++ = ToByte(Row[x].B);
+			}
+		}
+		Out += RowSize;
+	}
+
+	std::lock_guard<std::mutex> Lock(mFileMutex);
+	if (mFormat == EImageFormat::PFM)
+	{
+		// .pfm rows go from the bottom of the image to the top
+		for (uint32_t y = BeginRow; y < EndRow; y++)
+		{
+			mFileStream.seekp(mHeaderSize + (std::streamoff)((mOutputResolution.y - 1 - y) * RowSize));
+			mFileStream.write(Buffer.data() + (y - BeginRow) * RowSize, RowSize);
+		}
+	}
+	else
+	{
+		mFileStream.seekp(mHeaderSize + (std::streamoff)(BeginRow * RowSize));
+		mFileStream.write(Buffer.data(), Buffer.size());
+	}
+}
+
+size_t FImage::GetFileRowSize() const
+{
+	const size_t ComponentSize = (mFormat == EImageFormat::PFM) ? sizeof(float) : sizeof(uint8_t);
+	return 3 * ComponentSize * mOutputResolution.x;
 }
 
 void FImage::SetFilename(const std::string& Filename)
@@ -53,5 +219,5 @@ void FImage::SetFilename(const std::string& Filename)
 
 std::string FImage::GetFilename() const
 {
-	return mFilename;
-}
\ No newline at end of file
+	return mFilename + ((mFormat == EImageFormat::PFM) ? ".pfm" : ".ppm");
+}
@@ -2,17 +2,82 @@
 #include "Intersection.h"
 
 #include <algorithm>
+#include <cmath>
+#include <limits>
+
+/* Cost model used by the SAH builder, relative cost of a node traversal step and an object intersection test */
+static const float SAHTraversalCost = 1.0f;
+static const float SAHIntersectionCost = 4.0f;
+/* Cost reduction for splits that leave one child empty */
+static const float SAHEmptyBonus = 0.5f;
+/* Number of split candidate bins on each axis */
+static const uint32_t SAHBinCount = 32;
+/* Number of consecutive splits that may cost more than a leaf before construction stops */
+static const uint32_t SAHMaxBadRefines = 3;
+
+/**
+* Checks if a bounding box encloses a finite region.
+*/
+static bool IsBounded(const AABB& Box)
+{
+	const float MaxExtent = std::numeric_limits<float>::max() * 0.5f;
+	for (int i = 0; i < 3; i++)
+	{
+		if (!(Box.Max[i] - Box.Min[i] < MaxExtent))
+			return false;
+	}
+	return true;
+}
 
 KDTree::KDTree()
 	: mRoot()
+	, mBounds()
+	, mObjects()
+	, mUnboundedObjects()
 {
 
 }
 
+std::vector<IDrawable*> KDTree::ResetTree(std::vector<std::unique_ptr<IDrawable>>& Primitives)
+{
+	mRoot = KDNode();
+	mObjects = std::move(Primitives);
+	mUnboundedObjects.clear();
+
+	std::vector<IDrawable*> BoundedObjects;
+	bool IsFirstBounds = true;
+
+	for (const auto& Object : mObjects)
+	{
+		const AABB& ObjectBounds = Object->GetWorldAABB();
+		if (!IsBounded(ObjectBounds))
+		{
+			mUnboundedObjects.push_back(Object.get());
+			continue;
+		}
+
+		if (IsFirstBounds)
+			mBounds = ObjectBounds;
+		else
+			mBounds.Expand(ObjectBounds);
+
+		IsFirstBounds = false;
+		BoundedObjects.push_back(Object.get());
+	}
+
+	// pad the bounds so flat scenes still enclose a volume
+	for (int i = 0; i < 3; i++)
+	{
+		mBounds.Min[i] -= _EPSILON;
+		mBounds.Max[i] += _EPSILON;
+	}
+
+	return BoundedObjects;
+}
 
 void KDTree::BuildTree(std::vector<std::unique_ptr<IDrawable>>& Primitives, uint32_t depth, uint32_t MinObjectsPerNode)
 {
-	mRoot.ObjectList = std::move(Primitives);
+	mRoot.ObjectList = ResetTree(Primitives);
 	mRoot.Axis = 0;
 
 	BuildTreeHelper(mRoot, depth, MinObjectsPerNode);
@@ -26,12 +91,12 @@ void KDTree::BuildTreeHelper(KDNode& CurrentNode, uint32_t Depth, uint32_t MinOb
 
 	const uint32_t& DividingAxis = CurrentNode.Axis;
 	auto& CurrentObjects = CurrentNode.ObjectList;
-	
+
 	const size_t PrimitiveListSize = CurrentNode.ObjectList.size();
 	const size_t DividingObjectIndex = PrimitiveListSize / 2;
 
 	// sort all objects by splitting axis
-	std::partial_sort(CurrentObjects.begin(), CurrentObjects.begin() + DividingObjectIndex, CurrentObjects.end(), [DividingAxis](const std::unique_ptr<IDrawable>& lhs, const std::unique_ptr<IDrawable>& rhs) -> bool
+	std::partial_sort(CurrentObjects.begin(), CurrentObjects.begin() + DividingObjectIndex, CurrentObjects.end(), [DividingAxis](const IDrawable* lhs, const IDrawable* rhs) -> bool
 	{
 		return lhs->GetWorldAABB().GetCenter()[DividingAxis] < rhs->GetWorldAABB().GetCenter()[DividingAxis];
 	});
@@ -39,12 +104,12 @@ void KDTree::BuildTreeHelper(KDNode& CurrentNode, uint32_t Depth, uint32_t MinOb
 	auto& DividingObject = CurrentObjects[DividingObjectIndex];
 
 	AABB DividingAABB = DividingObject->GetWorldAABB();
-	
+
 	// offset the dividing axis value to just after the median objects AABB
 	const float DividingAxisValue = DividingAABB.GetCenter()[DividingAxis] + DividingAABB.GetDeminsions()[DividingAxis] + 0.1f;
 	CurrentNode.SplitValue = DividingAxisValue;
 
-	std::vector<std::unique_ptr<IDrawable>> StraddlingPrimitives;
+	std::vector<IDrawable*> StraddlingPrimitives;
 	CurrentNode.Child[0] = std::unique_ptr<KDNode>(new KDNode());
 	CurrentNode.Child[1] = std::unique_ptr<KDNode>(new KDNode());
 
@@ -55,11 +120,11 @@ void KDTree::BuildTreeHelper(KDNode& CurrentNode, uint32_t Depth, uint32_t MinOb
 		const float AxisRange = CurrentBBox.GetDeminsions()[DividingAxis];
 		const float DividedRange = std::abs(CurrentBBox.Min[DividingAxis] - DividingAxisValue);
 		if (AxisRange > DividedRange)
-			StraddlingPrimitives.push_back(std::move(CurrentObjects[i]));
+			StraddlingPrimitives.push_back(CurrentObjects[i]);
 		else
 		{
 			// add non straddling to near child
-			CurrentNode.Child[0]->ObjectList.push_back(std::move(CurrentObjects[i]));
+			CurrentNode.Child[0]->ObjectList.push_back(CurrentObjects[i]);
 		}
 	}
 
@@ -69,11 +134,11 @@ void KDTree::BuildTreeHelper(KDNode& CurrentNode, uint32_t Depth, uint32_t MinOb
 		float AxisRange = CurrentBBox.GetDeminsions()[DividingAxis];
 		float DividedRange = CurrentBBox.Max[DividingAxis] - DividingAxisValue;
 		if (AxisRange > DividedRange)
-			StraddlingPrimitives.push_back(std::move(CurrentObjects[i]));
+			StraddlingPrimitives.push_back(CurrentObjects[i]);
 		else
 		{
 			// add non straddling to far child
-			CurrentNode.Child[1]->ObjectList.push_back(std::move(CurrentObjects[i]));
+			CurrentNode.Child[1]->ObjectList.push_back(CurrentObjects[i]);
 		}
 	}
 
@@ -91,16 +156,226 @@ void KDTree::BuildTreeHelper(KDNode& CurrentNode, uint32_t Depth, uint32_t MinOb
 	BuildTreeHelper(*CurrentNode.Child[1], Depth - 1, MinObjectsPerNode);
 }
 
+void KDTree::BuildSAHTree(std::vector<std::unique_ptr<IDrawable>>& Primitives)
+{
+	const std::vector<IDrawable*> BoundedObjects = ResetTree(Primitives);
+	if (BoundedObjects.empty())
+		return;
+
+	// world bounds are computed once, objects are referred to by index during construction
+	std::vector<AABB> ObjectBounds;
+	std::vector<uint32_t> ObjectIndices;
+	for (uint32_t i = 0; i < BoundedObjects.size(); i++)
+	{
+		ObjectBounds.push_back(BoundedObjects[i]->GetWorldAABB());
+		ObjectIndices.push_back(i);
+	}
+
+	// max depth heuristic from Physically Based Rendering
+	const uint32_t MaxDepth = (uint32_t)std::round(8 + 1.3f * std::log2((float)BoundedObjects.size()));
+	BuildSAHTreeHelper(mRoot, mBounds, ObjectIndices, BoundedObjects, ObjectBounds, MaxDepth, 0);
+}
+
+void KDTree::BuildSAHTreeHelper(KDNode& CurrentNode, const AABB& NodeBounds, const std::vector<uint32_t>& Objects, const std::vector<IDrawable*>& TreeObjects, const std::vector<AABB>& ObjectBounds, uint32_t Depth, uint32_t BadRefines)
+{
+	auto MakeLeaf = [&CurrentNode, &Objects, &TreeObjects]()
+	{
+		for (const uint32_t Object : Objects)
+			CurrentNode.ObjectList.push_back(TreeObjects[Object]);
+	};
+
+	const size_t NumObjects = Objects.size();
+	if (Depth == 0 || NumObjects <= 1)
+	{
+		MakeLeaf();
+		return;
+	}
+
+	const float LeafCost = SAHIntersectionCost * NumObjects;
+	const float InvNodeArea = 1.0f / NodeBounds.GetSurfaceArea();
+	const Vector3f& NodeExtent = NodeBounds.GetDeminsions();
+
+	float BestCost = std::numeric_limits<float>::max();
+	float BestSplit = 0.0f;
+	int BestAxis = -1;
+
+	for (int Axis = 0; Axis < 3; Axis++)
+	{
+		if (NodeExtent[Axis] <= 0.0f)
+			continue;
+
+		// count where each object's bounds, clipped to the node, start and end
+		uint32_t StartCounts[SAHBinCount] = { 0 };
+		uint32_t EndCounts[SAHBinCount] = { 0 };
+		const float BinScale = SAHBinCount / NodeExtent[Axis];
+
+		for (const uint32_t Object : Objects)
+		{
+			const AABB& Box = ObjectBounds[Object];
+			const float Start = (std::max(Box.Min[Axis], NodeBounds.Min[Axis]) - NodeBounds.Min[Axis]) * BinScale;
+			const float End = (std::min(Box.Max[Axis], NodeBounds.Max[Axis]) - NodeBounds.Min[Axis]) * BinScale;
+			StartCounts[std::min((uint32_t)std::max(Start, 0.0f), SAHBinCount - 1)]++;
+			EndCounts[std::min((uint32_t)std::max(End, 0.0f), SAHBinCount - 1)]++;
+		}
+
+		// evaluate the SAH at each bin boundary
+		uint32_t NumBelow = 0;
+		uint32_t NumEndedBelow = 0;
+		for (uint32_t Bin = 1; Bin < SAHBinCount; Bin++)
+		{
+			NumBelow += StartCounts[Bin - 1];
+			NumEndedBelow += EndCounts[Bin - 1];
+			const uint32_t NumAbove = NumObjects - NumEndedBelow;
+			const float Split = NodeBounds.Min[Axis] + Bin * NodeExtent[Axis] / SAHBinCount;
+
+			AABB BelowBounds(NodeBounds), AboveBounds(NodeBounds);
+			BelowBounds.Max[Axis] = AboveBounds.Min[Axis] = Split;
+
+			const float EmptyBonus = (NumBelow == 0 || NumAbove == 0) ? SAHEmptyBonus : 0.0f;
+			const float Cost = SAHTraversalCost + SAHIntersectionCost * (1.0f - EmptyBonus) *
+				(BelowBounds.GetSurfaceArea() * NumBelow + AboveBounds.GetSurfaceArea() * NumAbove) * InvNodeArea;
+
+			if (Cost < BestCost)
+			{
+				BestCost = Cost;
+				BestSplit = Split;
+				BestAxis = Axis;
+			}
+		}
+	}
+
+	// stop when splitting keeps costing more than testing every object in a leaf
+	if (BestCost > LeafCost)
+		BadRefines++;
+
+	if (BestAxis < 0 || (BestCost > 4.0f * LeafCost && NumObjects < 16) || BadRefines >= SAHMaxBadRefines)
+	{
+		MakeLeaf();
+		return;
+	}
+
+	// objects that straddle the split are referenced by both children
+	std::vector<uint32_t> BelowObjects, AboveObjects;
+	for (const uint32_t Object : Objects)
+	{
+		const AABB& Box = ObjectBounds[Object];
+		if (Box.Min[BestAxis] < BestSplit || Box.Max[BestAxis] <= BestSplit)
+			BelowObjects.push_back(Object);
+		if (Box.Max[BestAxis] > BestSplit)
+			AboveObjects.push_back(Object);
+	}
+
+	CurrentNode.Axis = (uint8_t)BestAxis;
+	CurrentNode.SplitValue = BestSplit;
+	CurrentNode.Child[0] = std::unique_ptr<KDNode>(new KDNode());
+	CurrentNode.Child[1] = std::unique_ptr<KDNode>(new KDNode());
+
+	AABB BelowBounds(NodeBounds), AboveBounds(NodeBounds);
+	BelowBounds.Max[BestAxis] = AboveBounds.Min[BestAxis] = BestSplit;
+
+	BuildSAHTreeHelper(*CurrentNode.Child[0], BelowBounds, BelowObjects, TreeObjects, ObjectBounds, Depth - 1, BadRefines);
+	BuildSAHTreeHelper(*CurrentNode.Child[1], AboveBounds, AboveObjects, TreeObjects, ObjectBounds, Depth - 1, BadRefines);
+}
+
 bool KDTree::IsIntersectingRay(FRay Ray, float* tValueOut, FIntersection* IntersectionOut)
 {
-	return VisitNodesAgainstRay(&mRoot, Ray, tValueOut, IntersectionOut);
+	bool IsIntersecting = false;
+
+	for (const auto& Primitive : mUnboundedObjects)
+	{
+		IsIntersecting |= Primitive->IsIntersectingRay(Ray, tValueOut, IntersectionOut);
+	}
+
+	// if no IntersectionOut, return when a valid intersection is hit
+	if (!IntersectionOut && IsIntersecting)
+		return true;
+
+	// only the part of the ray within the tree bounds needs to be traversed
+	float tMin = 0.0f;
+	float tMax = (tValueOut) ? *tValueOut : std::numeric_limits<float>::max();
+	if (mObjects.size() == mUnboundedObjects.size() || !mBounds.ClipRay(Ray, tMin, tMax))
+		return IsIntersecting;
+
+	IsIntersecting |= VisitNodesAgainstRay(&mRoot, Ray, tMin, tMax, tValueOut, IntersectionOut);
+	return IsIntersecting;
+}
+
+bool KDTree::IsOccludingRay(FRay Ray, float tMax, IDrawable** OccluderOut)
+{
+	IDrawable* Occluder = nullptr;
+	for (IDrawable* Primitive : mUnboundedObjects)
+	{
+		if (Primitive->IsOccludingRay(Ray, tMax))
+		{
+			Occluder = Primitive;
+			break;
+		}
+	}
+
+	// only the part of the ray within the tree bounds needs to be traversed
+	float tMin = 0.0f, tClipMax = tMax;
+	if (!Occluder && mObjects.size() != mUnboundedObjects.size() && mBounds.ClipRay(Ray, tMin, tClipMax))
+		Occluder = FindOccluderInNodes(&mRoot, Ray, tMin, tClipMax, tMax);
+
+	if (Occluder && OccluderOut)
+		*OccluderOut = Occluder;
+	return Occluder != nullptr;
 }
 
-bool KDTree::VisitNodesAgainstRay(KDNode* CurrentNode, FRay Ray, float* tValueOut, FIntersection* IntersectionOut)
+IDrawable* KDTree::FindOccluderInNodes(const KDNode* CurrentNode, const FRay& Ray, float tMin, float tMax, float tRayMax)
 {
-	if (CurrentNode == nullptr)
-		return false;
+	// tMin and tMax bound the ray within the node, objects are tested against the whole ray up to tRayMax
+	while (true)
+	{
+		for (IDrawable* Primitive : CurrentNode->ObjectList)
+		{
+			if (Primitive->IsOccludingRay(Ray, tRayMax))
+				return Primitive;
+		}
+
+		if (!CurrentNode->Child[0])
+			return nullptr;
+
+		// check which child to traverse first from axis split
+		const uint32_t Axis = CurrentNode->Axis;
+		const uint32_t FirstChild = Ray.origin[Axis] > CurrentNode->SplitValue ||
+			(Ray.origin[Axis] == CurrentNode->SplitValue && Ray.direction[Axis] < 0.0f);
+
+		const KDNode* NearChild = CurrentNode->Child[FirstChild].get();
+		const KDNode* FarChild = CurrentNode->Child[FirstChild ^ 1].get();
 
+		if (std::abs(Ray.direction[Axis]) < _EPSILON)
+		{
+			// Ray is parallel to the plane, visit only near side
+			CurrentNode = NearChild;
+			continue;
+		}
+
+		// Find t value of intersection of ray with split plane
+		const float tSplit = (CurrentNode->SplitValue - Ray.origin[Axis]) / Ray.direction[Axis];
+
+		if (tSplit > tMax || tSplit <= 0.0f)
+		{
+			CurrentNode = NearChild;
+		}
+		else if (tSplit < tMin)
+		{
+			CurrentNode = FarChild;
+		}
+		else
+		{
+			// the far side is only needed when nothing blocks the near side
+			if (IDrawable* Occluder = FindOccluderInNodes(NearChild, Ray, tMin, tSplit, tRayMax))
+				return Occluder;
+
+			CurrentNode = FarChild;
+			tMin = tSplit;
+		}
+	}
+}
+
+bool KDTree::VisitNodesAgainstRay(KDNode* CurrentNode, const FRay& Ray, float tMin, float tMax, float* tValueOut, FIntersection* IntersectionOut)
+{
 	bool IsIntersecting = false;
 
 	for (const auto& primitive : CurrentNode->ObjectList)
@@ -112,36 +387,119 @@ bool KDTree::VisitNodesAgainstRay(KDNode* CurrentNode, FRay Ray, float* tValueOu
 	if (!IntersectionOut && IsIntersecting)
 		return true;
 
+	if (!CurrentNode->Child[0])
+		return IsIntersecting;
+
+	// objects beyond the closest intersection can't be closer
+	if (tValueOut)
+		tMax = std::min(tMax, *tValueOut);
+
 	// check which child to traverse first from axis split
-	uint32_t Axis = CurrentNode->Axis;
-	uint32_t FirstChild = Ray.origin[Axis] > CurrentNode->SplitValue;
+	const uint32_t Axis = CurrentNode->Axis;
+	const uint32_t FirstChild = Ray.origin[Axis] > CurrentNode->SplitValue ||
+		(Ray.origin[Axis] == CurrentNode->SplitValue && Ray.direction[Axis] < 0.0f);
+
+	KDNode* NearChild = CurrentNode->Child[FirstChild].get();
+	KDNode* FarChild = CurrentNode->Child[FirstChild ^ 1].get();
 
-	if (abs(Ray.direction[Axis]) < _EPSILON)
+	if (std::abs(Ray.direction[Axis]) < _EPSILON)
 	{
 		// Ray is parallel to the plane, visit only near side
-		IsIntersecting |= VisitNodesAgainstRay(CurrentNode->Child[FirstChild].get(), Ray, tValueOut, IntersectionOut);
+		return IsIntersecting | VisitNodesAgainstRay(NearChild, Ray, tMin, tMax, tValueOut, IntersectionOut);
+	}
+
+	// Find t value of intersection of ray with split plane
+	const float tSplit = (CurrentNode->SplitValue - Ray.origin[Axis]) / Ray.direction[Axis];
+
+	if (tSplit > tMax || tSplit <= 0.0f)
+	{
+		// Ray segment doesn't reach the splitting plane, just check near side
+		IsIntersecting |= VisitNodesAgainstRay(NearChild, Ray, tMin, tMax, tValueOut, IntersectionOut);
+	}
+	else if (tSplit < tMin)
+	{
+		// Ray segment starts past the splitting plane, just check far side
+		IsIntersecting |= VisitNodesAgainstRay(FarChild, Ray, tMin, tMax, tValueOut, IntersectionOut);
 	}
 	else
 	{
-		// Find t value of intersection of ray with split plane
-		float t = (CurrentNode->SplitValue - Ray.origin[Axis]) / Ray.direction[Axis];
+		// Check for intersection in the near field, then far
+		IsIntersecting |= VisitNodesAgainstRay(NearChild, Ray, tMin, tSplit, tValueOut, IntersectionOut);
 
-		// Check if ray straddles the splitting plane
-		// If no tValueout is given, make one
-		float maxTValue = (tValueOut) ? *tValueOut : std::numeric_limits<float>::max();
+		if (!IntersectionOut && IsIntersecting)
+			return true;
 
-		if (0.0f <= t && t < maxTValue)
+		// everything in the far child is past the split, skip it if a closer intersection was found
+		if (!tValueOut || *tValueOut >= tSplit)
+			IsIntersecting |= VisitNodesAgainstRay(FarChild, Ray, tSplit, tMax, tValueOut, IntersectionOut);
+	}
+
+	return IsIntersecting;
+}
+
+uint32_t KDTree::IsIntersectingPacket(FRayPacket& Packet, FIntersection* IntersectionsOut)
+{
+	uint32_t HitMask = 0;
+
+	// rays that don't share direction signs can't share a traversal order
+	if (!Packet.IsCoherent)
+	{
+		for (uint32_t i = 0; i < Packet.Size; i++)
 		{
-			// Check for intersection in the near field, then far
-			IsIntersecting |= VisitNodesAgainstRay(CurrentNode->Child[FirstChild].get(), Ray, tValueOut, IntersectionOut);
-			IsIntersecting |= VisitNodesAgainstRay(CurrentNode->Child[FirstChild ^ 1].get(), Ray, tValueOut, IntersectionOut);
+			if (IsIntersectingRay(Packet.Rays[i], &Packet.tMax[i], &IntersectionsOut[i]))
+				HitMask |= 1u << i;
 		}
-		else
+		return HitMask;
+	}
+
+	for (const auto& Primitive : mUnboundedObjects)
+	{
+		HitMask |= Primitive->IsIntersectingPacket(Packet, Packet.GetFullMask(), IntersectionsOut);
+	}
+
+	if (mObjects.size() == mUnboundedObjects.size())
+		return HitMask;
+
+	return HitMask | VisitNodesAgainstPacket(&mRoot, mBounds, Packet, Packet.GetFullMask(), IntersectionsOut);
+}
+
+uint32_t KDTree::VisitNodesAgainstPacket(KDNode* CurrentNode, const AABB& NodeBounds, FRayPacket& Packet, uint32_t ActiveMask, FIntersection* IntersectionsOut)
+{
+	// only rays that reach the node before their closest intersection continue
+	ActiveMask = Packet.GetOverlappingRays(NodeBounds, ActiveMask);
+	if (!ActiveMask)
+		return 0;
+
+	// a single ray is cheaper to trace on its own
+	if (Packet.CountRays(ActiveMask) == 1)
+	{
+		const uint32_t Ray = Packet.GetFirstRay(ActiveMask);
+		float tMin = 0.0f, tMax = Packet.tMax[Ray];
+		if (NodeBounds.ClipRay(Packet.Rays[Ray], tMin, tMax) &&
+			VisitNodesAgainstRay(CurrentNode, Packet.Rays[Ray], tMin, tMax, &Packet.tMax[Ray], &IntersectionsOut[Ray]))
 		{
-			// Just check near side
-			IsIntersecting |= VisitNodesAgainstRay(CurrentNode->Child[FirstChild].get(), Ray, tValueOut, IntersectionOut);
+			return ActiveMask;
 		}
+		return 0;
 	}
 
-	return IsIntersecting;
-}
\ No newline at end of file
+	uint32_t HitMask = 0;
+	for (const auto& Primitive : CurrentNode->ObjectList)
+	{
+		HitMask |= Primitive->IsIntersectingPacket(Packet, ActiveMask, IntersectionsOut);
+	}
+
+	if (!CurrentNode->Child[0])
+		return HitMask;
+
+	// child 0 is below the split, visit the child on the side the rays come from first
+	const uint32_t Axis = CurrentNode->Axis;
+	AABB ChildBounds[2] = { NodeBounds, NodeBounds };
+	ChildBounds[0].Max[Axis] = ChildBounds[1].Min[Axis] = CurrentNode->SplitValue;
+
+	const uint32_t NearChild = Packet.IsDirectionNegative[Axis] ? 1 : 0;
+	HitMask |= VisitNodesAgainstPacket(CurrentNode->Child[NearChild].get(), ChildBounds[NearChild], Packet, ActiveMask, IntersectionsOut);
+	HitMask |= VisitNodesAgainstPacket(CurrentNode->Child[NearChild ^ 1].get(), ChildBounds[NearChild ^ 1], Packet, ActiveMask, IntersectionsOut);
+
+	return HitMask;
+}
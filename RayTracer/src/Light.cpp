@@ -20,4 +20,4 @@ ILight::~ILight()
 void ILight::SetLightColor(const FColor& LightColor)
 {
 	mLightColor = LightColor;
-}
\ No newline at end of file
+}
@@ -0,0 +1,126 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+FMappedFile::FMappedFile()
+	: mData(nullptr)
+	, mSize(0)
+	, mIsOpen(false)
+#ifdef _WIN32
+	, mFileHandle(nullptr)
+	, mMappingHandle(nullptr)
+#endif
+{
+}
+
+FMappedFile::~FMappedFile()
+{
+	Close();
+}
+
+bool FMappedFile::Open(const std::string& Filepath)
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE File = CreateFileA(Filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (File == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER FileSize;
+	if (!GetFileSizeEx(File, &FileSize))
+	{
+		CloseHandle(File);
+		return false;
+	}
+
+	mFileHandle = File;
+	mSize = (size_t)FileSize.QuadPart;
+	mIsOpen = true;
+
+	// empty files can't be mapped, they are open with no data
+	if (mSize == 0)
+		return true;
+
+	mMappingHandle = CreateFileMappingA(File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mMappingHandle)
+		mData = (const char*)MapViewOfFile(mMappingHandle, FILE_MAP_READ, 0, 0, 0);
+#else
+	const int File = open(Filepath.c_str(), O_RDONLY);
+	if (File < 0)
+		return false;
+
+	struct stat FileStatus;
+	if (fstat(File, &FileStatus) != 0)
+	{
+		close(File);
+		return false;
+	}
+
+	mSize = (size_t)FileStatus.st_size;
+	mIsOpen = true;
+
+	// empty files can't be mapped, they are open with no data
+	if (mSize > 0)
+	{
+		void* Mapping = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, File, 0);
+		mData = (Mapping != MAP_FAILED) ? (const char*)Mapping : nullptr;
+	}
+
+	// the mapping keeps the file alive
+	close(File);
+#endif
+
+	if (mSize > 0 && !mData)
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void FMappedFile::Close()
+{
+#ifdef _WIN32
+	if (mData)
+		UnmapViewOfFile(mData);
+	if (mMappingHandle)
+		CloseHandle(mMappingHandle);
+	if (mFileHandle)
+		CloseHandle(mFileHandle);
+	mMappingHandle = nullptr;
+	mFileHandle = nullptr;
+#else
+	if (mData)
+		munmap((void*)mData, mSize);
+#endif
+
+	mData = nullptr;
+	mSize = 0;
+	mIsOpen = false;
+}
+
+bool FMappedFile::IsOpen() const
+{
+	return mIsOpen;
+}
+
+const char* FMappedFile::GetData() const
+{
+	return mData;
+}
+
+size_t FMappedFile::GetSize() const
+{
+	return mSize;
+}
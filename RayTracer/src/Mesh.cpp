@@ -1,76 +1,473 @@
 #include "Mesh.h"
 #include "Intersection.h"
+#include "ObjModel.h"
 
 #include <iostream>
 #include <fstream>
 #include <limits>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <string>
 
-#define _BVH_MIN_OBJECTS 5
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+/* Cost of a BVH node bounds test relative to a triangle intersection test */
+static const float BVHTraversalCost = 0.125f;
+/* Number of split candidate bins on each axis */
+static const uint32_t BVHBinCount = 16;
+/* Deepest level of the BVH, bounds the traversal stack */
+static const uint32_t BVHMaxDepth = 64;
+static_assert(FObjModel::NoIndex == 0xFFFFFFFF, "Model indices are passed on as mesh indices");
+
+/* Appended to a model's file path to name its cache file */
+static const char* const MeshCacheExtension = ".bvh";
+/* Changes whenever the layout of a cache file changes */
+static const uint32_t MeshCacheVersion = 2;
+/* Number of arrays stored in a cache file */
+static const uint32_t MeshCacheArrays = 10;
+/* Alignment of each array in a cache file */
+static const uint64_t MeshCacheAlignment = 16;
+
+/**
+* Start of a mesh cache file. It records what the mesh was built from, and the size of each array.
+* The arrays follow in the order of FMeshData, each aligned to MeshCacheAlignment bytes.
+*/
+struct FMeshCacheHeader
+{
+	char Magic[8];
+	uint32_t Version;
+	uint32_t NodeSize; /* Size of a BVH node, in case the node layout changes */
+	uint64_t SourceHash; /* Hash of the model file contents */
+	uint32_t MaxLeafTriangles; /* Build settings of the BVH */
+	uint32_t BinCount;
+	float TraversalCost;
+	uint32_t NumBVHNodes;
+	uint32_t NumVertices;
+	uint32_t NumUVs;
+	uint32_t NumVertexNormals;
+	uint32_t NumTriangles;
+	float BVHCost;
+	float BoundsMin[3];
+	float BoundsMax[3];
+};
+
+static const char MeshCacheMagic[8] = { 'R', 'T', 'M', 'E', 'S', 'H', 'C', '\0' };
+
+/**
+* Computes the placement of each array in a cache file.
+* @param Header - Header with the number of entries in each array
+* @param OffsetsOut - Receives the offset of each array
+* @param SizesOut - Receives the size of each array in bytes
+* @return The size of the file.
+*/
+static uint64_t GetMeshCacheLayout(const FMeshCacheHeader& Header, uint64_t OffsetsOut[MeshCacheArrays], uint64_t SizesOut[MeshCacheArrays])
+{
+	SizesOut[0] = (uint64_t)Header.NumBVHNodes * Header.NodeSize;
+	SizesOut[1] = (uint64_t)Header.NumVertices * sizeof(Vector3f);
+	SizesOut[2] = (uint64_t)Header.NumUVs * sizeof(Vector2f);
+	SizesOut[3] = (uint64_t)Header.NumVertexNormals * sizeof(Vector3f);
+	SizesOut[4] = (uint64_t)Header.NumTriangles * 3 * sizeof(uint32_t);
+	SizesOut[5] = (uint64_t)Header.NumTriangles * 3 * sizeof(uint32_t);
+	SizesOut[6] = (uint64_t)Header.NumTriangles * 3 * sizeof(uint32_t);
+	SizesOut[7] = (uint64_t)Header.NumTriangles * sizeof(Vector3f);
+	SizesOut[8] = (uint64_t)Header.NumTriangles * sizeof(Vector3f);
+	SizesOut[9] = (uint64_t)Header.NumTriangles * sizeof(Vector3f);
+
+	uint64_t Offset = sizeof(FMeshCacheHeader);
+	for (uint32_t i = 0; i < MeshCacheArrays; i++)
+	{
+		Offset = (Offset + MeshCacheAlignment - 1) & ~(MeshCacheAlignment - 1);
+		OffsetsOut[i] = Offset;
+		Offset += SizesOut[i];
+	}
+
+	return Offset;
+}
+
+/**
+* Gets the id of this process, to name files that only this process writes.
+*/
+static long long GetProcessNumber()
+{
+#ifdef _WIN32
+	return _getpid();
+#else
+	return getpid();
+#endif
+}
+
+/**
+* Hashes the contents of a file, eight bytes at a time.
+* @param Filepath - The file to hash
+* @param HashOut - Receives the hash
+* @return False if the file could not be read.
+*/
+static bool HashFile(const std::string& Filepath, uint64_t& HashOut)
+{
+	FMappedFile File;
+	if (!File.Open(Filepath))
+		return false;
+
+	const uint64_t Prime = 0x100000001B3ull;
+	uint64_t Hash = 0xCBF29CE484222325ull ^ File.GetSize();
+	const char* const Data = File.GetData();
+	const size_t NumWords = File.GetSize() / sizeof(uint64_t);
+	for (size_t i = 0; i < NumWords; i++)
+	{
+		uint64_t Word;
+		std::memcpy(&Word, Data + i * sizeof(uint64_t), sizeof(uint64_t));
+		Hash = (Hash ^ Word) * Prime;
+		Hash ^= Hash >> 29;
+	}
+
+	for (size_t i = NumWords * sizeof(uint64_t); i < File.GetSize(); i++)
+		Hash = (Hash ^ (uint8_t)Data[i]) * Prime;
+
+	HashOut = Hash;
+	return true;
+}
+
+/**
+* Rearranges per triangle data into a new triangle order.
+* @param Values - Data with Stride entries per triangle
+* @param Order - Original index of each triangle in the new order
+*/
+template <typename T>
+static void ReorderTriangleData(std::vector<T>& Values, const std::vector<uint32_t>& Order, const uint32_t Stride)
+{
+	std::vector<T> Ordered;
+	Ordered.reserve(Values.size());
+	for (const uint32_t Triangle : Order)
+	{
+		for (uint32_t i = 0; i < Stride; i++)
+			Ordered.push_back(Values[Stride * Triangle + i]);
+	}
+	Values.swap(Ordered);
+}
 
 FMesh::FMesh(const FMaterial& Material)
 	: IDrawable(Material)
-	, mBVHRoot()
+	, mData(std::make_shared<FMeshData>())
 {
 }
 
-FMesh::FMesh(const std::string& ModelFilepath, const FMaterial& Material)
-	: IDrawable(Material)
-	, mBVHRoot()
+FMesh::FMesh(const std::string& ModelFilepath, const FMaterial& Material, const uint32_t MaxLeafTriangles, const bool UseCache)
+	: FMesh(Material)
 {
+	// a cache is only used for the exact model contents it was built from
+	uint64_t SourceHash = 0;
+	const bool CanCache = UseCache && HashFile(ModelFilepath, SourceHash);
+	const std::string CacheFilepath = ModelFilepath + MeshCacheExtension;
+	if (CanCache && ReadCache(CacheFilepath, SourceHash, MaxLeafTriangles))
+		return;
+
 	ReadModel(ModelFilepath);
-	ConstructBVH(mBVHRoot, 8);
+	ConstructBVH(MaxLeafTriangles);
+	BindBuffers();
+
+	if (CanCache)
+		WriteCache(CacheFilepath, SourceHash, MaxLeafTriangles);
+}
+
+FMesh::FMesh(const std::vector<Vector3f>& Vertices, const std::vector<uint32_t>& Indices, const FMaterial& Material, const uint32_t MaxLeafTriangles)
+	: FMesh(Material)
+{
+	mData->Buffers.Vertices = Vertices;
+
+	Vector3f MinBounds(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+	Vector3f MaxBounds(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest());
+	for (const Vector3f& Vertex : Vertices)
+		UpdateBounds(MinBounds, MaxBounds, Vertex);
+
+	const uint32_t NoUVs[3] = { NoUV, NoUV, NoUV };
+	const uint32_t NoNormals[3] = { NoNormal, NoNormal, NoNormal };
+	for (size_t i = 0; i + 2 < Indices.size(); i += 3)
+		AddTriangle(&Indices[i], NoUVs, NoNormals);
+
+	if (!Vertices.empty())
+		ConstructAABB(MinBounds, MaxBounds);
+
+	ConstructBVH(MaxLeafTriangles);
+	BindBuffers();
 }
 
 bool FMesh::IsIntersectingRay(FRay Ray, float* tValueOut, FIntersection* IntersectionOut)
 {
-	if (!IsEnabled())
+	// skip the surface the ray was spawned from, or only the triangle it was spawned from
+	const uint32_t IgnoredTriangle = (Ray.ignoreObject == this) ? Ray.ignorePrimitive : FRay::AllPrimitives;
+	if ((Ray.ignoreObject == this && IgnoredTriangle == FRay::AllPrimitives) || mData->NumBVHNodes == 0)
 		return false;
 
 	// bring ray into object space for intersection tests
 	Ray = GetWorldInvTransform().TransformRay(Ray);
 
-	const bool Flag = TraverseBVHAgainstRay(mBVHRoot, Ray, tValueOut, IntersectionOut);
+	// closest hit found so far
+	float tClosest = (tValueOut) ? *tValueOut : std::numeric_limits<float>::max();
+	uint32_t ClosestTriangle = FRay::AllPrimitives;
+	float ClosestAlpha = 0.0f, ClosestBeta = 0.0f;
 
-	if (Flag && tValueOut && IntersectionOut)
+	const Vector3f InvDirection(1.0f / Ray.direction.x, 1.0f / Ray.direction.y, 1.0f / Ray.direction.z);
+	const bool IsDirectionNegative[3] = { InvDirection.x < 0.0f, InvDirection.y < 0.0f, InvDirection.z < 0.0f };
+
+	bool IsIntersecting = false;
+	uint32_t NodesToVisit[BVHMaxDepth];
+	uint32_t StackSize = 0;
+	uint32_t NodeIndex = 0;
+
+	while (true)
 	{
-		const FMatrix4& WorldTransform = GetWorldTransform();
-		IntersectionOut->point = WorldTransform.TransformPosition(IntersectionOut->point);
-		IntersectionOut->normal = WorldTransform.TransformDirection(IntersectionOut->normal);
+		const FLinearBVHNode& Node = mData->BVHNodes[NodeIndex];
+
+		if (Node.Bounds.IsOverlappingSegment(Ray.origin, InvDirection, 0.0f, tClosest))
+		{
+			if (Node.NumTriangles > 0)
+			{
+				for (uint32_t i = Node.FirstTriangle; i < Node.FirstTriangle + Node.NumTriangles; i++)
+				{
+					float t, Alpha, Beta;
+					if (i == IgnoredTriangle || !IsIntersectingTriangle(i, Ray, tClosest, t, Alpha, Beta))
+						continue;
+
+					// if no IntersectionOut, return when a valid intersection is hit
+					if (!IntersectionOut)
+						return true;
+
+					IsIntersecting = true;
+					if (t < tClosest)
+					{
+						tClosest = t;
+						ClosestTriangle = i;
+						ClosestAlpha = Alpha;
+						ClosestBeta = Beta;
+					}
+				}
+
+				if (StackSize == 0)
+					break;
+				NodeIndex = NodesToVisit[--StackSize];
+			}
+			else
+			{
+				// visit the child on the side the ray comes from first
+				if (IsDirectionNegative[Node.Axis])
+				{
+					NodesToVisit[StackSize++] = NodeIndex + 1;
+					NodeIndex = Node.SecondChild;
+				}
+				else
+				{
+					NodesToVisit[StackSize++] = Node.SecondChild;
+					NodeIndex = NodeIndex + 1;
+				}
+			}
+		}
+		else
+		{
+			if (StackSize == 0)
+				break;
+			NodeIndex = NodesToVisit[--StackSize];
+		}
 	}
 
-	return Flag;
+	// only a closer hit writes a new intersection, a hit at the same t leaves it untouched
+	if (ClosestTriangle != FRay::AllPrimitives && tValueOut)
+	{
+		*tValueOut = tClosest;
+		ConstructIntersection(ClosestTriangle, Ray, tClosest, ClosestAlpha, ClosestBeta, *IntersectionOut);
+	}
+
+	return IsIntersecting;
 }
 
-bool FMesh::TraverseBVHAgainstRay(FBVHNode& Node, FRay Ray, float* tValueOut, FIntersection* IntersectionOut)
+bool FMesh::IsOccludingRay(const FRay& WorldRay, float tMax)
 {
-	float TempTValue = (tValueOut) ? *tValueOut : std::numeric_limits<float>::max();
-	if (!Node.BoundingVolume.IsIntersectingRay(Ray, &TempTValue))
+	const uint32_t IgnoredTriangle = (WorldRay.ignoreObject == this) ? WorldRay.ignorePrimitive : FRay::AllPrimitives;
+	if ((WorldRay.ignoreObject == this && IgnoredTriangle == FRay::AllPrimitives) || mData->NumBVHNodes == 0)
 		return false;
 
-	if (!Node.Objects.empty())
+	const FRay Ray = GetWorldInvTransform().TransformRay(WorldRay);
+	const Vector3f InvDirection(1.0f / Ray.direction.x, 1.0f / Ray.direction.y, 1.0f / Ray.direction.z);
+	const bool IsDirectionNegative[3] = { InvDirection.x < 0.0f, InvDirection.y < 0.0f, InvDirection.z < 0.0f };
+
+	// no closest hit is tracked, every node is tested against the full segment
+	uint32_t NodesToVisit[BVHMaxDepth];
+	uint32_t StackSize = 0;
+	uint32_t NodeIndex = 0;
+
+	while (true)
 	{
-		bool IsIntersecting = false;
-		for (const auto& Object : Node.Objects)
+		const FLinearBVHNode& Node = mData->BVHNodes[NodeIndex];
+
+		if (Node.Bounds.IsOverlappingSegment(Ray.origin, InvDirection, 0.0f, tMax))
 		{
-			IsIntersecting |= Object->IsIntersectingRay(Ray, tValueOut, IntersectionOut);
+			if (Node.NumTriangles > 0)
+			{
+				for (uint32_t i = Node.FirstTriangle; i < Node.FirstTriangle + Node.NumTriangles; i++)
+				{
+					float t, Alpha, Beta;
+					if (i != IgnoredTriangle && IsIntersectingTriangle(i, Ray, tMax, t, Alpha, Beta))
+						return true;
+				}
+			}
+			else
+			{
+				// occluders near the ray origin are found sooner from the near child
+				if (IsDirectionNegative[Node.Axis])
+				{
+					NodesToVisit[StackSize++] = NodeIndex + 1;
+					NodeIndex = Node.SecondChild;
+				}
+				else
+				{
+					NodesToVisit[StackSize++] = Node.SecondChild;
+					NodeIndex = NodeIndex + 1;
+				}
+				continue;
+			}
 		}
 
-		return IsIntersecting;
+		if (StackSize == 0)
+			return false;
+		NodeIndex = NodesToVisit[--StackSize];
+	}
+}
+
+uint32_t FMesh::IsIntersectingPacket(FRayPacket& Packet, uint32_t ActiveMask, FIntersection* IntersectionsOut)
+{
+	if (mData->NumBVHNodes == 0)
+		return 0;
+
+	// rays spawned from this mesh skip one of its triangles, test them on their own
+	for (uint32_t i = 0; i < Packet.Size; i++)
+	{
+		if ((ActiveMask & (1u << i)) && Packet.Rays[i].ignoreObject == this)
+			return IDrawable::IsIntersectingPacket(Packet, ActiveMask, IntersectionsOut);
 	}
 
-	bool IsIntersecting = false;
-	IsIntersecting |= TraverseBVHAgainstRay(*Node.Child[1], Ray, tValueOut, IntersectionOut);
-	IsIntersecting |= TraverseBVHAgainstRay(*Node.Child[0], Ray, tValueOut, IntersectionOut);
+	// bring the rays into object space, t values are the same in both spaces
+	const FMatrix4& WorldInvTransform = GetWorldInvTransform();
+	FRay ObjectRays[FRayPacket::MaxSize];
+	for (uint32_t i = 0; i < Packet.Size; i++)
+		ObjectRays[i] = WorldInvTransform.TransformRay(Packet.Rays[i]);
 
-	return IsIntersecting;
+	FRayPacket ObjectPacket(ObjectRays, Packet.Size);
+	if (!ObjectPacket.IsCoherent)
+		return IDrawable::IsIntersectingPacket(Packet, ActiveMask, IntersectionsOut);
+	std::copy(Packet.tMax, Packet.tMax + FRayPacket::MaxSize, ObjectPacket.tMax);
 
+	// closest hit found so far for each ray
+	uint32_t ClosestTriangles[FRayPacket::MaxSize];
+	RAYTRACER_ALIGN(16) float ClosestAlphas[FRayPacket::MaxSize];
+	RAYTRACER_ALIGN(16) float ClosestBetas[FRayPacket::MaxSize];
+	std::fill(ClosestTriangles, ClosestTriangles + FRayPacket::MaxSize, FRay::AllPrimitives);
+
+	// nodes are visited in the same order as single rays, each with the rays that reached its parent
+	struct FNodeToVisit
+	{
+		uint32_t Node;
+		uint32_t RayMask;
+	};
+
+	uint32_t HitMask = 0;
+	FNodeToVisit NodesToVisit[BVHMaxDepth];
+	uint32_t StackSize = 0;
+	uint32_t NodeIndex = 0;
+	uint32_t RayMask = ActiveMask;
+
+	while (true)
+	{
+		const FLinearBVHNode& Node = mData->BVHNodes[NodeIndex];
+		RayMask = ObjectPacket.GetOverlappingRays(Node.Bounds, RayMask);
+
+		if (RayMask && Node.NumTriangles == 0)
+		{
+			// visit the child on the side the rays come from first
+			if (ObjectPacket.IsDirectionNegative[Node.Axis])
+			{
+				NodesToVisit[StackSize++] = { NodeIndex + 1, RayMask };
+				NodeIndex = Node.SecondChild;
+			}
+			else
+			{
+				NodesToVisit[StackSize++] = { Node.SecondChild, RayMask };
+				NodeIndex = NodeIndex + 1;
+			}
+			continue;
+		}
+
+		for (uint32_t i = Node.FirstTriangle; RayMask && i < Node.FirstTriangle + Node.NumTriangles; i++)
+		{
+			RAYTRACER_ALIGN(16) float tValues[FRayPacket::MaxSize], Alphas[FRayPacket::MaxSize], Betas[FRayPacket::MaxSize];
+			const uint32_t TriangleHits = IsIntersectingTrianglePacket(i, ObjectPacket, RayMask, tValues, Alphas, Betas);
+			HitMask |= TriangleHits;
+
+			// keep the hits that are closer than the closest so far
+			for (uint32_t Hits = TriangleHits; Hits; Hits &= Hits - 1)
+			{
+				const uint32_t Ray = FRayPacket::GetFirstRay(Hits);
+				if (!(tValues[Ray] < ObjectPacket.tMax[Ray]))
+					continue;
+
+				ObjectPacket.tMax[Ray] = tValues[Ray];
+				ClosestTriangles[Ray] = i;
+				ClosestAlphas[Ray] = Alphas[Ray];
+				ClosestBetas[Ray] = Betas[Ray];
+			}
+		}
+
+		if (StackSize == 0)
+			break;
+		--StackSize;
+		NodeIndex = NodesToVisit[StackSize].Node;
+		RayMask = NodesToVisit[StackSize].RayMask;
+	}
+
+	// only a closer hit writes a new intersection
+	for (uint32_t i = 0; i < Packet.Size; i++)
+	{
+		if (ClosestTriangles[i] == FRay::AllPrimitives)
+			continue;
+
+		Packet.tMax[i] = ObjectPacket.tMax[i];
+		ConstructIntersection(ClosestTriangles[i], ObjectRays[i], ObjectPacket.tMax[i], ClosestAlphas[i], ClosestBetas[i], IntersectionsOut[i]);
+	}
+
+	return HitMask;
 }
 
-FMaterial FMesh::GetMaterial(Vector3f SurfacePoint)
+void FMesh::ConstructIntersection(const uint32_t Triangle, const FRay& Ray, const float t, const float Alpha, const float Beta, FIntersection& IntersectionOut)
 {
-	// remove compiler warning
-	SurfacePoint;
-	return mMaterial;
+	const FMatrix4& WorldTransform = GetWorldTransform();
+	const Vector3f& Normal = mData->Normals[Triangle];
+	const Vector3f Point = Ray.origin + t * Ray.direction;
+
+	// interpolate vertex UVs with the barycentric coordinates of the hit
+	Vector2f UV;
+	const uint32_t* UVIndices = &mData->UVIndices[3 * Triangle];
+	if (UVIndices[0] != NoUV)
+		UV = (1.0f - Alpha - Beta) * mData->UVs[UVIndices[0]] + Alpha * mData->UVs[UVIndices[1]] + Beta * mData->UVs[UVIndices[2]];
+
+	// interpolate vertex normals for smooth shading, the face normal still offsets the point off the surface
+	Vector3f ShadingNormal = Normal;
+	const uint32_t* NormalIndices = &mData->NormalIndices[3 * Triangle];
+	if (NormalIndices[0] != NoNormal)
+	{
+		ShadingNormal = (1.0f - Alpha - Beta) * mData->VertexNormals[NormalIndices[0]] + Alpha * mData->VertexNormals[NormalIndices[1]] + Beta * mData->VertexNormals[NormalIndices[2]];
+		ShadingNormal.Normalize();
+	}
+
+	IntersectionOut.object = this;
+	IntersectionOut.primitive = Triangle;
+	IntersectionOut.point = WorldTransform.TransformPosition(Point + Normal * _EPSILON);
+	IntersectionOut.normal = WorldTransform.TransformDirection(ShadingNormal);
+	IntersectionOut.uv = UV;
 }
 
 void FMesh::ConstructAABB(Vector3f Min, Vector3f Max)
@@ -80,170 +477,609 @@ void FMesh::ConstructAABB(Vector3f Min, Vector3f Max)
 
 void FMesh::ReadModel(const std::string& ModelFilepath)
 {
-	// bounds for bounding box
+	FObjModel Model;
+	if (!Model.Read(ModelFilepath))
+	{
+		std::cout << "Failed to open FMesh model filename: "
+			<< ModelFilepath;
+		return;
+	}
+
+	if (Model.NumSkippedTriangles > 0)
+		std::cout << ModelFilepath << ": skipped " << Model.NumSkippedTriangles << " triangles with missing vertices" << std::endl;
+
+	// bounds for bounding box, they always include the model's origin
 	Vector3f MinBounds;
 	Vector3f MaxBounds;
+	for (const Vector3f& Vertex : Model.Vertices)
+		UpdateBounds(MinBounds, MaxBounds, Vertex);
+
+	FMeshBuffers& Buffers = mData->Buffers;
+	Buffers.Vertices.swap(Model.Vertices);
+	Buffers.UVs.swap(Model.UVs);
+	Buffers.VertexNormals.swap(Model.Normals);
+	for (Vector3f& VertexNormal : Buffers.VertexNormals)
+		VertexNormal.Normalize();
 
-	std::ifstream ModelFile(ModelFilepath.c_str());
+	const size_t NumTriangles = Model.GetNumTriangles();
+	Buffers.VertexIndices.reserve(3 * NumTriangles);
+	Buffers.UVIndices.reserve(3 * NumTriangles);
+	Buffers.NormalIndices.reserve(3 * NumTriangles);
+	Buffers.Edges1.reserve(NumTriangles);
+	Buffers.Edges2.reserve(NumTriangles);
+	Buffers.Normals.reserve(NumTriangles);
 
-	if (ModelFile.fail())
+	for (size_t i = 0; i < NumTriangles; i++)
 	{
-		std::cout << "Failed to open FMesh model filename: "
-			<< ModelFilepath;
-		return;
+		// .obj vertex order is clockwise, we use counterclockwise
+		const uint32_t* const Vertices = &Model.VertexIndices[3 * i];
+		const uint32_t* const UVs = &Model.UVIndices[3 * i];
+		const uint32_t* const Normals = &Model.NormalIndices[3 * i];
+		const uint32_t TriangleVerts[3] = { Vertices[2], Vertices[1], Vertices[0] };
+		const uint32_t TriangleUVs[3] = { UVs[2], UVs[1], UVs[0] };
+		const uint32_t TriangleNormals[3] = { Normals[2], Normals[1], Normals[0] };
+		AddTriangle(TriangleVerts, TriangleUVs, TriangleNormals);
 	}
 
-	std::string FileLine;
-	std::vector<Vector3f> Vertices;
-	std::vector<Vector2f> UVs;
-	std::vector<std::unique_ptr<FTriangle>> Triangles;
+	ConstructAABB(MinBounds, MaxBounds);
+}
 
-	while (getline(ModelFile, FileLine))
+void FMesh::AddTriangle(const uint32_t VertexIndices[3], const uint32_t UVIndices[3], const uint32_t NormalIndices[3])
+{
+	const Vector3f& V0 = mData->Buffers.Vertices[VertexIndices[0]];
+	const Vector3f Edge1 = mData->Buffers.Vertices[VertexIndices[1]] - V0;
+	const Vector3f Edge2 = mData->Buffers.Vertices[VertexIndices[2]] - V0;
+
+	Vector3f Normal = Vector3f::Cross(Edge2, Edge1);
+	Normal.Normalize();
+
+	mData->Buffers.VertexIndices.insert(mData->Buffers.VertexIndices.end(), VertexIndices, VertexIndices + 3);
+	mData->Buffers.UVIndices.insert(mData->Buffers.UVIndices.end(), UVIndices, UVIndices + 3);
+	mData->Buffers.NormalIndices.insert(mData->Buffers.NormalIndices.end(), NormalIndices, NormalIndices + 3);
+	mData->Buffers.Edges1.push_back(Edge1);
+	mData->Buffers.Edges2.push_back(Edge2);
+	mData->Buffers.Normals.push_back(Normal);
+}
+
+bool FMesh::IsIntersectingTriangle(const uint32_t Triangle, const FRay& Ray, const float tMax, float& tOut, float& AlphaOut, float& BetaOut) const
+{
+	// Ray/Triangle intersection test from 3D Math Primier for Graphics and Game Development
+	const Vector3f& Normal = mData->Normals[Triangle];
+	const Vector3f& V0 = mData->Vertices[mData->VertexIndices[3 * Triangle]];
+
+	// Compute gradient, how steep is the ray against the triangle
+	const float Gradient = Vector3f::Dot(Normal, Ray.direction);
+
+	// Check if ray is pointing towards the triangle
+	if (!(Gradient < 0.0f))
+		return false;
+
+	// Compute parametric point of intersection with plane, bail if ray is on backside of plane
+	float t = Vector3f::Dot(Normal, V0) - Vector3f::Dot(Normal, Ray.origin);
+	if (!(t <= 0.0f))
+		return false;
+
+	// Check if tMax is closer
+	if (!(t >= Gradient * tMax))
+		return false;
+
+	// The ray intersects the plane, now find the point
+	t /= Gradient;
+	if (t > tMax)
+		return false;
+
+	const Vector3f Offset = Ray.origin + Ray.direction * t - V0;
+	const Vector3f& Edge1 = mData->Edges1[Triangle];
+	const Vector3f& Edge2 = mData->Edges2[Triangle];
+
+	// Project onto the plane with the largest area, skipping the dominant axis of the normal
+	uint32_t UAxis, VAxis;
+	if (std::abs(Normal.x) > std::abs(Normal.y))
 	{
-		// line contains a vertex
-		if (FileLine[0] == 'v' && FileLine[1] == ' ')
-		{
-			FileLine = FileLine.substr(2);
+		UAxis = (std::abs(Normal.x) > std::abs(Normal.z)) ? 1 : 0;
+		VAxis = (std::abs(Normal.x) > std::abs(Normal.z)) ? 2 : 1;
+	}
+	else
+	{
+		UAxis = 0;
+		VAxis = (std::abs(Normal.y) > std::abs(Normal.z)) ? 2 : 1;
+	}
 
-			const std::string XString = FileLine.substr(0, FileLine.find(' '));
-			const float X = (float)atof(XString.c_str());
+	const float u0 = Offset[UAxis], u1 = Edge1[UAxis], u2 = Edge2[UAxis];
+	const float v0 = Offset[VAxis], v1 = Edge1[VAxis], v2 = Edge2[VAxis];
 
-			FileLine = FileLine.substr(XString.length() + 1);
-			const std::string YString = FileLine.substr(0, FileLine.find(' '));
-			const float Y = (float)atof(YString.c_str());
+	// Compute denominator
+	float Denominator = u1 * v2 - v1 * u2;
+	if (!(Denominator != 0.0f))
+		return false;
+	Denominator = 1.f / Denominator;
 
-			FileLine = FileLine.substr(YString.length() + 1);
-			const std::string ZString = FileLine.substr(0, FileLine.find(' '));
-			const float Z = (float)atof(ZString.c_str());
+	// Compute barycentric coords, exit on out-of-range
+	const float Alpha = (u0 * v2 - v0 * u2) * Denominator;
+	if (!(Alpha >= 0.0f))
+		return false;
 
-			const Vector3f Vertex(X, Y, Z);
-			UpdateBounds(MinBounds, MaxBounds, Vertex);
+	const float Beta = (u1 * v0 - v1 * u0) * Denominator;
+	if (!(Beta >= 0.0f))
+		return false;
 
-			Vertices.push_back(Vertex);
-			
-		}
-		// line contains a face
-		else if (FileLine[0] == 'f' && FileLine[1] == ' ')
-		{
-			FileLine = FileLine.substr(2);
+	if (!(1.f - Alpha - Beta >= 0.0f))
+		return false;
 
-			Vector3f FaceVerts[3];
+	tOut = t;
+	AlphaOut = Alpha;
+	BetaOut = Beta;
+	return true;
+}
 
-			bool HasUVs = false;
-			Vector2f FaceUVs[3];
+uint32_t FMesh::IsIntersectingTrianglePacket(const uint32_t Triangle, const FRayPacket& Packet, const uint32_t ActiveMask, float* tOut, float* AlphaOut, float* BetaOut) const
+{
+	// same steps as IsIntersectingTriangle, with four rays in the lanes of each register
+	const Vector3f& Normal = mData->Normals[Triangle];
+	const Vector3f& V0 = mData->Vertices[mData->VertexIndices[3 * Triangle]];
+	const Vector3f& Edge1 = mData->Edges1[Triangle];
+	const Vector3f& Edge2 = mData->Edges2[Triangle];
 
-			// get attributes for each vertex
-			for (int i = 0; i < 3; i++)
-			{
-				std::string DataString = FileLine.substr(0, FileLine.find(' '));
-				std::string VertexString = DataString.substr(0, DataString.find('/'));
-				FaceVerts[i] = Vertices[atoi(VertexString.c_str()) - 1];
+	// the projection plane and denominator only depend on the triangle
+	uint32_t UAxis, VAxis;
+	if (std::abs(Normal.x) > std::abs(Normal.y))
+	{
+		UAxis = (std::abs(Normal.x) > std::abs(Normal.z)) ? 1 : 0;
+		VAxis = (std::abs(Normal.x) > std::abs(Normal.z)) ? 2 : 1;
+	}
+	else
+	{
+		UAxis = 0;
+		VAxis = (std::abs(Normal.y) > std::abs(Normal.z)) ? 2 : 1;
+	}
 
-				if (HasUVs || VertexString.length() != DataString.length())
-				{
-					HasUVs = true;
-					std::string UVString = DataString.substr(VertexString.length() + 1);
-					UVString = UVString.substr(0, UVString.find('/'));
-					FaceUVs[i] = UVs[atoi(UVString.c_str()) - 1];
-				}
+	const float u1 = Edge1[UAxis], u2 = Edge2[UAxis];
+	const float v1 = Edge1[VAxis], v2 = Edge2[VAxis];
 
-				if (i < 2)
-					FileLine = FileLine.substr(DataString.length() + 1);
-			}
-			
-			// .obj vertex order is clockwise, we use counterclockwise
-			std::unique_ptr<FTriangle> Triangle(new FTriangle(FaceVerts[2], FaceVerts[1], FaceVerts[0], mMaterial));
-			Triangle->SetParent(*this);
+	float Denominator = u1 * v2 - v1 * u2;
+	if (!(Denominator != 0.0f))
+		return 0;
+	Denominator = 1.f / Denominator;
 
-			if (HasUVs)
-				Triangle->SetUVCoordinates(FaceUVs[2], FaceUVs[1], FaceUVs[0]);
+	const VectorRegister Zero = VectorSetFloat1(0.0f);
+	const VectorRegister One = VectorSetFloat1(1.0f);
+	const VectorRegister NormalX = VectorSetFloat1(Normal.x), NormalY = VectorSetFloat1(Normal.y), NormalZ = VectorSetFloat1(Normal.z);
+	const VectorRegister NormalDotV0 = VectorSetFloat1(Vector3f::Dot(Normal, V0));
+	const VectorRegister V0U = VectorSetFloat1(V0[UAxis]), V0V = VectorSetFloat1(V0[VAxis]);
+	const VectorRegister U1 = VectorSetFloat1(u1), U2 = VectorSetFloat1(u2), V1 = VectorSetFloat1(v1), V2 = VectorSetFloat1(v2);
+	const VectorRegister InvDenominator = VectorSetFloat1(Denominator);
 
-			Triangles.push_back(std::move(Triangle));
-		}
-		// line contains a UV
-		else if (FileLine[0] == 'v' && FileLine[1] == 't' && FileLine[2] == ' ')
-		{
-			FileLine = FileLine.substr(3);
+	const float* Origins[3] = { Packet.OriginX, Packet.OriginY, Packet.OriginZ };
+	const float* Directions[3] = { Packet.DirectionX, Packet.DirectionY, Packet.DirectionZ };
 
-			const std::string UString = FileLine.substr(0, FileLine.find(' '));
-			const std::string VString = FileLine.substr(UString.length() + 1, FileLine.find(' '));
-			UVs.push_back(Vector2f((float)atof(UString.c_str()), (float)atof(VString.c_str())));
-		}
+	uint32_t HitMask = 0;
+	for (uint32_t First = 0; First < Packet.Size; First += FRayPacket::GroupSize)
+	{
+		if (!((ActiveMask >> First) & 0xF))
+			continue;
+
+		const VectorRegister DirectionX = VectorLoadAligned(&Packet.DirectionX[First]);
+		const VectorRegister DirectionY = VectorLoadAligned(&Packet.DirectionY[First]);
+		const VectorRegister DirectionZ = VectorLoadAligned(&Packet.DirectionZ[First]);
+		const VectorRegister tMax = VectorLoadAligned(&Packet.tMax[First]);
+
+		// Compute gradient, rays must point towards the triangle
+		const VectorRegister Gradient = VectorAdd(VectorAdd(VectorMultiply(NormalX, DirectionX), VectorMultiply(NormalY, DirectionY)), VectorMultiply(NormalZ, DirectionZ));
+		VectorRegister Mask = VectorCompareLT(Gradient, Zero);
+
+		// Compute parametric point of intersection with plane, rays must start in front of the plane and reach it within tMax
+		const VectorRegister NormalDotOrigin = VectorAdd(VectorAdd(VectorMultiply(NormalX, VectorLoadAligned(&Packet.OriginX[First])),
+			VectorMultiply(NormalY, VectorLoadAligned(&Packet.OriginY[First]))), VectorMultiply(NormalZ, VectorLoadAligned(&Packet.OriginZ[First])));
+		VectorRegister t = VectorSubtract(NormalDotV0, NormalDotOrigin);
+		Mask = VectorBitwiseAnd(Mask, VectorCompareLE(t, Zero));
+		Mask = VectorBitwiseAnd(Mask, VectorCompareGE(t, VectorMultiply(Gradient, tMax)));
+
+		t = VectorDivide(t, Gradient);
+		Mask = VectorBitwiseAnd(Mask, VectorCompareLE(t, tMax));
+		if (!VectorMaskBits(Mask))
+			continue;
+
+		// Offset of the intersection points from the first vertex on the projection plane
+		const VectorRegister u0 = VectorSubtract(VectorAdd(VectorLoadAligned(&Origins[UAxis][First]), VectorMultiply(VectorLoadAligned(&Directions[UAxis][First]), t)), V0U);
+		const VectorRegister v0 = VectorSubtract(VectorAdd(VectorLoadAligned(&Origins[VAxis][First]), VectorMultiply(VectorLoadAligned(&Directions[VAxis][First]), t)), V0V);
+
+		// Compute barycentric coords, rejecting out-of-range lanes
+		const VectorRegister Alpha = VectorMultiply(VectorSubtract(VectorMultiply(u0, V2), VectorMultiply(v0, U2)), InvDenominator);
+		Mask = VectorBitwiseAnd(Mask, VectorCompareGE(Alpha, Zero));
+
+		const VectorRegister Beta = VectorMultiply(VectorSubtract(VectorMultiply(U1, v0), VectorMultiply(V1, u0)), InvDenominator);
+		Mask = VectorBitwiseAnd(Mask, VectorCompareGE(Beta, Zero));
+		Mask = VectorBitwiseAnd(Mask, VectorCompareGE(VectorSubtract(VectorSubtract(One, Alpha), Beta), Zero));
+
+		VectorStoreAligned(t, &tOut[First]);
+		VectorStoreAligned(Alpha, &AlphaOut[First]);
+		VectorStoreAligned(Beta, &BetaOut[First]);
+		HitMask |= VectorMaskBits(Mask) << First;
 	}
 
-	ModelFile.close();
+	return HitMask & ActiveMask;
+}
 
-	ConstructAABB(MinBounds, MaxBounds);
+void FMesh::BindBuffers()
+{
+	FMeshData& Data = *mData;
+	const FMeshBuffers& Buffers = Data.Buffers;
+
+	Data.BVHNodes = Buffers.BVHNodes.data();
+	Data.Vertices = Buffers.Vertices.data();
+	Data.UVs = Buffers.UVs.data();
+	Data.VertexNormals = Buffers.VertexNormals.data();
+	Data.VertexIndices = Buffers.VertexIndices.data();
+	Data.UVIndices = Buffers.UVIndices.data();
+	Data.NormalIndices = Buffers.NormalIndices.data();
+	Data.Edges1 = Buffers.Edges1.data();
+	Data.Edges2 = Buffers.Edges2.data();
+	Data.Normals = Buffers.Normals.data();
+
+	Data.NumBVHNodes = (uint32_t)Buffers.BVHNodes.size();
+	Data.NumVertices = (uint32_t)Buffers.Vertices.size();
+	Data.NumUVs = (uint32_t)Buffers.UVs.size();
+	Data.NumVertexNormals = (uint32_t)Buffers.VertexNormals.size();
+	Data.NumTriangles = (uint32_t)Buffers.Normals.size();
+}
+
+bool FMesh::ReadCache(const std::string& CacheFilepath, const uint64_t SourceHash, const uint32_t MaxLeafTriangles)
+{
+	FMeshData& Data = *mData;
+	if (!Data.CacheFile.Open(CacheFilepath) || Data.CacheFile.GetSize() < sizeof(FMeshCacheHeader))
+		return false;
+
+	// only the header is read, the arrays are paged in as rays touch them
+	FMeshCacheHeader Header;
+	std::memcpy(&Header, Data.CacheFile.GetData(), sizeof(FMeshCacheHeader));
+
+	uint64_t Offsets[MeshCacheArrays], Sizes[MeshCacheArrays];
+	const uint64_t FileSize = GetMeshCacheLayout(Header, Offsets, Sizes);
+
+	if (std::memcmp(Header.Magic, MeshCacheMagic, sizeof(MeshCacheMagic)) != 0 || Header.Version != MeshCacheVersion ||
+		Header.NodeSize != sizeof(FLinearBVHNode) || Header.SourceHash != SourceHash || Header.MaxLeafTriangles != MaxLeafTriangles ||
+		Header.BinCount != BVHBinCount || Header.TraversalCost != BVHTraversalCost || FileSize != Data.CacheFile.GetSize())
+	{
+		Data.CacheFile.Close();
+		return false;
+	}
+
+	const char* const File = Data.CacheFile.GetData();
+	Data.BVHNodes = (const FLinearBVHNode*)(File + Offsets[0]);
+	Data.Vertices = (const Vector3f*)(File + Offsets[1]);
+	Data.UVs = (const Vector2f*)(File + Offsets[2]);
+	Data.VertexNormals = (const Vector3f*)(File + Offsets[3]);
+	Data.VertexIndices = (const uint32_t*)(File + Offsets[4]);
+	Data.UVIndices = (const uint32_t*)(File + Offsets[5]);
+	Data.NormalIndices = (const uint32_t*)(File + Offsets[6]);
+	Data.Edges1 = (const Vector3f*)(File + Offsets[7]);
+	Data.Edges2 = (const Vector3f*)(File + Offsets[8]);
+	Data.Normals = (const Vector3f*)(File + Offsets[9]);
+
+	Data.NumBVHNodes = Header.NumBVHNodes;
+	Data.NumVertices = Header.NumVertices;
+	Data.NumUVs = Header.NumUVs;
+	Data.NumVertexNormals = Header.NumVertexNormals;
+	Data.NumTriangles = Header.NumTriangles;
+	Data.BVHCost = Header.BVHCost;
+
+	ConstructAABB(Vector3f(Header.BoundsMin[0], Header.BoundsMin[1], Header.BoundsMin[2]),
+		Vector3f(Header.BoundsMax[0], Header.BoundsMax[1], Header.BoundsMax[2]));
+	return true;
+}
+
+void FMesh::WriteCache(const std::string& CacheFilepath, const uint64_t SourceHash, const uint32_t MaxLeafTriangles) const
+{
+	const FMeshData& Data = *mData;
+	const AABB& Bounds = GetBoundingBox();
+
+	FMeshCacheHeader Header;
+	std::memset(&Header, 0, sizeof(FMeshCacheHeader));
+	std::memcpy(Header.Magic, MeshCacheMagic, sizeof(MeshCacheMagic));
+	Header.Version = MeshCacheVersion;
+	Header.NodeSize = sizeof(FLinearBVHNode);
+	Header.SourceHash = SourceHash;
+	Header.MaxLeafTriangles = MaxLeafTriangles;
+	Header.BinCount = BVHBinCount;
+	Header.TraversalCost = BVHTraversalCost;
+	Header.NumBVHNodes = Data.NumBVHNodes;
+	Header.NumVertices = Data.NumVertices;
+	Header.NumUVs = Data.NumUVs;
+	Header.NumVertexNormals = Data.NumVertexNormals;
+	Header.NumTriangles = Data.NumTriangles;
+	Header.BVHCost = Data.BVHCost;
+	for (int Axis = 0; Axis < 3; Axis++)
+	{
+		Header.BoundsMin[Axis] = Bounds.Min[Axis];
+		Header.BoundsMax[Axis] = Bounds.Max[Axis];
+	}
+
+	uint64_t Offsets[MeshCacheArrays], Sizes[MeshCacheArrays];
+	GetMeshCacheLayout(Header, Offsets, Sizes);
+
+	const char* const Arrays[MeshCacheArrays] =
+	{
+		(const char*)Data.BVHNodes, (const char*)Data.Vertices, (const char*)Data.UVs, (const char*)Data.VertexNormals,
+		(const char*)Data.VertexIndices, (const char*)Data.UVIndices, (const char*)Data.NormalIndices,
+		(const char*)Data.Edges1, (const char*)Data.Edges2, (const char*)Data.Normals
+	};
+
+	// write a temporary file first, so a render that starts meanwhile never maps a partial cache. Each
+	// process has its own, renders that cache the same model at the same time would otherwise mix their writes
+	const std::string TempFilepath = CacheFilepath + "." + std::to_string(GetProcessNumber()) + ".tmp";
+	std::ofstream CacheFile(TempFilepath.c_str(), std::ios::binary | std::ios::trunc);
+	if (!CacheFile)
+	{
+		std::cout << "Failed to write mesh cache: " << CacheFilepath << std::endl;
+		return;
+	}
+
+	const char Padding[MeshCacheAlignment] = { 0 };
+	CacheFile.write((const char*)&Header, sizeof(FMeshCacheHeader));
+	uint64_t Position = sizeof(FMeshCacheHeader);
+	for (uint32_t i = 0; i < MeshCacheArrays; i++)
+	{
+		CacheFile.write(Padding, Offsets[i] - Position);
+		if (Sizes[i] > 0)
+			CacheFile.write(Arrays[i], Sizes[i]);
+		Position = Offsets[i] + Sizes[i];
+	}
+
+	CacheFile.close();
+	if (!CacheFile)
+	{
+		std::remove(TempFilepath.c_str());
+		std::cout << "Failed to write mesh cache: " << CacheFilepath << std::endl;
+		return;
+	}
 
-	// setup root of BVH
-	mBVHRoot.BoundingVolume = GetBoundingBox();
-	mBVHRoot.Objects = std::move(Triangles);
+	// rename doesn't replace an existing file on every platform
+	if (std::rename(TempFilepath.c_str(), CacheFilepath.c_str()) != 0)
+	{
+		std::remove(CacheFilepath.c_str());
+		if (std::rename(TempFilepath.c_str(), CacheFilepath.c_str()) != 0)
+		{
+			std::remove(TempFilepath.c_str());
+			std::cout << "Failed to write mesh cache: " << CacheFilepath << std::endl;
+		}
+	}
 }
 
-void FMesh::ConstructBVH(FBVHNode& Node, const uint8_t Depth)
+void FMesh::ConstructBVH(const uint32_t MaxLeafTriangles)
 {
-	if (Depth <= 0 || Node.Objects.size() <= _BVH_MIN_OBJECTS)
+	const uint32_t NumTriangles = (uint32_t)mData->Buffers.Normals.size();
+	if (NumTriangles == 0)
 		return;
 
-	// the split axis will be the axis which the current AABB extends the most
-	uint8_t SplitAxis = 0;
-	const Vector3f& CurrentDeminsions(Node.BoundingVolume.GetDeminsions());
-	for (uint8_t i = 1; i < 3; i++)
+	std::vector<FBuildTriangle> Triangles(NumTriangles);
+	for (uint32_t i = 0; i < NumTriangles; i++)
 	{
-		if (CurrentDeminsions[i] > CurrentDeminsions[SplitAxis])
-			SplitAxis = i;
+		const Vector3f& V0 = mData->Buffers.Vertices[mData->Buffers.VertexIndices[3 * i]];
+		const Vector3f& V1 = mData->Buffers.Vertices[mData->Buffers.VertexIndices[3 * i + 1]];
+		const Vector3f& V2 = mData->Buffers.Vertices[mData->Buffers.VertexIndices[3 * i + 2]];
+
+		Triangles[i].Bounds = AABB(V0, V0);
+		UpdateBounds(Triangles[i].Bounds.Min, Triangles[i].Bounds.Max, V1);
+		UpdateBounds(Triangles[i].Bounds.Min, Triangles[i].Bounds.Max, V2);
+		Triangles[i].Center = Triangles[i].Bounds.GetCenter();
+		Triangles[i].Index = i;
 	}
 
-	// sort objects in respect to the split axis
-	std::sort(Node.Objects.begin(), Node.Objects.end(), [&SplitAxis](const std::unique_ptr<FTriangle>& Lhs, const std::unique_ptr<FTriangle>& Rhs)
+	// leaf sizes must fit in a node
+	const uint32_t LeafSize = std::min(std::max(MaxLeafTriangles, 1u), (uint32_t)std::numeric_limits<uint16_t>::max());
+	const float WeightedCost = ConstructBVHNode(Triangles, 0, NumTriangles, 0, LeafSize);
+	const float RootArea = mData->Buffers.BVHNodes[0].Bounds.GetSurfaceArea();
+	mData->BVHCost = (RootArea > 0.0f) ? WeightedCost / RootArea : (float)NumTriangles;
+
+	// store the triangle data in leaf order so each leaf reads a contiguous range
+	std::vector<uint32_t> Order(NumTriangles);
+	for (uint32_t i = 0; i < NumTriangles; i++)
+		Order[i] = Triangles[i].Index;
+
+	ReorderTriangleData(mData->Buffers.VertexIndices, Order, 3);
+	ReorderTriangleData(mData->Buffers.UVIndices, Order, 3);
+	ReorderTriangleData(mData->Buffers.NormalIndices, Order, 3);
+	ReorderTriangleData(mData->Buffers.Edges1, Order, 1);
+	ReorderTriangleData(mData->Buffers.Edges2, Order, 1);
+	ReorderTriangleData(mData->Buffers.Normals, Order, 1);
+}
+
+float FMesh::ConstructBVHNode(std::vector<FBuildTriangle>& Triangles, const uint32_t Begin, const uint32_t End, const uint32_t Depth, const uint32_t MaxLeafTriangles)
+{
+	const uint32_t NodeIndex = (uint32_t)mData->Buffers.BVHNodes.size();
+	mData->Buffers.BVHNodes.push_back(FLinearBVHNode());
+	mData->Buffers.BVHNodes[NodeIndex].Bounds = ConstructBoundingVolume(Triangles, Begin, End);
+
+	const auto TrianglesBegin = Triangles.begin() + Begin;
+	const auto TrianglesEnd = Triangles.begin() + End;
+	const uint32_t NumObjects = End - Begin;
+	const float NodeArea = mData->Buffers.BVHNodes[NodeIndex].Bounds.GetSurfaceArea();
+	const float LeafCost = NodeArea * NumObjects;
+
+	auto MakeLeaf = [this, NodeIndex, Begin, NumObjects, MaxLeafTriangles]()
 	{
-		return Lhs->GetBoundingBox().GetCenter()[SplitAxis] < Rhs->GetBoundingBox().GetCenter()[SplitAxis];
-	});
-	
-	// split at the median object
-	const uint32_t SplitIndex = Node.Objects.size() / 2;
+		assert(NumObjects <= MaxLeafTriangles || NumObjects <= 1);
+		mData->Buffers.BVHNodes[NodeIndex].FirstTriangle = Begin;
+		mData->Buffers.BVHNodes[NodeIndex].NumTriangles = (uint16_t)NumObjects;
+	};
 
-	// construct children and divide objects amoung them
-	Node.Child[0] = std::unique_ptr<FBVHNode>(new FBVHNode());
-	Node.Child[1] = std::unique_ptr<FBVHNode>(new FBVHNode());
+	// the traversal stack holds one node per level
+	if (NumObjects <= 1 || Depth + 1 >= BVHMaxDepth)
+	{
+		MakeLeaf();
+		return LeafCost;
+	}
 
-	for (size_t i = 0; i < SplitIndex; i++)
+	// halving the triangles must still reach the leaf size before the depth limit, so nodes that are
+	// running out of levels are split at the median of their longest axis instead of by cost
+	uint32_t LevelsToLeafSize = 0;
+	for (uint32_t Count = NumObjects; Count > MaxLeafTriangles; Count = (Count + 1) / 2)
+		LevelsToLeafSize++;
+
+	if (Depth + 1 + LevelsToLeafSize >= BVHMaxDepth)
 	{
-		Node.Child[0]->Objects.push_back(std::move(Node.Objects[i]));
+		const Vector3f Extent = mData->Buffers.BVHNodes[NodeIndex].Bounds.Max - mData->Buffers.BVHNodes[NodeIndex].Bounds.Min;
+		const uint32_t Axis = (Extent.x >= Extent.y && Extent.x >= Extent.z) ? 0 : (Extent.y >= Extent.z ? 1 : 2);
+		const uint32_t Median = Begin + NumObjects / 2;
+		std::nth_element(TrianglesBegin, Triangles.begin() + Median, TrianglesEnd, [Axis](const FBuildTriangle& A, const FBuildTriangle& B)
+		{
+			return A.Center[Axis] < B.Center[Axis];
+		});
+
+		mData->Buffers.BVHNodes[NodeIndex].Axis = (uint8_t)Axis;
+		mData->Buffers.BVHNodes[NodeIndex].NumTriangles = 0;
+		const float FirstCost = ConstructBVHNode(Triangles, Begin, Median, Depth + 1, MaxLeafTriangles);
+		mData->Buffers.BVHNodes[NodeIndex].SecondChild = (uint32_t)mData->Buffers.BVHNodes.size();
+		return BVHTraversalCost * NodeArea + FirstCost + ConstructBVHNode(Triangles, Median, End, Depth + 1, MaxLeafTriangles);
 	}
 
-	for (size_t i = SplitIndex; i < Node.Objects.size(); i++)
+	// splits are chosen by triangle centers, find the range they cover
+	Vector3f CenterMin(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+	Vector3f CenterMax(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest());
+	for (auto Triangle = TrianglesBegin; Triangle != TrianglesEnd; ++Triangle)
 	{
-		Node.Child[1]->Objects.push_back(std::move(Node.Objects[i]));
+		UpdateBounds(CenterMin, CenterMax, Triangle->Center);
 	}
 
-	Node.Objects.clear();
-	Node.Objects.resize(0);
+	const Vector3f CenterExtent = CenterMax - CenterMin;
+	auto GetBin = [&CenterMin, &CenterExtent](const FBuildTriangle& Triangle, const uint32_t Axis) -> uint32_t
+	{
+		const float Offset = (Triangle.Center[Axis] - CenterMin[Axis]) / CenterExtent[Axis];
+		return std::min((uint32_t)(Offset * BVHBinCount), BVHBinCount - 1);
+	};
 
-	// Construct bounding box for each child
-	ConstructBoundingVolume(*Node.Child[0]);
-	ConstructBoundingVolume(*Node.Child[1]);
+	// area weighted SAH cost of the best split, relative to a triangle intersection test
+	float BestCost = std::numeric_limits<float>::max();
+	uint32_t BestAxis = 0;
+	uint32_t BestBin = 0;
 
-	ConstructBVH(*Node.Child[0], Depth - 1);
-	ConstructBVH(*Node.Child[1], Depth - 1);
+	for (uint32_t Axis = 0; Axis < 3; Axis++)
+	{
+		if (CenterExtent[Axis] <= 0.0f)
+			continue;
+
+		// gather the triangle count and bounds of each bin
+		uint32_t BinCounts[BVHBinCount] = { 0 };
+		AABB BinBounds[BVHBinCount];
+		for (auto Triangle = TrianglesBegin; Triangle != TrianglesEnd; ++Triangle)
+		{
+			const uint32_t Bin = GetBin(*Triangle, Axis);
+			if (BinCounts[Bin]++ == 0)
+				BinBounds[Bin] = Triangle->Bounds;
+			else
+				BinBounds[Bin].Expand(Triangle->Bounds);
+		}
+
+		// sweep from the right to find the area and count above each bin boundary
+		float AboveAreas[BVHBinCount];
+		uint32_t AboveCounts[BVHBinCount];
+		AABB Bounds;
+		uint32_t Count = 0;
+		for (uint32_t Bin = BVHBinCount - 1; Bin > 0; Bin--)
+		{
+			if (BinCounts[Bin] > 0)
+			{
+				if (Count == 0)
+					Bounds = BinBounds[Bin];
+				else
+					Bounds.Expand(BinBounds[Bin]);
+				Count += BinCounts[Bin];
+			}
+			AboveAreas[Bin] = (Count > 0) ? Bounds.GetSurfaceArea() : 0.0f;
+			AboveCounts[Bin] = Count;
+		}
+
+		// sweep from the left and evaluate each boundary
+		Count = 0;
+		for (uint32_t Bin = 0; Bin < BVHBinCount - 1; Bin++)
+		{
+			if (BinCounts[Bin] > 0)
+			{
+				if (Count == 0)
+					Bounds = BinBounds[Bin];
+				else
+					Bounds.Expand(BinBounds[Bin]);
+				Count += BinCounts[Bin];
+			}
+
+			if (Count == 0 || AboveCounts[Bin + 1] == 0)
+				continue;
+
+			const float Cost = BVHTraversalCost * NodeArea + Bounds.GetSurfaceArea() * Count + AboveAreas[Bin + 1] * AboveCounts[Bin + 1];
+			if (Cost < BestCost)
+			{
+				BestCost = Cost;
+				BestAxis = Axis;
+				BestBin = Bin;
+			}
+		}
+	}
+
+	// small nodes are only split when it is cheaper than testing all of their triangles
+	if (NumObjects <= MaxLeafTriangles && LeafCost <= BestCost)
+	{
+		MakeLeaf();
+		return LeafCost;
+	}
+
+	// if all triangle centers are the same point, divide them evenly to respect the leaf size
+	uint32_t Split = Begin + NumObjects / 2;
+	if (BestCost < std::numeric_limits<float>::max())
+	{
+		const auto SplitPoint = std::partition(TrianglesBegin, TrianglesEnd, [&GetBin, BestAxis, BestBin](const FBuildTriangle& Triangle)
+		{
+			return GetBin(Triangle, BestAxis) <= BestBin;
+		});
+		Split = (uint32_t)(SplitPoint - Triangles.begin());
+	}
+
+	mData->Buffers.BVHNodes[NodeIndex].Axis = (uint8_t)BestAxis;
+	mData->Buffers.BVHNodes[NodeIndex].NumTriangles = 0;
+
+	// the first child directly follows its parent
+	const float ChildCost = ConstructBVHNode(Triangles, Begin, Split, Depth + 1, MaxLeafTriangles);
+	mData->Buffers.BVHNodes[NodeIndex].SecondChild = (uint32_t)mData->Buffers.BVHNodes.size();
+
+	return BVHTraversalCost * NodeArea + ChildCost + ConstructBVHNode(Triangles, Split, End, Depth + 1, MaxLeafTriangles);
 }
 
-void FMesh::ConstructBoundingVolume(FBVHNode& Node)
+AABB FMesh::ConstructBoundingVolume(const std::vector<FBuildTriangle>& Triangles, const uint32_t Begin, const uint32_t End)
 {
 	Vector3f Min(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
-	Vector3f Max(std::numeric_limits<float>::min(), std::numeric_limits<float>::min(), std::numeric_limits<float>::min());
+	Vector3f Max(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest());
 
-	for (const auto& Triangle : Node.Objects)
+	for (uint32_t i = Begin; i < End; i++)
 	{
-		const AABB& CurrentAABB = Triangle->GetBoundingBox();
+		const AABB& CurrentAABB = Triangles[i].Bounds;
 		UpdateBounds(Min, Max, CurrentAABB.Min);
 		UpdateBounds(Min, Max, CurrentAABB.Max);
 	}
 
-	Node.BoundingVolume.Min = Min;
-	Node.BoundingVolume.Max = Max;
+	return AABB(Min, Max);
+}
+
+FMesh::FMesh(const FMesh& Source, const FMaterial& Material)
+	: IDrawable(Material)
+	, mData(Source.mData)
+{
+	SetBoundingBox(Source.GetBoundingBox());
 }
 
 FMesh::~FMesh()
 {
 }
+
+size_t FMesh::GetNumTriangles() const
+{
+	return mData->NumTriangles;
+}
+
+float FMesh::GetBVHCost() const
+{
+	return mData->BVHCost;
+}
+
+long FMesh::GetNumInstances() const
+{
+	return mData.use_count();
+}
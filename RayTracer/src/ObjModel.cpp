@@ -0,0 +1,449 @@
+#include "ObjModel.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <thread>
+
+/* Smallest part of a file worth giving to its own thread */
+static const size_t MinChunkBytes = 1 << 20;
+/* Longest number that is copied out for strtod when it can't be computed exactly */
+static const size_t MaxNumberLength = 64;
+/* Most significant digits of a number that are always exact in a double */
+static const int32_t MaxExactDigits = 15;
+
+/* Powers of ten that are exact in a double */
+static const double PowersOf10[] =
+{
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+static const int32_t MaxExactPower = 22;
+
+/**
+* Geometry read from one chunk of a file. Positive indices are already global. Negative indices
+* can't be resolved until the number of elements in the earlier chunks is known, so they are
+* stored relative to the chunk's first element and their positions are listed.
+*/
+struct FObjChunk
+{
+	std::vector<Vector3f> Vertices;
+	std::vector<Vector2f> UVs;
+	std::vector<Vector3f> Normals;
+	std::vector<uint32_t> VertexIndices;
+	std::vector<uint32_t> UVIndices;
+	std::vector<uint32_t> NormalIndices;
+
+	/* Positions of the relative entries in the index arrays */
+	std::vector<uint32_t> RelativeVertexCorners;
+	std::vector<uint32_t> RelativeUVCorners;
+	std::vector<uint32_t> RelativeNormalCorners;
+
+	uint32_t NumSkippedTriangles{ 0 };
+};
+
+/**
+* Indices of one corner of a face, for positions, texture coordinates and normals.
+*/
+struct FObjCorner
+{
+	uint32_t Index[3]; /* Index of each attribute */
+	bool HasIndex[3]; /* True if the attribute is given, a relative index can take any value including NoIndex */
+	bool IsRelative[3]; /* True if the index is relative to the chunk */
+};
+
+static inline bool IsDigit(const char Character)
+{
+	return (unsigned)(Character - '0') < 10u;
+}
+
+static inline bool IsSpace(const char Character)
+{
+	return Character == ' ' || Character == '\t' || Character == '\r';
+}
+
+static inline const char* SkipSpaces(const char* Cursor, const char* End)
+{
+	while (Cursor < End && IsSpace(*Cursor))
+		++Cursor;
+	return Cursor;
+}
+
+/**
+* Reads a number with strtod from a copy of the token, for numbers with too many digits
+* or too large an exponent to compute exactly, and for inf and nan.
+* @return The end of the number, or nullptr if the token isn't a number.
+*/
+static const char* ParseFloatSlow(const char* Cursor, const char* End, float& ValueOut)
+{
+	char Buffer[MaxNumberLength + 1];
+	size_t Length = 0;
+	while (Cursor + Length < End && Length < MaxNumberLength && !IsSpace(Cursor[Length]))
+	{
+		Buffer[Length] = Cursor[Length];
+		Length++;
+	}
+	Buffer[Length] = '\0';
+
+	char* NumberEnd;
+	const double Value = std::strtod(Buffer, &NumberEnd);
+	if (NumberEnd == Buffer)
+		return nullptr;
+
+	ValueOut = (float)Value;
+	return Cursor + (NumberEnd - Buffer);
+}
+
+/**
+* Reads a decimal number in place. The digits are gathered into an integer, and when it and the
+* power of ten are both exact in a double a single multiply or divide gives the correctly rounded
+* value, the same value strtod would give. Other numbers fall back to strtod.
+* @return The end of the number, or nullptr if the token isn't a number.
+*/
+static const char* ParseFloat(const char* Cursor, const char* End, float& ValueOut)
+{
+	const char* const Start = Cursor;
+	const bool IsNegative = (Cursor < End && *Cursor == '-');
+	if (Cursor < End && (*Cursor == '-' || *Cursor == '+'))
+		++Cursor;
+
+	uint64_t Mantissa = 0;
+	int32_t NumDigits = 0;
+	int32_t Exponent = 0;
+	bool HasDigits = false;
+
+	// leading zeros are not significant, only the first MaxExactDigits digits need to be kept
+	for (; Cursor < End && IsDigit(*Cursor); ++Cursor)
+	{
+		HasDigits = true;
+		if (Mantissa == 0 && *Cursor == '0')
+			continue;
+		if (++NumDigits <= MaxExactDigits)
+			Mantissa = Mantissa * 10 + (*Cursor - '0');
+	}
+
+	if (Cursor < End && *Cursor == '.')
+	{
+		for (++Cursor; Cursor < End && IsDigit(*Cursor); ++Cursor)
+		{
+			HasDigits = true;
+			Exponent--;
+			if (Mantissa == 0 && *Cursor == '0')
+				continue;
+			if (++NumDigits <= MaxExactDigits)
+				Mantissa = Mantissa * 10 + (*Cursor - '0');
+		}
+	}
+
+	if (!HasDigits)
+		return ParseFloatSlow(Start, End, ValueOut);
+
+	// an exponent needs at least one digit, otherwise the number ends before the 'e'
+	if (Cursor < End && (*Cursor == 'e' || *Cursor == 'E'))
+	{
+		const char* ExponentCursor = Cursor + 1;
+		const bool IsExponentNegative = (ExponentCursor < End && *ExponentCursor == '-');
+		if (ExponentCursor < End && (*ExponentCursor == '-' || *ExponentCursor == '+'))
+			++ExponentCursor;
+
+		if (ExponentCursor < End && IsDigit(*ExponentCursor))
+		{
+			int32_t ExplicitExponent = 0;
+			for (; ExponentCursor < End && IsDigit(*ExponentCursor); ++ExponentCursor)
+			{
+				if (ExplicitExponent < 100000)
+					ExplicitExponent = ExplicitExponent * 10 + (*ExponentCursor - '0');
+			}
+			Exponent += IsExponentNegative ? -ExplicitExponent : ExplicitExponent;
+			Cursor = ExponentCursor;
+		}
+	}
+
+	if (NumDigits > MaxExactDigits || Exponent < -MaxExactPower || Exponent > MaxExactPower)
+		return ParseFloatSlow(Start, End, ValueOut);
+
+	double Value = (double)Mantissa;
+	Value = (Exponent < 0) ? Value / PowersOf10[-Exponent] : Value * PowersOf10[Exponent];
+	ValueOut = (float)(IsNegative ? -Value : Value);
+	return Cursor;
+}
+
+/**
+* Reads a signed integer in place.
+* @return The end of the integer, or nullptr if there is no integer.
+*/
+static const char* ParseIndex(const char* Cursor, const char* End, int64_t& ValueOut)
+{
+	const bool IsNegative = (Cursor < End && *Cursor == '-');
+	if (Cursor < End && (*Cursor == '-' || *Cursor == '+'))
+		++Cursor;
+
+	if (Cursor == End || !IsDigit(*Cursor))
+		return nullptr;
+
+	int64_t Value = 0;
+	for (; Cursor < End && IsDigit(*Cursor); ++Cursor)
+	{
+		if (Value < ((int64_t)1 << 40))
+			Value = Value * 10 + (*Cursor - '0');
+	}
+
+	ValueOut = IsNegative ? -Value : Value;
+	return Cursor;
+}
+
+/**
+* Reads a number of floats separated by spaces.
+* @return False if the line has fewer numbers.
+*/
+static bool ParseFloats(const char* Cursor, const char* End, float* ValuesOut, const uint32_t NumValues)
+{
+	for (uint32_t i = 0; i < NumValues; i++)
+	{
+		Cursor = SkipSpaces(Cursor, End);
+		Cursor = (Cursor < End) ? ParseFloat(Cursor, End, ValuesOut[i]) : nullptr;
+		if (!Cursor)
+			return false;
+	}
+
+	return true;
+}
+
+/**
+* Resolves an index of a face corner.
+* @param Index - Index from the file, counting from 1, or back from the last element when negative
+* @param NumElements - Number of elements read so far in the chunk
+* @param Attribute - Attribute of the corner to set
+* @return False if the index is 0 or too large.
+*/
+static bool SetCornerIndex(const int64_t Index, const size_t NumElements, const uint32_t Attribute, FObjCorner& CornerOut)
+{
+	if (Index == 0 || Index > (int64_t)FObjModel::NoIndex - 1)
+		return false;
+
+	// a relative index that reaches into an earlier chunk is negative until the chunk's first element is added
+	CornerOut.HasIndex[Attribute] = true;
+	CornerOut.IsRelative[Attribute] = (Index < 0);
+	CornerOut.Index[Attribute] = (Index > 0) ? (uint32_t)(Index - 1) : (uint32_t)((int64_t)NumElements + Index);
+	return true;
+}
+
+/**
+* Reads the corners of a face.
+* @return False if a corner is not valid.
+*/
+static bool ParseFace(const char* Cursor, const char* End, const FObjChunk& Chunk, std::vector<FObjCorner>& CornersOut)
+{
+	const size_t NumElements[3] = { Chunk.Vertices.size(), Chunk.UVs.size(), Chunk.Normals.size() };
+
+	CornersOut.clear();
+	while ((Cursor = SkipSpaces(Cursor, End)) < End)
+	{
+		FObjCorner Corner = { { FObjModel::NoIndex, FObjModel::NoIndex, FObjModel::NoIndex }, { false, false, false }, { false, false, false } };
+
+		// v, v/vt, v//vn or v/vt/vn
+		for (uint32_t Attribute = 0; Attribute < 3; Attribute++)
+		{
+			if (Attribute > 0)
+			{
+				if (Cursor == End || *Cursor != '/')
+					break;
+				++Cursor;
+				if (Attribute == 1 && Cursor < End && *Cursor == '/')
+					continue;
+			}
+
+			int64_t Index;
+			Cursor = ParseIndex(Cursor, End, Index);
+			if (!Cursor || !SetCornerIndex(Index, NumElements[Attribute], Attribute, Corner))
+				return false;
+		}
+
+		if (Cursor < End && !IsSpace(*Cursor))
+			return false;
+
+		CornersOut.push_back(Corner);
+	}
+
+	return CornersOut.size() >= 3;
+}
+
+/**
+* Adds one attribute of a triangle's corners to a chunk. The attribute is only kept if every corner has it.
+*/
+static void AddTriangleAttribute(const FObjCorner* const Corners[3], const uint32_t Attribute, std::vector<uint32_t>& IndicesOut, std::vector<uint32_t>& RelativeCornersOut)
+{
+	const bool HasAttribute = Corners[0]->HasIndex[Attribute] && Corners[1]->HasIndex[Attribute] && Corners[2]->HasIndex[Attribute];
+
+	for (int i = 0; i < 3; i++)
+	{
+		if (HasAttribute && Corners[i]->IsRelative[Attribute])
+			RelativeCornersOut.push_back((uint32_t)IndicesOut.size());
+		IndicesOut.push_back(HasAttribute ? Corners[i]->Index[Attribute] : (uint32_t)FObjModel::NoIndex);
+	}
+}
+
+/**
+* Parses the lines of one chunk of a file.
+*/
+static void ParseChunk(const char* Cursor, const char* const End, FObjChunk& Chunk)
+{
+	std::vector<FObjCorner> Corners;
+
+	while (Cursor < End)
+	{
+		const char* LineEnd = (const char*)std::memchr(Cursor, '\n', End - Cursor);
+		if (!LineEnd)
+			LineEnd = End;
+
+		const char* Line = SkipSpaces(Cursor, LineEnd);
+		Cursor = LineEnd + 1;
+
+		// every element is a keyword followed by a space
+		if (LineEnd - Line < 2)
+			continue;
+
+		float Values[3];
+		if (Line[0] == 'v' && IsSpace(Line[1]))
+		{
+			if (ParseFloats(Line + 2, LineEnd, Values, 3))
+				Chunk.Vertices.push_back(Vector3f(Values[0], Values[1], Values[2]));
+		}
+		else if (Line[0] == 'v' && Line[1] == 't' && LineEnd - Line > 2 && IsSpace(Line[2]))
+		{
+			if (ParseFloats(Line + 3, LineEnd, Values, 2))
+				Chunk.UVs.push_back(Vector2f(Values[0], Values[1]));
+		}
+		else if (Line[0] == 'v' && Line[1] == 'n' && LineEnd - Line > 2 && IsSpace(Line[2]))
+		{
+			if (ParseFloats(Line + 3, LineEnd, Values, 3))
+				Chunk.Normals.push_back(Vector3f(Values[0], Values[1], Values[2]));
+		}
+		else if (Line[0] == 'f' && IsSpace(Line[1]))
+		{
+			if (!ParseFace(Line + 2, LineEnd, Chunk, Corners))
+			{
+				Chunk.NumSkippedTriangles += (Corners.size() >= 3) ? (uint32_t)Corners.size() - 2 : 1;
+				continue;
+			}
+
+			// fan of triangles around the first corner
+			for (size_t i = 1; i + 1 < Corners.size(); i++)
+			{
+				const FObjCorner* const Triangle[3] = { &Corners[0], &Corners[i], &Corners[i + 1] };
+				AddTriangleAttribute(Triangle, 0, Chunk.VertexIndices, Chunk.RelativeVertexCorners);
+				AddTriangleAttribute(Triangle, 1, Chunk.UVIndices, Chunk.RelativeUVCorners);
+				AddTriangleAttribute(Triangle, 2, Chunk.NormalIndices, Chunk.RelativeNormalCorners);
+			}
+		}
+	}
+}
+
+/**
+* Adds the first element of a chunk to its relative indices.
+*/
+static void ResolveRelativeIndices(std::vector<uint32_t>& Indices, const std::vector<uint32_t>& RelativeCorners, const uint32_t FirstElement)
+{
+	for (const uint32_t Corner : RelativeCorners)
+		Indices[Corner] += FirstElement;
+}
+
+/**
+* Checks that every index of a triangle attribute refers to an element.
+*/
+static bool IsValidTriangle(const uint32_t* Indices, const size_t NumElements)
+{
+	return Indices[0] < NumElements && Indices[1] < NumElements && Indices[2] < NumElements;
+}
+
+bool FObjModel::Read(const std::string& Filepath, uint32_t NumThreads)
+{
+	*this = FObjModel();
+
+	FMappedFile File;
+	if (!File.Open(Filepath))
+		return false;
+
+	const char* const Data = File.GetData();
+	const char* const End = Data + File.GetSize();
+
+	// split the file at line ends into chunks of similar size
+	if (NumThreads == 0)
+		NumThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	const size_t NumChunks = std::max<size_t>(std::min<size_t>(NumThreads, File.GetSize() / MinChunkBytes), 1);
+
+	std::vector<const char*> ChunkStarts(NumChunks + 1, End);
+	ChunkStarts[0] = Data;
+	for (size_t i = 1; i < NumChunks; i++)
+	{
+		const char* Start = std::max(Data + File.GetSize() / NumChunks * i, ChunkStarts[i - 1]);
+		const char* LineEnd = (const char*)std::memchr(Start, '\n', End - Start);
+		ChunkStarts[i] = LineEnd ? LineEnd + 1 : End;
+	}
+
+	std::vector<FObjChunk> Chunks(NumChunks);
+	std::vector<std::thread> Threads;
+	for (size_t i = 1; i < NumChunks; i++)
+		Threads.push_back(std::thread(ParseChunk, ChunkStarts[i], ChunkStarts[i + 1], std::ref(Chunks[i])));
+	if (Data)
+		ParseChunk(ChunkStarts[0], ChunkStarts[1], Chunks[0]);
+	for (std::thread& Thread : Threads)
+		Thread.join();
+
+	// elements are numbered in file order, so each chunk's elements follow those of the chunks before it
+	size_t NumVertices = 0, NumUVs = 0, NumNormals = 0, NumIndices = 0;
+	for (FObjChunk& Chunk : Chunks)
+	{
+		ResolveRelativeIndices(Chunk.VertexIndices, Chunk.RelativeVertexCorners, (uint32_t)NumVertices);
+		ResolveRelativeIndices(Chunk.UVIndices, Chunk.RelativeUVCorners, (uint32_t)NumUVs);
+		ResolveRelativeIndices(Chunk.NormalIndices, Chunk.RelativeNormalCorners, (uint32_t)NumNormals);
+		NumVertices += Chunk.Vertices.size();
+		NumUVs += Chunk.UVs.size();
+		NumNormals += Chunk.Normals.size();
+		NumIndices += Chunk.VertexIndices.size();
+	}
+
+	Vertices.reserve(NumVertices);
+	UVs.reserve(NumUVs);
+	Normals.reserve(NumNormals);
+	VertexIndices.reserve(NumIndices);
+	UVIndices.reserve(NumIndices);
+	NormalIndices.reserve(NumIndices);
+
+	const uint32_t NoIndices[3] = { NoIndex, NoIndex, NoIndex };
+	for (FObjChunk& Chunk : Chunks)
+	{
+		Vertices.insert(Vertices.end(), Chunk.Vertices.begin(), Chunk.Vertices.end());
+		UVs.insert(UVs.end(), Chunk.UVs.begin(), Chunk.UVs.end());
+		Normals.insert(Normals.end(), Chunk.Normals.begin(), Chunk.Normals.end());
+		NumSkippedTriangles += Chunk.NumSkippedTriangles;
+
+		// triangles need every vertex, missing texture coordinates or normals are only left out
+		for (size_t i = 0; i < Chunk.VertexIndices.size(); i += 3)
+		{
+			if (!IsValidTriangle(&Chunk.VertexIndices[i], NumVertices))
+			{
+				NumSkippedTriangles++;
+				continue;
+			}
+
+			const uint32_t* const TriangleUVs = IsValidTriangle(&Chunk.UVIndices[i], NumUVs) ? &Chunk.UVIndices[i] : NoIndices;
+			const uint32_t* const TriangleNormals = IsValidTriangle(&Chunk.NormalIndices[i], NumNormals) ? &Chunk.NormalIndices[i] : NoIndices;
+			VertexIndices.insert(VertexIndices.end(), &Chunk.VertexIndices[i], &Chunk.VertexIndices[i] + 3);
+			UVIndices.insert(UVIndices.end(), TriangleUVs, TriangleUVs + 3);
+			NormalIndices.insert(NormalIndices.end(), TriangleNormals, TriangleNormals + 3);
+		}
+
+		// release each chunk once it's copied to keep the peak memory down
+		Chunk = FObjChunk();
+	}
+
+	return true;
+}
+
+size_t FObjModel::GetNumTriangles() const
+{
+	return VertexIndices.size() / 3;
+}
@@ -1,7 +1,8 @@
 #include "Plane.h"
 #include "Intersection.h"
 #include "Camera.h"
-#include "Texture.h"
+
+#include <cmath>
 
 FPlane::FPlane(const FMaterial& LightingMaterial, Vector3f PlaneNormal, Vector3f PointOnPlane)
 	: IDrawable(LightingMaterial)
@@ -16,13 +17,14 @@ FPlane::FPlane(const FMaterial& LightingMaterial, Vector3f PlaneNormal, Vector3f
 
 bool FPlane::IsIntersectingRay(FRay Ray, float* tValueOut, FIntersection* IntersectionOut)
 {
-	if (!IsEnabled())
+	// skip the surface the ray was spawned from
+	if (Ray.ignoreObject == this)
 		return false;
 
 	// bring ray into object space
 	Ray = GetWorldInvTransform().TransformRay(Ray);
 
-	if (abs(Vector3f::Dot(Ray.direction, mNormal)) < _EPSILON)
+	if (std::abs(Vector3f::Dot(Ray.direction, mNormal)) < _EPSILON)
 		return false;
 
 	// Plane/Ray intersection from Mathmatics for 3D Game Programming and Computer Graphics
@@ -47,30 +49,15 @@ bool FPlane::IsIntersectingRay(FRay Ray, float* tValueOut, FIntersection* Inters
 	return true;
 }
 
-FMaterial FPlane::GetMaterial(Vector3f SurfacePoint)
-{
-	const FTextureInfo& DiffuseTextureInfo = mMaterial.GetDiffuseTexture();
-
-	if (!DiffuseTextureInfo.Texture)
-		return mMaterial;
-
-	// bring point into object space
-	SurfacePoint = GetWorldInvTransform().TransformPosition(SurfacePoint);
-
-	// calculate how much to point extends on each UAxis and VAxis
-	const float& U = Vector3f::Dot(SurfacePoint, mUAxis) * DiffuseTextureInfo.UAxisScale;
-	const float& V = Vector3f::Dot(SurfacePoint, mVAxis) * DiffuseTextureInfo.VAxisScale;
-
-	mMaterial.SetDiffuse(DiffuseTextureInfo.Texture->GetSample(U, V));
-
-	return mMaterial;
-}
-
 void FPlane::ConstructIntersection(Vector3f IntersectionPoint, FIntersection& IntersectionOut)
 {
 	IntersectionOut.object = this;
+	IntersectionOut.primitive = FRay::AllPrimitives;
 	IntersectionOut.normal = mNormal;
 	IntersectionOut.point = GetWorldTransform().TransformPosition(IntersectionPoint + mNormal * _EPSILON);
+
+	// calculate how much the point extends on each UAxis and VAxis
+	IntersectionOut.uv = Vector2f(Vector3f::Dot(IntersectionPoint, mUAxis), Vector3f::Dot(IntersectionPoint, mVAxis));
 }
 
 void FPlane::ConstructAABB(Vector3f Min, Vector3f Max)
@@ -1,7 +1,7 @@
 #include "PointLight.h"
 #include "Matrix4.h"
 
-#include <cstdlib>
+#include <cmath>
 
 FPointLight::FPointLight(FColor LightColor, Vector3f LightPosition, float SizeRadius, float MinDistance, float MaxDistance)
 	: ILight(LightColor)
@@ -19,15 +19,15 @@ FRay FPointLight::GetRayToLight(const Vector3f& SurfacePoint) const
 	return LightRay;
 }
 
-std::vector<FRay> FPointLight::GetRayToLightSamples(const Vector3f& SurfacePoint, int NumSamples) const
+FLightSampleFrame FPointLight::GetSampleFrame(const Vector3f& SurfacePoint, uint32_t NumSamples) const
 {
-	// create a plane, decompose it into grids, then take samples
+	// create a plane facing the surface point, samples are taken on it
 	const Vector3f SurfaceDirection(-(mPosition - SurfacePoint).Normalize());
 	 
 	//  let the up direction be the smallest component of the surface direction
 	int ShortestDirection = 0;
 	for (int i = 1; i < 3; i++)
-		if (abs(SurfaceDirection[i]) < abs(SurfaceDirection[ShortestDirection]))
+		if (std::abs(SurfaceDirection[i]) < std::abs(SurfaceDirection[ShortestDirection]))
 			ShortestDirection = i;
 
 	// calculate basis vectors for the plan
@@ -38,38 +38,28 @@ std::vector<FRay> FPointLight::GetRayToLightSamples(const Vector3f& SurfacePoint
 	vUp = Vector3f::Cross(RightVector, SurfaceDirection);
 
 	// create a new frame from these vectors
-	FMatrix4 LightPlaneFrame(RightVector, vUp, SurfaceDirection);
-	LightPlaneFrame.SetOrigin(mPosition);
+	FLightSampleFrame SampleFrame;
+	SampleFrame.Frame = FMatrix4(RightVector, vUp, SurfaceDirection);
+	SampleFrame.Frame.SetOrigin(mPosition);
 
-	const float SamplePlaneRadius = mSizeRadius;
-	const int NumRows = (int)sqrt(NumSamples);
-	const float GridSize = SamplePlaneRadius * 2.0f / NumRows;
-
-	// generate rays in world space
-	std::vector<FRay> SampleRays;
-
-	for (int i = 0; i < NumRows; i++)
-	{
-		// add random sample position within grid for jittered sample points
-		for (int j = 0; j < NumRows; j++)
-		{
-			const float jitterOffsetZ = ((std::rand() % 9 + 1) / 10.0f) * GridSize;
-			const float Z = -i * GridSize + SamplePlaneRadius - jitterOffsetZ;
-
-			const float jitterOffsetX = ((std::rand() % 9 + 1) / 10.0f) * GridSize;
-			const float X = j * GridSize - SamplePlaneRadius + jitterOffsetX;
-
-			Vector3f GridPosition(X, 0, Z);
-			GridPosition = LightPlaneFrame.TransformPosition(GridPosition);
-
-			FRay RayToGrid(SurfacePoint, (GridPosition - SurfacePoint).Normalize());
-			RayToGrid.origin += RayToGrid.direction * _EPSILON;
-
-			SampleRays.push_back(RayToGrid);
-		}
-	}
+	SampleFrame.NumSamples = NumSamples;
+	return SampleFrame;
+}
 
-	return SampleRays;
+FRay FPointLight::GetRayToLightSample(const Vector3f& SurfacePoint, const FLightSampleFrame& Frame, const Vector2f& SamplePoint) const
+{
+	// map the sample point onto the sample plane, from its top left corner
+	const float SamplePlaneSize = mSizeRadius * 2.0f;
+	const float Z = mSizeRadius - SamplePoint.y * SamplePlaneSize;
+	const float X = SamplePoint.x * SamplePlaneSize - mSizeRadius;
+
+	// generate the ray in world space
+	Vector3f GridPosition(X, 0, Z);
+	GridPosition = Frame.Frame.TransformPosition(GridPosition);
+
+	FRay RayToGrid(SurfacePoint, (GridPosition - SurfacePoint).Normalize());
+	RayToGrid.origin += RayToGrid.direction * _EPSILON;
+	return RayToGrid;
 }
 
 void FPointLight::SetLightPosition(const Vector3f& LightPosition)
@@ -0,0 +1,258 @@
+#include "Sampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/* Width and height of the tiles that blue noise sampling orders pixels in, a power of two */
+static const uint32_t BlueNoiseTileSize = 256;
+/* Largest float below 1, points are clamped to it so they stay in [0, 1) */
+static const float OneMinusEpsilon = 0.99999994f;
+
+static const char* SamplerNames[] = { "Jittered", "Halton", "Sobol", "BlueNoise" };
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+* Mixes the bits of a 32 bit value, so close inputs give unrelated outputs.
+*/
+static uint32_t Hash(uint32_t Value)
+{
+	Value ^= Value >> 16;
+	Value *= 0x7feb352du;
+	Value ^= Value >> 15;
+	Value *= 0x846ca68bu;
+	Value ^= Value >> 16;
+	return Value;
+}
+
+/**
+* Hashes two values into one.
+*/
+static uint32_t HashCombine(const uint32_t Seed, const uint32_t Value)
+{
+	return Hash(Seed ^ (Hash(Value) + 0x9e3779b9u + (Seed << 6) + (Seed >> 2)));
+}
+
+/**
+* Converts the upper 24 bits of a value to a float in [0, 1).
+*/
+static float ToUnitFloat(const uint32_t Bits)
+{
+	return (Bits >> 8) * (1.0f / 16777216.0f);
+}
+
+/**
+* Adds an offset to a coordinate and wraps it back into [0, 1).
+*/
+static float WrapShift(const float Value, const float Offset)
+{
+	const float Shifted = Value + Offset;
+	return (Shifted >= 1.0f) ? Shifted - 1.0f : Shifted;
+}
+
+static uint32_t ReverseBits(uint32_t Value)
+{
+	Value = (Value << 16) | (Value >> 16);
+	Value = ((Value & 0x00ff00ffu) << 8) | ((Value & 0xff00ff00u) >> 8);
+	Value = ((Value & 0x0f0f0f0fu) << 4) | ((Value & 0xf0f0f0f0u) >> 4);
+	Value = ((Value & 0x33333333u) << 2) | ((Value & 0xccccccccu) >> 2);
+	Value = ((Value & 0x55555555u) << 1) | ((Value & 0xaaaaaaaau) >> 1);
+	return Value;
+}
+
+/**
+* Owen scrambles a fixed point value in [0, 1). Each bit is flipped depending on the bits above it,
+* which randomizes the point while keeping the stratification of the sequence (Burley 2020).
+*/
+static uint32_t OwenScramble(uint32_t Value, const uint32_t Seed)
+{
+	// the hash only lets lower bits affect higher ones, so it is applied to the reversed bits
+	Value = ReverseBits(Value);
+	Value ^= Value * 0x3d20adeau;
+	Value += Seed;
+	Value *= (Seed >> 16) | 1u;
+	Value ^= Value * 0x05526c56u;
+	Value ^= Value * 0x53a22864u;
+	return ReverseBits(Value);
+}
+
+/**
+* Gets the second dimension of the Sobol sequence as a fixed point value. The first dimension
+* is the bit reversed index.
+*/
+static uint32_t SobolSecondDimension(uint32_t Index)
+{
+	uint32_t Result = 0;
+	for (uint32_t Direction = 1u << 31; Index; Index >>= 1, Direction ^= Direction >> 1)
+	{
+		if (Index & 1u)
+			Result ^= Direction;
+	}
+	return Result;
+}
+
+/**
+* Mirrors the base 3 digits of an index around the decimal point.
+*/
+static float RadicalInverseBase3(uint32_t Index)
+{
+	uint64_t Reversed = 0;
+	double InvBaseN = 1.0;
+	while (Index)
+	{
+		const uint32_t Next = Index / 3;
+		Reversed = Reversed * 3 + (Index - Next * 3);
+		InvBaseN *= 1.0 / 3.0;
+		Index = Next;
+	}
+	return std::min((float)(Reversed * InvBaseN), OneMinusEpsilon);
+}
+
+/**
+* Interleaves the bits of two 16 bit coordinates into a Morton code, so the pixels of every aligned
+* 2^k x 2^k block get consecutive codes.
+*/
+static uint32_t GetMortonCode(const uint32_t X, const uint32_t Y)
+{
+	auto SpreadBits = [](uint32_t Value)
+	{
+		Value &= 0x0000ffffu;
+		Value = (Value | (Value << 8)) & 0x00ff00ffu;
+		Value = (Value | (Value << 4)) & 0x0f0f0f0fu;
+		Value = (Value | (Value << 2)) & 0x33333333u;
+		Value = (Value | (Value << 1)) & 0x55555555u;
+		return Value;
+	};
+	return SpreadBits(X) | (SpreadBits(Y) << 1);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+Vector2f FSampleSet::GetPoint(uint32_t Sample) const
+{
+	switch (Sampler)
+	{
+	case ESampler::Jittered:
+	{
+		// the first rows take a column more when the samples don't fill the grid, each row is as tall as
+		// its share of the samples so every cell covers 1/NumSamples of the square
+		const uint32_t BaseColumns = NumSamples / NumRows;
+		const uint32_t NumWideRows = NumSamples % NumRows;
+		const uint32_t NumWideSamples = NumWideRows * (BaseColumns + 1);
+		const uint32_t NumColumns = (Sample < NumWideSamples) ? BaseColumns + 1 : BaseColumns;
+		const uint32_t Column = (Sample < NumWideSamples) ? Sample % NumColumns : (Sample - NumWideSamples) % NumColumns;
+		const uint32_t FirstInRow = Sample - Column;
+
+		const float JitterX = ToUnitFloat(HashCombine(Scramble, 2 * Sample));
+		const float JitterY = ToUnitFloat(HashCombine(Scramble, 2 * Sample + 1));
+		return Vector2f(std::min((Column + JitterX) / NumColumns, OneMinusEpsilon),
+			std::min((FirstInRow + JitterY * NumColumns) / NumSamples, OneMinusEpsilon));
+	}
+	case ESampler::Halton:
+	{
+		const uint32_t Index = FirstIndex + Sample;
+		return Vector2f(WrapShift(ToUnitFloat(ReverseBits(Index)), Offset.x), WrapShift(RadicalInverseBase3(Index), Offset.y));
+	}
+	case ESampler::Sobol:
+	case ESampler::BlueNoise:
+	default:
+	{
+		const uint32_t Index = FirstIndex + Sample;
+		return Vector2f(ToUnitFloat(OwenScramble(ReverseBits(Index), Scramble)),
+			ToUnitFloat(OwenScramble(SobolSecondDimension(Index), Hash(Scramble))));
+	}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+FPixelSampler::FPixelSampler(ESampler Sampler, uint32_t Seed, const Vector2i& Pixel, const Vector2i& Resolution, uint32_t Pass)
+	: mSampler(Sampler)
+	, mSeed(Seed)
+	, mPixel(Pixel)
+	, mPass(Pass)
+	, mNumSets(0)
+	, mRandom(Seed, (uint64_t)Pass * Resolution.x * Resolution.y + (uint64_t)Pixel.y * Resolution.x + Pixel.x)
+{
+}
+
+FSampleSet FPixelSampler::GetPixelSet(uint32_t NumSamples, uint32_t Round) const
+{
+	// blue noise sets are scrambled the same for every pixel, neighbours take neighbouring parts of the sequence
+	if (mSampler == ESampler::BlueNoise)
+		return MakeSet(NumSamples, HashCombine(mSeed, 0xFFFFFFFFu - Round));
+
+	FSampleSet Set = MakeSet(NumSamples, HashCombine(HashCombine(mSeed, (uint32_t)mPixel.x), (uint32_t)mPixel.y));
+	if (mSampler == ESampler::Jittered)
+	{
+		if (Round > 0)
+			Set.Scramble = HashCombine(Set.Scramble, Round);
+	}
+	else
+	{
+		Set.FirstIndex = Round * NumSamples;
+	}
+	return Set;
+}
+
+FSampleSet FPixelSampler::NextSet(uint32_t NumSamples)
+{
+	const uint32_t SetIndex = mNumSets++;
+	if (mSampler == ESampler::BlueNoise)
+		return MakeSet(NumSamples, HashCombine(HashCombine(mSeed, mPass), SetIndex));
+
+	return MakeSet(NumSamples, mRandom.NextUInt());
+}
+
+FSampleSet FPixelSampler::MakeSet(uint32_t NumSamples, uint32_t Scramble) const
+{
+	FSampleSet Set;
+	Set.Sampler = mSampler;
+	Set.NumSamples = NumSamples;
+	Set.Scramble = Scramble;
+	Set.FirstIndex = 0;
+	Set.Offset = Vector2f();
+
+	// largest number of rows that leaves every row at least as many columns
+	Set.NumRows = std::max((uint32_t)std::sqrt((float)NumSamples), 1u);
+	while (Set.NumRows * Set.NumRows > NumSamples && Set.NumRows > 1)
+		Set.NumRows--;
+	while ((Set.NumRows + 1) * (Set.NumRows + 1) <= NumSamples)
+		Set.NumRows++;
+
+	if (mSampler == ESampler::Halton)
+	{
+		Set.Offset = Vector2f(ToUnitFloat(Hash(Scramble)), ToUnitFloat(HashCombine(Scramble, 1)));
+	}
+	else if (mSampler == ESampler::BlueNoise)
+	{
+		// each pixel takes the next NumSamples points of one sequence, with pixels in Morton order. The points of
+		// every aligned block of pixels are then a larger part of the sequence that is stratified as a whole,
+		// so the errors of neighbouring pixels cancel out. Flipping bits of the order scrambles the quadrants
+		// of each level of the blocks (Ahmed and Wonka 2020).
+		const uint32_t TileMask = BlueNoiseTileSize - 1;
+		const uint32_t PixelOrder = GetMortonCode(mPixel.x & TileMask, mPixel.y & TileMask) ^ (Hash(Scramble) & (BlueNoiseTileSize * BlueNoiseTileSize - 1));
+		Set.FirstIndex = PixelOrder * NumSamples;
+	}
+
+	return Set;
+}
+
+const char* FPixelSampler::GetName(ESampler Sampler)
+{
+	return SamplerNames[(uint32_t)Sampler];
+}
+
+bool FPixelSampler::FindSampler(const std::string& Name, ESampler& SamplerOut)
+{
+	for (uint32_t i = 0; i < sizeof(SamplerNames) / sizeof(SamplerNames[0]); i++)
+	{
+		if (Name == SamplerNames[i])
+		{
+			SamplerOut = (ESampler)i;
+			return true;
+		}
+	}
+	return false;
+}
@@ -14,14 +14,110 @@
 
 #include <iostream>
 #include <algorithm>
+#include <cmath>
 #include <string>
 #include <limits>
 #include <unordered_map>
+#include <thread>
+#include <chrono>
+#include <time.h>
 
 static std::unordered_map<std::string, FTexture> TextureHolder;
 static std::unordered_map<std::string, FMaterial> MaterialHolder;
 static const uint8_t KdDepth = 10;
 static const uint8_t KdMinObjects = 3;
+static const int32_t RenderTileSize = 32;
+/* Width and height of the pixel blocks whose camera rays are traced as packets */
+static const int32_t PacketBlockSize = 4;
+/* Soft shadow samples taken first to find out if a point is in a penumbra */
+static const uint32_t NumShadowProbes = 5;
+/* Lights whose colors a shaded hit keeps on the stack, scenes with more lights use a heap buffer */
+static const uint32_t MaxStackLights = 16;
+/* Passes of a progressive render that trace every pixel, before the noise of the pixels is trusted */
+static const uint32_t MinProgressivePasses = 4;
+/* Progressive renders stop after this many passes, even if their noise target was not reached */
+static const uint32_t MaxProgressivePasses = 1024;
+
+const float FScene::DefaultMinRayWeight = 0.001f;
+const float FScene::DefaultSuperSamplingThreshold = 0.01f;
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+* Checks if the soft shadow samples of a light start with probes. Probes only save rays when the
+* light takes more samples than that.
+*/
+static bool IsProbingShadows(const bool UseAdaptiveShadows, const FSampleSet& Samples)
+{
+	return UseAdaptiveShadows && Samples.NumSamples > NumShadowProbes;
+}
+
+/**
+* Gets the sample index of a shadow probe. The probes of a full jittered grid are its four corner
+* cells and its center cell, so together they span the whole light.
+* @param Samples - Sample set of the light
+* @param Probe - Index of the probe, less than NumShadowProbes
+*/
+static uint32_t GetShadowProbeSample(const FSampleSet& Samples, const uint32_t Probe)
+{
+	// the first points of a sequence, or of a scrambled grid, are already spread over the light
+	if (Samples.Sampler != ESampler::Jittered || Samples.NumRows < 3 || Samples.NumRows * Samples.NumRows != Samples.NumSamples)
+		return Probe;
+
+	const uint32_t Last = Samples.NumRows - 1;
+	const uint32_t Middle = Samples.NumRows / 2;
+	const uint32_t ProbeRows[NumShadowProbes] = { 0, 0, Last, Last, Middle };
+	const uint32_t ProbeColumns[NumShadowProbes] = { 0, Last, 0, Last, Middle };
+	return ProbeRows[Probe] * Samples.NumRows + ProbeColumns[Probe];
+}
+
+/**
+* Checks if a sample of a light is one of its shadow probes.
+*/
+static bool IsShadowProbeSample(const FSampleSet& Samples, const uint32_t Sample)
+{
+	for (uint32_t Probe = 0; Probe < NumShadowProbes; Probe++)
+	{
+		if (GetShadowProbeSample(Samples, Probe) == Sample)
+			return true;
+	}
+	return false;
+}
+
+/**
+* Gets the cell of a pixel's supersampling grid that a camera sample is taken in. The first
+* samples are on the diagonal of the grid, so they cover every row and column of the pixel.
+* The rest of the cells follow in row order.
+* @param Level - Width of the supersampling grid
+* @param Sample - Index of the sample in the order the pixel's samples are taken
+*/
+static uint32_t GetPixelSampleCell(const uint32_t Level, const uint32_t Sample)
+{
+	if (Sample < Level)
+		return Sample * Level + Sample;
+
+	// skip the diagonal cell of each row
+	const uint32_t OffDiagonal = Sample - Level;
+	const uint32_t Row = OffDiagonal / (Level - 1);
+	uint32_t Column = OffDiagonal % (Level - 1);
+	if (Column >= Row)
+		Column++;
+	return Row * Level + Column;
+}
+
+/**
+* Computes the factor of a light that is visible from the number of its shadow samples that were blocked.
+*/
+static float GetShadeFactor(const uint32_t NumShadowed, const uint32_t NumSamples)
+{
+	const float FactorSize = 1.0f / NumSamples;
+	float ShadeFactor = 1.0f;
+	for (uint32_t i = 0; i < NumShadowed; i++)
+	{
+		ShadeFactor -= FactorSize;
+	}
+	return ShadeFactor;
+}
 
 //////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -31,9 +127,29 @@ void throwSceneConfigError(const std::string& ObjectType)
 	throw std::runtime_error("Scene config error.");
 }
 
+/**
+* Creates a mesh for a model file. The first mesh of a file reads the model and builds its BVH,
+* later meshes of the same file are instances that share them.
+* @param LoadedModels - First mesh created for each model file
+*/
+static FMesh* CreateModel(std::unordered_map<std::string, const FMesh*>& LoadedModels, const std::string& Filename, const FMaterial& Material, uint32_t MeshLeafTriangles, bool UseMeshCache)
+{
+	const auto Loaded = LoadedModels.find(Filename);
+	if (Loaded != LoadedModels.end())
+		return new FMesh(*Loaded->second, Material);
+
+	FMesh* Mesh = new FMesh(Filename, Material, MeshLeafTriangles, UseMeshCache);
+	std::cout << Filename << ": " << Mesh->GetNumTriangles() << " triangles, BVH SAH cost " << Mesh->GetBVHCost() << std::endl;
+	LoadedModels.insert({ Filename, Mesh });
+	return Mesh;
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////
-FScene::FScene(const std::string& OutputName, const Vector2i& OutputResolution, const uint16_t NumShadowSamples, const uint16_t SuperSamplingLevel)
-	: mOutputImage(OutputName, OutputResolution)
+FScene::FScene(const std::string& OutputName, const Vector2i& OutputResolution, const uint16_t NumShadowSamples, const uint16_t SuperSamplingLevel, const uint16_t NumThreads, const uint32_t Seed,
+	const uint32_t PacketSize, const EIntegrator Integrator, const float MinRayWeight, const EImageFormat ImageFormat,
+	const bool UseAdaptiveShadows, const bool UseAdaptiveSuperSampling, const float SuperSamplingThreshold,
+	const ESampler Sampler, const float TimeBudget, const float TargetNoise, const float WriteInterval)
+	: mOutputImage(OutputName, OutputResolution, ImageFormat)
 	, mBackgroundColor(FColor::Black)
 	, mGlobalAmbient(0.2f, 0.2f, 0.2f)
 	, mCamera(Vector3f(0, 0, 0), Vector3f(0, 0, -1.0f), Vector3f(0, 1, 0), 75, OutputResolution)
@@ -41,16 +157,41 @@ FScene::FScene(const std::string& OutputName, const Vector2i& OutputResolution,
 	, mKDTree()
 	, mNumberOfShadowSamples(NumShadowSamples)
 	, mSuperSamplingLevel(SuperSamplingLevel)
+	, mNumberOfThreads(std::max<uint16_t>(NumThreads, 1))
+	, mSeed(Seed)
+	, mSampler(Sampler)
+	, mPacketSize(std::min(std::max(PacketSize, 1u), (uint32_t)FRayPacket::MaxSize))
+	, mIntegrator(Integrator)
+	, mMinRayWeight(MinRayWeight)
+	, mUseAdaptiveShadows(UseAdaptiveShadows)
+	, mUseAdaptiveSuperSampling(UseAdaptiveSuperSampling)
+	, mSuperSamplingThreshold(SuperSamplingThreshold)
+	, mTimeBudget(TimeBudget)
+	, mTargetNoise(TargetNoise)
+	, mWriteInterval(WriteInterval)
 	, mOutputResolution(OutputResolution)
+	, mSampleSums()
+	, mSquaredSampleSums()
+	, mSampleCounts()
+	, mCompletedPixels(0)
+	, mPassPixels(0)
+	, mProgressMutex()
+	, mCameraRays(0)
+	, mShadowRays(0)
+	, mShadowTests(0)
+	, mSecondaryRays(0)
+	, mSkippedRays(0)
+	, mReusedRays(0)
 {
 	
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////
 
-void FScene::BuildScene(std::istream& in)
+void FScene::BuildScene(std::istream& in, EKDTreeBuilder TreeBuilder, uint32_t MeshLeafTriangles, bool UseMeshCache)
 {
 	std::vector<PrimitivePtr> Objects;
+	std::unordered_map<std::string, const FMesh*> LoadedModels;
 
 	std::string string;
 	in >> string;
@@ -282,13 +423,62 @@ void FScene::BuildScene(std::istream& in)
 				throwSceneConfigError("Model");
 			in >> Scale.x >> Scale.y >> Scale.z;
 
-			Objects.push_back(PrimitivePtr(new FMesh(Filename, MaterialHolder[Material])));
+			Objects.push_back(PrimitivePtr(CreateModel(LoadedModels, Filename, MaterialHolder[Material], MeshLeafTriangles, UseMeshCache)));
 			FMatrix4 Transform;
 			Transform.SetOrigin(Position);
 			Transform.Rotate(Rotation);
 			Transform.Scale(Scale);
 			Objects.back()->SetTransform(Transform);
 		}
+		else if (string == "Instances")
+		{
+			std::string Filename;
+			uint32_t Count;
+
+			in >> string;
+			if (string != "ModelFile:")
+				throwSceneConfigError("Instances");
+			in >> Filename;
+
+			in >> string;
+			if (string != "Count:")
+				throwSceneConfigError("Instances");
+			in >> Count;
+
+			// every instance shares the model's triangles and BVH, and has its own material and transform
+			for (uint32_t i = 0; i < Count; i++)
+			{
+				std::string Material;
+				Vector3f Position, Rotation, Scale;
+
+				in >> string;
+				if (string != "Material:")
+					throwSceneConfigError("Instances");
+				in >> Material;
+
+				in >> string;
+				if (string != "Position:")
+					throwSceneConfigError("Instances");
+				in >> Position.x >> Position.y >> Position.z;
+
+				in >> string;
+				if (string != "Rotation:")
+					throwSceneConfigError("Instances");
+				in >> Rotation.x >> Rotation.y >> Rotation.z;
+
+				in >> string;
+				if (string != "Scale:")
+					throwSceneConfigError("Instances");
+				in >> Scale.x >> Scale.y >> Scale.z;
+
+				Objects.push_back(PrimitivePtr(CreateModel(LoadedModels, Filename, MaterialHolder[Material], MeshLeafTriangles, UseMeshCache)));
+				FMatrix4 Transform;
+				Transform.SetOrigin(Position);
+				Transform.Rotate(Rotation);
+				Transform.Scale(Scale);
+				Objects.back()->SetTransform(Transform);
+			}
+		}
 		else if (string == "Texture")
 		{
 			std::string Name, File;
@@ -372,12 +562,24 @@ void FScene::BuildScene(std::istream& in)
 		in >> string;
 	}
 
-	mKDTree.BuildTree(Objects, KdDepth, KdMinObjects);
+	for (const auto& Model : LoadedModels)
+	{
+		if (Model.second->GetNumInstances() > 1)
+			std::cout << Model.first << ": " << Model.second->GetNumInstances() << " instances" << std::endl;
+	}
+
+	const clock_t BuildStart = clock();
+	if (TreeBuilder == EKDTreeBuilder::SAH)
+		mKDTree.BuildSAHTree(Objects);
+	else
+		mKDTree.BuildTree(Objects, KdDepth, KdMinObjects);
+
+	std::cout << "KD-tree built in " << ((float)clock() - (float)BuildStart) / CLOCKS_PER_SEC << " seconds." << std::endl;
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////
 
-FColor FScene::TraceRay(const FRay& CameraRay, int32_t Depth)
+FColor FScene::TraceRay(const FRay& CameraRay, int32_t Depth, FPixelSampler& Sampler, FRayStats& Stats, float Weight)
 {
 	if (Depth < 1)
 		return mBackgroundColor;
@@ -393,21 +595,38 @@ FColor FScene::TraceRay(const FRay& CameraRay, int32_t Depth)
 	//}
 		
 	mKDTree.IsIntersectingRay(CameraRay, &MaxTValue, &ClosestIntersection);
+	return ShadeIntersection(CameraRay, ClosestIntersection, Depth, Sampler, Stats, Weight);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
 
+FColor FScene::ShadeIntersection(const FRay& CameraRay, FIntersection ClosestIntersection, int32_t Depth, FPixelSampler& Sampler, FRayStats& Stats, float Weight)
+{
 	// If an object was intersected
 	if (ClosestIntersection.object)
 	{
-		// disable the current object so reflection and refraction rays don't
-		// interact with it
-		ClosestIntersection.object->SetEnabled(false);
-		FColor OutputColor;
+		// reflection, refraction and shadow rays ignore the surface they are
+		// spawned from so they don't interact with it
+		const IDrawable* SurfaceObject = ClosestIntersection.object;
+		const uint32_t SurfacePrimitive = ClosestIntersection.primitive;
+
+		// direct light of each lit light, kept on the stack since every hit and bounce needs its own
+		FColor StackLightColors[MaxStackLights];
+		std::vector<FColor> HeapLightColors;
+		FColor* LightColors = StackLightColors;
+		if (mLights.size() > MaxStackLights)
+		{
+			HeapLightColors.resize(mLights.size());
+			LightColors = HeapLightColors.data();
+		}
+		uint32_t NumLights = 0;
 
-		// Get the surface material, point, and normal
+		// Get the surface properties, point, and normal
 		const Vector3f& SurfacePoint(ClosestIntersection.point);
 		const Vector3f& SurfaceNormal(ClosestIntersection.normal.Normalize());
-		const FMaterial& SurfaceMaterial(ClosestIntersection.object->GetMaterial(SurfacePoint));
+		const FSurfaceProperties Surface(SurfaceObject->GetSurfaceProperties(ClosestIntersection));
 
-		assert(abs(SurfaceNormal.Length() - 1.0f) < _EPSILON);
+		assert(std::abs(SurfaceNormal.Length() - 1.0f) < _EPSILON);
 
 		for (const auto& light : mLights)
 		{
@@ -420,60 +639,52 @@ FColor FScene::TraceRay(const FRay& CameraRay, int32_t Depth)
 			// Get direction of light and compute h reflection
 			FRay RayToLight(light->GetRayToLight(SurfacePoint));
 			RayToLight.origin += RayToLight.direction * _EPSILON;
+			RayToLight.ignoreObject = SurfaceObject;
+			RayToLight.ignorePrimitive = SurfacePrimitive;
 
 			const Vector3f& LightDirection(RayToLight.direction);
-			const Vector3f& H = ComputeBlinnSpecularReflection(RayToLight.direction, -CameraRay.direction);
 
 			// If an object is in the way of the light, skip lighting for that light
+			Stats.ShadowTests++;
 			if (mNumberOfShadowSamples > 1)
 			{
-				const float ShadeFactor = ComputeShadeFactor(*light, SurfacePoint);
+				const float ShadeFactor = ComputeShadeFactor(*light, SurfacePoint, SurfaceObject, SurfacePrimitive, Sampler, Stats);
 				if (ShadeFactor <= 0.0)
 					continue;
 
 				LightColor *= ShadeFactor;
 			}
-			else if (IsInShadow(RayToLight, light->GetDistance(SurfacePoint)))
+			else
 			{
-				continue;
+				Stats.ShadowRays++;
+				if (IsInShadow(RayToLight, light->GetDistance(SurfacePoint)))
+					continue;
 			}
 
-			// Get dot product of surface normal and h for specular lighting
-			const float SpecularFactor = pow(std::max(Vector3f::Dot(SurfaceNormal, H), 0.f), SurfaceMaterial.GetGlossiness());
-
-			// Get dot product of surface normal and light direction for diffuse lighting
-			const float DiffuseFactor = std::max(Vector3f::Dot(SurfaceNormal, LightDirection), 0.f);
-
-			// Combine material color and light color for diffuse and specular
-			const FColor specularColor(LightColor * SurfaceMaterial.GetSpecular() * SpecularFactor);
-			const FColor diffuseColor(LightColor  * SurfaceMaterial.GetDiffuse() * DiffuseFactor);
+			// Get diffuse and specular contributions
+			LightColors[NumLights++] = ComputeDirectLight(SurfaceNormal, -CameraRay.direction, LightDirection, LightColor, Surface);
+		}
 
-			// Add diffuse and specular contributions to total
-			OutputColor += specularColor + diffuseColor;
+		// the reflection and refraction are seen through every lit light, so they are traced once for all of them
+		FColor Reflection, Refraction;
+		if (NumLights > 0)
+		{
+			float ReflectionWeight, RefractionWeight;
+			ComputeSecondaryWeights(LightColors, NumLights, Surface, Weight, ReflectionWeight, RefractionWeight);
 
-			if (SurfaceMaterial.GetDiffuse().A < 1.0f)
+			if (Surface.Diffuse.A < 1.0f)
 			{
-				OutputColor *= SurfaceMaterial.GetDiffuse().A;
-				const Vector3f RefractionDirection = ComputeRefractionVector(-CameraRay.direction, SurfaceNormal, SurfaceMaterial.GetRefractiveIndex());
-				assert(abs(RefractionDirection.Length() - 1) < _EPSILON);
-				const FRay Refraction(SurfacePoint, RefractionDirection);
-
-				// modify the refraction input by amount of transparency
-				OutputColor += (1 - SurfaceMaterial.GetDiffuse().A) * TraceRay(Refraction, Depth - 1);
+				const Vector3f RefractionDirection = ComputeRefractionVector(-CameraRay.direction, SurfaceNormal, Surface.RefractiveIndex);
+				assert(std::abs(RefractionDirection.Length() - 1) < _EPSILON);
+				Refraction = TraceSecondaryRay(FRay(SurfacePoint, RefractionDirection, SurfaceObject, SurfacePrimitive), Depth - 1, Sampler, Stats, RefractionWeight, NumLights);
 			}
 
-			// Add mirror reflection contributions
 			const Vector3f mirrorReflection = -CameraRay.direction.Reflect(SurfaceNormal);
-			const FRay reflectionRay(SurfacePoint, mirrorReflection);
-			OutputColor += TraceRay(reflectionRay, Depth - 1) * OutputColor * SurfaceMaterial.GetReflectivity();
-			
+			Reflection = TraceSecondaryRay(FRay(SurfacePoint, mirrorReflection, SurfaceObject, SurfacePrimitive), Depth - 1, Sampler, Stats, ReflectionWeight, NumLights);
 		}
 
-		// re-enable this object
-		ClosestIntersection.object->SetEnabled(true);
-
 		// return computed color totals with ambient contribution
-		return OutputColor + (mGlobalAmbient * SurfaceMaterial.GetAmbient());
+		return CombineLighting(LightColors, NumLights, Reflection, Refraction, Surface) + (mGlobalAmbient * Surface.Ambient);
 	}
 	else
 		return mBackgroundColor;
@@ -483,61 +694,925 @@ FColor FScene::TraceRay(const FRay& CameraRay, int32_t Depth)
 
 void FScene::RenderScene()
 {
-	// values for calculating progress of completion
-	const float InvTotalPixels = 100.0f / (mOutputResolution.x * mOutputResolution.y);
-	const int PercentUpdateRate = mOutputResolution.y / 20;
-	int UpdateInterval = 0;
+	mCameraRays = mShadowRays = mShadowTests = mSecondaryRays = mSkippedRays = mReusedRays = 0;
+	if (IsProgressive())
+	{
+		RenderProgressive();
+		return;
+	}
+
+	mOutputImage.BeginImage();
+
+	const uint32_t NumPixels = (uint32_t)(mOutputResolution.x * mOutputResolution.y);
+	const uint32_t SamplesPerPixel = (mSuperSamplingLevel <= 1) ? 1 : mSuperSamplingLevel * mSuperSamplingLevel;
+
+	// without adaptive supersampling every sample is traced in one pass, and pixels are written as they finish
+	if (!mUseAdaptiveSuperSampling || mSuperSamplingLevel <= 1)
+	{
+		const FRenderPass Pass = { 0, 0, SamplesPerPixel, nullptr, NumPixels, true };
+		RenderPass(Pass);
+		mOutputImage.WriteImage();
+		return;
+	}
+
+	mSampleSums.assign(NumPixels, FColor());
+	mSquaredSampleSums.assign(NumPixels, FColor());
+	mSampleCounts.assign(NumPixels, 0);
+
+	// one sample on each row and column of every pixel's grid shows where the image varies
+	const FRenderPass FirstPass = { 0, 0, mSuperSamplingLevel, nullptr, NumPixels, false };
+	RenderPass(FirstPass);
+
+	std::vector<uint8_t> PixelMask;
+	const uint32_t NumRefinedPixels = FindPixelsToRefine(PixelMask);
+	std::cout << "Supersampling " << NumRefinedPixels << " of " << NumPixels << " pixels" << std::endl;
+
+	const FRenderPass RefinePass = { 1, mSuperSamplingLevel, SamplesPerPixel - mSuperSamplingLevel, PixelMask.data(), NumRefinedPixels, true };
+	RenderPass(RefinePass);
+	mOutputImage.WriteImage();
+
+	mSampleSums.clear();
+	mSquaredSampleSums.clear();
+	mSampleCounts.clear();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+void FScene::RenderProgressive()
+{
+	using FClock = std::chrono::steady_clock;
+	using FSeconds = std::chrono::duration<float>;
+	const FClock::time_point StartTime = FClock::now();
+	FClock::time_point LastWriteTime = StartTime;
+
+	const uint32_t NumPixels = (uint32_t)(mOutputResolution.x * mOutputResolution.y);
+	const uint32_t SamplesPerPass = std::max<uint32_t>(mSuperSamplingLevel, 1);
+
+	mSampleSums.assign(NumPixels, FColor());
+	mSquaredSampleSums.assign(NumPixels, FColor());
+	mSampleCounts.assign(NumPixels, 0);
+
+	std::vector<uint8_t> PixelMask;
+	uint32_t NumPassPixels = NumPixels;
+	float PassTime = 0.0f;
+	uint32_t NumPasses = 0;
+	const char* StopReason = "pass limit";
+	while (NumPasses < MaxProgressivePasses)
+	{
+		// passes take about as long as the one before, so the last pass still fits in the budget
+		const float ElapsedTime = FSeconds(FClock::now() - StartTime).count();
+		if (mTimeBudget > 0.0f && NumPasses > 0 && ElapsedTime + PassTime > mTimeBudget)
+		{
+			StopReason = "time budget";
+			break;
+		}
+
+		const FClock::time_point PassStartTime = FClock::now();
+		const FRenderPass Pass = { NumPasses, NumPasses * SamplesPerPass, SamplesPerPass, PixelMask.empty() ? nullptr : PixelMask.data(), NumPassPixels, false };
+		RenderPass(Pass);
+		PassTime = FSeconds(FClock::now() - PassStartTime).count();
+		NumPasses++;
+
+		float Noise;
+		const uint32_t NumNoisyPixels = FindNoisyPixels(PixelMask, Noise);
+		std::cout << "Pass " << NumPasses << ": " << NumPassPixels << " pixels traced, noise " << Noise;
+		if (mTargetNoise > 0.0f)
+			std::cout << ", " << NumNoisyPixels << " pixels above the target";
+		std::cout << ", " << PassTime << " seconds" << std::endl;
+
+		// every pixel is traced until the noise of its first samples can be trusted
+		if (mTargetNoise > 0.0f && NumPasses >= MinProgressivePasses)
+			NumPassPixels = NumNoisyPixels;
+		else
+			PixelMask.clear();
+
+		if (NumPassPixels == 0)
+		{
+			StopReason = "target noise";
+			break;
+		}
+
+		if (mWriteInterval > 0.0f && FSeconds(FClock::now() - LastWriteTime).count() >= mWriteInterval)
+		{
+			WriteAveragedImage(false);
+			LastWriteTime = FClock::now();
+		}
+	}
+
+	std::cout << "Progressive render stopped by the " << StopReason << " after " << NumPasses << " passes, "
+		<< FSeconds(FClock::now() - StartTime).count() << " seconds" << std::endl;
+	WriteAveragedImage(true);
+
+	mSampleSums.clear();
+	mSquaredSampleSums.clear();
+	mSampleCounts.clear();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+void FScene::WriteAveragedImage(const bool IsFinal)
+{
+	for (int32_t y = 0; y < mOutputResolution.y; y++)
+	{
+		for (int32_t x = 0; x < mOutputResolution.x; x++)
+		{
+			const size_t Pixel = (size_t)y * mOutputResolution.x + x;
+			FColor PixelColor = mSampleSums[Pixel];
+			PixelColor /= (float)std::max(mSampleCounts[Pixel], 1u);
+			mOutputImage.SetPixel(x, y, PixelColor);
+		}
+	}
+
+	mOutputImage.WriteImage(IsFinal);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+void FScene::RenderPass(const FRenderPass& Pass)
+{
+	mCompletedPixels = 0;
+	mPassPixels = Pass.NumPixels;
+
+	// A single thread renders the whole image as one tile
+	if (mNumberOfThreads <= 1)
+	{
+		RenderTile(Vector2i(0, 0), mOutputResolution, Pass);
+		return;
+	}
+
+	// split the image into tiles
+	std::vector<std::pair<Vector2i, Vector2i>> Tiles;
+	for (int32_t y = 0; y < mOutputResolution.y; y += RenderTileSize)
+	{
+		for (int32_t x = 0; x < mOutputResolution.x; x += RenderTileSize)
+		{
+			const Vector2i TileEnd(std::min(x + RenderTileSize, mOutputResolution.x), std::min(y + RenderTileSize, mOutputResolution.y));
+			Tiles.push_back({ Vector2i(x, y), TileEnd });
+		}
+	}
+
+	// each worker grabs the next unrendered tile until none are left
+	std::atomic<uint32_t> NextTile(0);
+	auto RenderWorker = [this, &Tiles, &NextTile, &Pass]()
+	{
+		for (uint32_t Tile = NextTile++; Tile < Tiles.size(); Tile = NextTile++)
+		{
+			RenderTile(Tiles[Tile].first, Tiles[Tile].second, Pass);
+		}
+	};
+
+	std::vector<std::thread> Workers;
+	for (uint16_t i = 0; i < mNumberOfThreads; i++)
+	{
+		Workers.push_back(std::thread(RenderWorker));
+	}
+
+	for (auto& Worker : Workers)
+	{
+		Worker.join();
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+FRayStats FScene::GetRayStats() const
+{
+	return FRayStats{ mCameraRays, mShadowRays, mShadowTests, mSecondaryRays, mSkippedRays, mReusedRays };
+}
 
-	// With supersampling
-	if (mSuperSamplingLevel > 1)
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+void FScene::RenderTile(const Vector2i& Start, const Vector2i& End, const FRenderPass& Pass)
+{
+	FRayStats Stats = {};
+	if (mIntegrator == EIntegrator::Wavefront)
+	{
+		RenderTileWavefront(Start, End, Pass, Stats);
+	}
+	else if (mPacketSize > 1)
+	{
+		RenderTilePackets(Start, End, Pass, Stats);
+	}
+	else
 	{
-		for (int y = 0; y < mOutputResolution.y; y++)
+		for (int32_t y = Start.y; y < End.y; y++)
 		{
-			for (int x = 0; x < mOutputResolution.x; x++)
+			uint32_t NumPixels = 0;
+			for (int32_t x = Start.x; x < End.x; x++)
 			{
-				FColor PixelColor;
-				for (const FRay& PixelRay : mCamera.GenerateSampleRays(x, y, mSuperSamplingLevel))
+				if (Pass.PixelMask && !Pass.PixelMask[y * mOutputResolution.x + x])
+					continue;
+
+				AddPixelSamples(x, y, RenderPixel(x, y, Pass, Stats), Pass);
+				NumPixels++;
+			}
+
+			ReportProgress(NumPixels);
+		}
+	}
+
+	AddRayStats(Stats);
+	WriteUntracedPixels(Start, End, Pass);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+void FScene::RenderTilePackets(const Vector2i& Start, const Vector2i& End, const FRenderPass& Pass, FRayStats& Stats)
+{
+	const uint32_t SamplesPerPixel = Pass.NumSamples;
+
+	// camera rays of a block, the samples of each pixel are next to each other
+	std::vector<Vector2i> BlockPixels;
+	std::vector<FPixelSampler> PixelSamplers;
+	std::vector<FRay> BlockRays;
+	std::vector<FIntersection> BlockIntersections;
+	std::vector<FColor> SampleColors;
+
+	for (int32_t BlockY = Start.y; BlockY < End.y; BlockY += PacketBlockSize)
+	{
+		for (int32_t BlockX = Start.x; BlockX < End.x; BlockX += PacketBlockSize)
+		{
+			BlockPixels.clear();
+			PixelSamplers.clear();
+			BlockRays.clear();
+			SampleColors.clear();
+
+			const Vector2i BlockEnd(std::min(BlockX + PacketBlockSize, End.x), std::min(BlockY + PacketBlockSize, End.y));
+			GatherCameraRays(Vector2i(BlockX, BlockY), BlockEnd, Pass, BlockPixels, PixelSamplers, BlockRays);
+			IntersectRays(BlockRays, true, BlockIntersections);
+			Stats.CameraRays += BlockRays.size();
+
+			for (size_t Sample = 0; Sample < BlockRays.size(); Sample++)
+			{
+				SampleColors.push_back(ShadeIntersection(BlockRays[Sample], BlockIntersections[Sample], 4, PixelSamplers[Sample / SamplesPerPixel], Stats));
+			}
+
+			WritePixels(BlockPixels, SampleColors, Pass);
+			ReportProgress((uint32_t)BlockPixels.size());
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+void FScene::RenderTileWavefront(const Vector2i& Start, const Vector2i& End, const FRenderPass& Pass, FRayStats& Stats)
+{
+	std::vector<Vector2i> TilePixels;
+	std::vector<FPixelSampler> PixelSamplers;
+	std::vector<FRay> CameraRays;
+	std::vector<FColor> SampleColors;
+
+	// every ray of a tile is kept in memory, so larger regions are traced a tile at a time
+	for (int32_t TileY = Start.y; TileY < End.y; TileY += RenderTileSize)
+	{
+		for (int32_t TileX = Start.x; TileX < End.x; TileX += RenderTileSize)
+		{
+			TilePixels.clear();
+			PixelSamplers.clear();
+			CameraRays.clear();
+
+			const Vector2i TileEnd(std::min(TileX + RenderTileSize, End.x), std::min(TileY + RenderTileSize, End.y));
+			GatherCameraRays(Vector2i(TileX, TileY), TileEnd, Pass, TilePixels, PixelSamplers, CameraRays);
+			TraceRayStreams(CameraRays, PixelSamplers, SampleColors, Stats);
+			WritePixels(TilePixels, SampleColors, Pass);
+
+			ReportProgress((uint32_t)TilePixels.size());
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+void FScene::TraceRayStreams(const std::vector<FRay>& CameraRays, std::vector<FPixelSampler>& PixelSamplers, std::vector<FColor>& SampleColorsOut, FRayStats& Stats)
+{
+	const uint32_t SamplesPerPixel = (uint32_t)(CameraRays.size() / std::max<size_t>(PixelSamplers.size(), 1));
+
+	// camera rays write their color to their own sample
+	FRayStream Rays;
+	for (uint32_t Sample = 0; Sample < CameraRays.size(); Sample++)
+	{
+		Rays.Add(CameraRays[Sample], Sample, Sample, 1.0f);
+	}
+
+	// rays that miss, or are never traced, see the background
+	SampleColorsOut.assign(CameraRays.size(), mBackgroundColor);
+
+	std::vector<FStreamBounce> Bounces;
+	std::vector<FIntersection> Intersections;
+	std::vector<FStreamLight> Lights;
+	std::vector<FRay> ShadowRays;
+	FRayStream NextRays;
+	Stats.CameraRays += CameraRays.size();
+
+	for (int32_t Depth = 4; Depth >= 1 && !Rays.Rays.empty(); Depth--)
+	{
+		// intersect the whole stream, camera rays are coherent enough for packets
+		IntersectRays(Rays.Rays, Bounces.empty(), Intersections);
+
+		// compact the rays that hit something into the hits of this bounce
+		Bounces.emplace_back();
+		FStreamBounce& Bounce = Bounces.back();
+		for (uint32_t i = 0; i < Rays.Rays.size(); i++)
+		{
+			FIntersection& Intersection = Intersections[i];
+			if (!Intersection.object)
+				continue;
+
+			FStreamHit Hit;
+			Hit.Point = Intersection.point;
+			Hit.Normal = Intersection.normal.Normalize();
+			Hit.RayDirection = Rays.Rays[i].direction;
+			Hit.Surface = Intersection.object->GetSurfaceProperties(Intersection);
+			Hit.Object = Intersection.object;
+			Hit.Primitive = Intersection.primitive;
+			Hit.Sample = Rays.Samples[i];
+			Hit.Target = Rays.Targets[i];
+			Hit.Weight = Rays.Weights[i];
+			Hit.FirstLight = Hit.NumLights = 0;
+			Bounce.Hits.push_back(Hit);
+		}
+		Bounce.SecondaryColors.assign(2 * Bounce.Hits.size(), mBackgroundColor);
+
+		// adds a soft shadow sample of a light to the shadow stream
+		auto AddShadowSample = [this, &Bounce, &Lights, &ShadowRays](FStreamLight& Light, const uint32_t Sample)
+		{
+			const FStreamHit& Hit = Bounce.Hits[Light.Hit];
+			FRay ShadowSample = Light.Source->GetRayToLightSample(Hit.Point, Light.SampleFrame, Light.SampleSet.GetPoint(Sample));
+
+			// make sure the ray doesn't start below the surface
+			ShadowSample.origin += ShadowSample.direction * _EPSILON;
+			ShadowSample.ignoreObject = Hit.Object;
+			ShadowSample.ignorePrimitive = Hit.Primitive;
+			ShadowRays.push_back(ShadowSample);
+			Light.NumShadowRays++;
+		};
+
+		// traces the shadow stream and counts the blocked rays of each light
+		auto TraceShadowRays = [this, &Lights, &ShadowRays, &Stats]()
+		{
+			Stats.ShadowRays += ShadowRays.size();
+			for (FStreamLight& Light : Lights)
+			{
+				IDrawable* LastOccluder = nullptr;
+				for (uint32_t i = Light.FirstShadowRay; i < Light.FirstShadowRay + Light.NumShadowRays; i++)
 				{
-					PixelColor += TraceRay(PixelRay, 4);
+					if (IsInShadow(ShadowRays[i], Light.Distance, &LastOccluder))
+						Light.NumShadowed++;
 				}
+				Light.NumSamples += Light.NumShadowRays;
+			}
+		};
 
-				// average the result of all samples
-				PixelColor /= (float)(mSuperSamplingLevel * mSuperSamplingLevel);
-				mOutputImage.SetPixel(x, y, PixelColor.Clamp());
+		// queue the shadow rays of every light that reaches a hit
+		Lights.clear();
+		ShadowRays.clear();
+		for (uint32_t h = 0; h < Bounce.Hits.size(); h++)
+		{
+			const FStreamHit& Hit = Bounce.Hits[h];
+			for (const auto& Light : mLights)
+			{
+				const FColor LightColor = Light->GetIntesityAt(Hit.Point);
+				if (LightColor == FColor::Black)
+					continue;
+
+				FRay RayToLight(Light->GetRayToLight(Hit.Point));
+				RayToLight.origin += RayToLight.direction * _EPSILON;
+				RayToLight.ignoreObject = Hit.Object;
+				RayToLight.ignorePrimitive = Hit.Primitive;
+
+				// hard shadows never set the sample frame and set, so start from zero rather than copy indeterminate values
+				FStreamLight StreamLight = {};
+				StreamLight.Hit = h;
+				StreamLight.Color = LightColor;
+				StreamLight.Direction = RayToLight.direction;
+				StreamLight.Distance = Light->GetDistance(Hit.Point);
+				StreamLight.Source = Light.get();
+				StreamLight.FirstShadowRay = (uint32_t)ShadowRays.size();
+				Lights.push_back(StreamLight);
+				Stats.ShadowTests++;
+
+				if (mNumberOfShadowSamples > 1)
+				{
+					FStreamLight& SampledLight = Lights.back();
+					SampledLight.SampleFrame = Light->GetSampleFrame(Hit.Point, mNumberOfShadowSamples);
+					SampledLight.SampleSet = PixelSamplers[Hit.Sample / SamplesPerPixel].NextSet(SampledLight.SampleFrame.NumSamples);
+					if (IsProbingShadows(mUseAdaptiveShadows, SampledLight.SampleSet))
+					{
+						for (uint32_t Probe = 0; Probe < NumShadowProbes; Probe++)
+							AddShadowSample(SampledLight, GetShadowProbeSample(SampledLight.SampleSet, Probe));
+					}
+					else
+					{
+						for (uint32_t Sample = 0; Sample < SampledLight.SampleFrame.NumSamples; Sample++)
+							AddShadowSample(SampledLight, Sample);
+					}
+				}
+				else
+				{
+					ShadowRays.push_back(RayToLight);
+					Lights.back().NumShadowRays = 1;
+				}
 			}
-			// Display progress to console
-			UpdateInterval++;
-			if (UpdateInterval >= PercentUpdateRate)
+		}
+		TraceShadowRays();
+
+		// lights whose probes disagree are in a penumbra, they take the rest of their samples in a second stream
+		if (mUseAdaptiveShadows && mNumberOfShadowSamples > 1)
+		{
+			ShadowRays.clear();
+			for (FStreamLight& Light : Lights)
 			{
-				UpdateInterval = 0;
-				std::cout << (y * mOutputResolution.x) * InvTotalPixels << "% Complete" << std::endl;
+				Light.FirstShadowRay = (uint32_t)ShadowRays.size();
+				Light.NumShadowRays = 0;
+				if (!IsProbingShadows(mUseAdaptiveShadows, Light.SampleSet) || Light.NumShadowed == 0 || Light.NumShadowed == Light.NumSamples)
+					continue;
+
+				for (uint32_t Sample = 0; Sample < Light.SampleFrame.NumSamples; Sample++)
+				{
+					if (!IsShadowProbeSample(Light.SampleSet, Sample))
+						AddShadowSample(Light, Sample);
+				}
 			}
+			TraceShadowRays();
 		}
+
+		// add the direct light of each light that is not blocked, and queue the secondary rays of lit hits
+		NextRays.Clear();
+		uint32_t NextLight = 0;
+		for (uint32_t h = 0; h < Bounce.Hits.size(); h++)
+		{
+			FStreamHit& Hit = Bounce.Hits[h];
+			Hit.FirstLight = (uint32_t)Bounce.LightColors.size();
+
+			for (; NextLight < Lights.size() && Lights[NextLight].Hit == h; NextLight++)
+			{
+				const FStreamLight& Light = Lights[NextLight];
+				FColor LightColor = Light.Color;
+
+				if (mNumberOfShadowSamples > 1)
+				{
+					const float ShadeFactor = GetShadeFactor(Light.NumShadowed, Light.NumSamples);
+					if (ShadeFactor <= 0.0)
+						continue;
+
+					LightColor *= ShadeFactor;
+				}
+				else if (Light.NumShadowed > 0)
+				{
+					continue;
+				}
+
+				Bounce.LightColors.push_back(ComputeDirectLight(Hit.Normal, -Hit.RayDirection, Light.Direction, LightColor, Hit.Surface));
+			}
+			Hit.NumLights = (uint32_t)Bounce.LightColors.size() - Hit.FirstLight;
+
+			// reflections and refractions are only seen through lit lights
+			if (Hit.NumLights == 0 || Depth <= 1)
+				continue;
+
+			float ReflectionWeight, RefractionWeight;
+			ComputeSecondaryWeights(&Bounce.LightColors[Hit.FirstLight], Hit.NumLights, Hit.Surface, Hit.Weight, ReflectionWeight, RefractionWeight);
+
+			// rays that are too weak to matter are not traced and contribute black
+			if (ReflectionWeight > 0.0f && ReflectionWeight >= mMinRayWeight)
+			{
+				const Vector3f MirrorReflection = -Hit.RayDirection.Reflect(Hit.Normal);
+				NextRays.Add(FRay(Hit.Point, MirrorReflection, Hit.Object, Hit.Primitive), Hit.Sample, 2 * h, ReflectionWeight);
+				Stats.ReusedRays += Hit.NumLights - 1;
+			}
+			else
+			{
+				Bounce.SecondaryColors[2 * h] = FColor::Black;
+				Stats.SkippedRays++;
+			}
+
+			if (Hit.Surface.Diffuse.A < 1.0f)
+			{
+				if (RefractionWeight > 0.0f && RefractionWeight >= mMinRayWeight)
+				{
+					const Vector3f RefractionDirection = ComputeRefractionVector(-Hit.RayDirection, Hit.Normal, Hit.Surface.RefractiveIndex);
+					NextRays.Add(FRay(Hit.Point, RefractionDirection, Hit.Object, Hit.Primitive), Hit.Sample, 2 * h + 1, RefractionWeight);
+					Stats.ReusedRays += Hit.NumLights - 1;
+				}
+				else
+				{
+					Bounce.SecondaryColors[2 * h + 1] = FColor::Black;
+					Stats.SkippedRays++;
+				}
+			}
+		}
+
+		Stats.SecondaryRays += NextRays.Rays.size();
+
+		std::swap(Rays, NextRays);
 	}
-	// Without supersampling
-	else
+
+	// resolve colors from the deepest bounce back up to the camera samples
+	for (size_t b = Bounces.size(); b-- > 0;)
 	{
-		for (int y = 0; y < mOutputResolution.y; y++)
+		const FStreamBounce& Bounce = Bounces[b];
+		for (uint32_t h = 0; h < Bounce.Hits.size(); h++)
 		{
-			for (int x = 0; x < mOutputResolution.x; x++)
+			const FStreamHit& Hit = Bounce.Hits[h];
+			const FColor& Reflection = Bounce.SecondaryColors[2 * h];
+			const FColor& Refraction = Bounce.SecondaryColors[2 * h + 1];
+
+			const FColor* LightColors = Hit.NumLights ? &Bounce.LightColors[Hit.FirstLight] : nullptr;
+			const FColor OutputColor = CombineLighting(LightColors, Hit.NumLights, Reflection, Refraction, Hit.Surface) + (mGlobalAmbient * Hit.Surface.Ambient);
+
+			if (b == 0)
+				SampleColorsOut[Hit.Target] = OutputColor;
+			else
+				Bounces[b - 1].SecondaryColors[Hit.Target] = OutputColor;
+		}
+	}
+
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+void FScene::GatherCameraRays(const Vector2i& Start, const Vector2i& End, const FRenderPass& Pass, std::vector<Vector2i>& PixelsOut, std::vector<FPixelSampler>& SamplersOut, std::vector<FRay>& RaysOut)
+{
+	for (int32_t BlockY = Start.y; BlockY < End.y; BlockY += PacketBlockSize)
+	{
+		for (int32_t BlockX = Start.x; BlockX < End.x; BlockX += PacketBlockSize)
+		{
+			// gather the pixels of a block in Morton order, so each packet covers a compact part of the block
+			for (int32_t i = 0; i < PacketBlockSize * PacketBlockSize; i++)
 			{
-				FColor PixelColor;
-				const FRay& PixelRay = mCamera.GenerateRay(x, y);
-				PixelColor = TraceRay(PixelRay, 4);
-				mOutputImage.SetPixel(x, y, PixelColor.Clamp());
+				const int32_t x = BlockX + ((i & 1) | ((i >> 1) & 2));
+				const int32_t y = BlockY + (((i >> 1) & 1) | ((i >> 2) & 2));
+				if (x >= End.x || y >= End.y)
+					continue;
+
+				if (Pass.PixelMask && !Pass.PixelMask[y * mOutputResolution.x + x])
+					continue;
+
+				PixelsOut.push_back(Vector2i(x, y));
+				SamplersOut.push_back(GetPixelSampler(x, y, Pass));
+				const FSampleSet PixelSet = GetCameraSampleSet(SamplersOut.back(), Pass);
+				for (uint32_t Sample = Pass.FirstSample; Sample < Pass.FirstSample + Pass.NumSamples; Sample++)
+				{
+					RaysOut.push_back(GenerateCameraRay(x, y, Sample, PixelSet));
+				}
 			}
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+void FScene::IntersectRays(const std::vector<FRay>& Rays, const bool IsCoherent, std::vector<FIntersection>& IntersectionsOut)
+{
+	IntersectionsOut.assign(Rays.size(), FIntersection());
+
+	if (IsCoherent && mPacketSize > 1)
+	{
+		for (size_t First = 0; First < Rays.size(); First += mPacketSize)
+		{
+			FRayPacket Packet(&Rays[First], (uint32_t)std::min<size_t>(mPacketSize, Rays.size() - First));
+			mKDTree.IsIntersectingPacket(Packet, &IntersectionsOut[First]);
+		}
+		return;
+	}
+
+	for (size_t i = 0; i < Rays.size(); i++)
+	{
+		float MaxTValue(std::numeric_limits<float>::max());
+		mKDTree.IsIntersectingRay(Rays[i], &MaxTValue, &IntersectionsOut[i]);
+	}
+}
 
-			// Display progress to console
-			UpdateInterval++;
-			if (UpdateInterval >= PercentUpdateRate)
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+void FScene::WritePixels(const std::vector<Vector2i>& Pixels, const std::vector<FColor>& SampleColors, const FRenderPass& Pass)
+{
+	const uint32_t SamplesPerPixel = (uint32_t)(SampleColors.size() / std::max<size_t>(Pixels.size(), 1));
+	for (size_t Pixel = 0; Pixel < Pixels.size(); Pixel++)
+	{
+		FPixelSamples Samples;
+		const size_t FirstSample = Pixel * SamplesPerPixel;
+		for (size_t Sample = FirstSample; Sample < FirstSample + SamplesPerPixel; Sample++)
+		{
+			Samples.Add(SampleColors[Sample]);
+		}
+
+		AddPixelSamples(Pixels[Pixel].x, Pixels[Pixel].y, Samples, Pass);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+void FScene::AddPixelSamples(int32_t X, int32_t Y, const FPixelSamples& Samples, const FRenderPass& Pass)
+{
+	// a render with a single pass writes the pixel straight away
+	if (mSampleCounts.empty())
+	{
+		FColor PixelColor = Samples.Sum;
+		if (Samples.Count > 1)
+			PixelColor /= (float)Samples.Count;
+		mOutputImage.SetPixel(X, Y, PixelColor);
+		return;
+	}
+
+	const size_t Pixel = (size_t)Y * mOutputResolution.x + X;
+	mSampleSums[Pixel] += Samples.Sum;
+	mSquaredSampleSums[Pixel] += Samples.SquaredSum;
+	mSampleCounts[Pixel] += Samples.Count;
+
+	if (Pass.IsFinal)
+	{
+		// average the result of all samples
+		FColor PixelColor = mSampleSums[Pixel];
+		PixelColor /= (float)mSampleCounts[Pixel];
+		mOutputImage.SetPixel(X, Y, PixelColor);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+void FScene::WriteUntracedPixels(const Vector2i& Start, const Vector2i& End, const FRenderPass& Pass)
+{
+	if (!Pass.IsFinal || !Pass.PixelMask)
+		return;
+
+	for (int32_t y = Start.y; y < End.y; y++)
+	{
+		for (int32_t x = Start.x; x < End.x; x++)
+		{
+			if (!Pass.PixelMask[y * mOutputResolution.x + x])
+				AddPixelSamples(x, y, FPixelSamples(), Pass);
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t FScene::FindPixelsToRefine(std::vector<uint8_t>& PixelMaskOut) const
+{
+	const int32_t Width = mOutputResolution.x;
+	const int32_t Height = mOutputResolution.y;
+
+	// the displayed color of each pixel so far
+	std::vector<FColor> PixelColors(mSampleSums.size());
+	for (size_t Pixel = 0; Pixel < PixelColors.size(); Pixel++)
+	{
+		PixelColors[Pixel] = mSampleSums[Pixel];
+		PixelColors[Pixel] /= (float)std::max(mSampleCounts[Pixel], 1u);
+		PixelColors[Pixel].Clamp();
+	}
+
+	PixelMaskOut.assign(PixelColors.size(), 0);
+	const float Threshold = mSuperSamplingThreshold;
+	const float SquaredThreshold = Threshold * Threshold;
+	for (int32_t y = 0; y < Height; y++)
+	{
+		for (int32_t x = 0; x < Width; x++)
+		{
+			const size_t Pixel = (size_t)y * Width + x;
+			const uint32_t Count = mSampleCounts[Pixel];
+
+			// sample variance of each channel
+			if (Count > 1)
 			{
-				UpdateInterval = 0;
-				std::cout << (y * mOutputResolution.x) * InvTotalPixels << "% Complete" << std::endl;
+				const FColor& Sum = mSampleSums[Pixel];
+				const FColor& SquaredSum = mSquaredSampleSums[Pixel];
+				for (int32_t Channel = 0; Channel < 3; Channel++)
+				{
+					const float Variance = (SquaredSum[Channel] - Sum[Channel] * Sum[Channel] / Count) / (Count - 1);
+					if (Variance > SquaredThreshold)
+						PixelMaskOut[Pixel] = 1;
+				}
+			}
+
+			// contrast with the right and lower neighbours, both pixels of an edge are refined
+			const int32_t Neighbours[2][2] = { { x + 1, y }, { x, y + 1 } };
+			for (const auto& Neighbour : Neighbours)
+			{
+				if (Neighbour[0] >= Width || Neighbour[1] >= Height)
+					continue;
+
+				const size_t NeighbourPixel = (size_t)Neighbour[1] * Width + Neighbour[0];
+				for (int32_t Channel = 0; Channel < 3; Channel++)
+				{
+					if (std::abs(PixelColors[Pixel][Channel] - PixelColors[NeighbourPixel][Channel]) > Threshold)
+					{
+						PixelMaskOut[Pixel] = 1;
+						PixelMaskOut[NeighbourPixel] = 1;
+					}
+				}
 			}
 		}
 	}
 
-	mOutputImage.WriteImage();
+	return (uint32_t)std::count(PixelMaskOut.begin(), PixelMaskOut.end(), (uint8_t)1);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t FScene::FindNoisyPixels(std::vector<uint8_t>& PixelMaskOut, float& NoiseOut) const
+{
+	PixelMaskOut.assign(mSampleSums.size(), 0);
+	double SquaredNoiseSum = 0.0;
+	uint32_t NumNoisyPixels = 0;
+
+	for (size_t Pixel = 0; Pixel < mSampleSums.size(); Pixel++)
+	{
+		const uint32_t Count = mSampleCounts[Pixel];
+
+		// a single sample says nothing about the noise
+		float SquaredError = std::numeric_limits<float>::max();
+		if (Count > 1)
+		{
+			SquaredError = 0.0f;
+			const FColor& Sum = mSampleSums[Pixel];
+			const FColor& SquaredSum = mSquaredSampleSums[Pixel];
+			for (int32_t Channel = 0; Channel < 3; Channel++)
+			{
+				const float Variance = std::max((SquaredSum[Channel] - Sum[Channel] * Sum[Channel] / Count) / (Count - 1), 0.0f);
+				SquaredError = std::max(SquaredError, Variance / Count);
+			}
+			SquaredNoiseSum += SquaredError;
+		}
+
+		if (!(SquaredError <= mTargetNoise * mTargetNoise))
+		{
+			PixelMaskOut[Pixel] = 1;
+			NumNoisyPixels++;
+		}
+	}
+
+	NoiseOut = (float)std::sqrt(SquaredNoiseSum / std::max<size_t>(mSampleSums.size(), 1));
+	return NumNoisyPixels;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+FScene::FPixelSamples FScene::RenderPixel(int32_t X, int32_t Y, const FRenderPass& Pass, FRayStats& Stats)
+{
+	// each pixel has its own sampler, so the result does not depend
+	// on which thread renders the pixel or in what order
+	FPixelSampler Sampler = GetPixelSampler(X, Y, Pass);
+	const FSampleSet PixelSet = GetCameraSampleSet(Sampler, Pass);
+	Stats.CameraRays += Pass.NumSamples;
+
+	FPixelSamples Samples;
+	for (uint32_t Sample = Pass.FirstSample; Sample < Pass.FirstSample + Pass.NumSamples; Sample++)
+	{
+		Samples.Add(TraceRay(GenerateCameraRay(X, Y, Sample, PixelSet), 4, Sampler, Stats));
+	}
+
+	return Samples;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+FPixelSampler FScene::GetPixelSampler(int32_t X, int32_t Y, const FRenderPass& Pass) const
+{
+	return FPixelSampler(mSampler, mSeed, Vector2i(X, Y), mOutputResolution, Pass.Index);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+FSampleSet FScene::GetCameraSampleSet(const FPixelSampler& Sampler, const FRenderPass& Pass) const
+{
+	// a pass never spans two rounds, its samples per pixel divide the size of the grid
+	const uint32_t SamplesPerRound = std::max((uint32_t)mSuperSamplingLevel * mSuperSamplingLevel, 1u);
+	return Sampler.GetPixelSet(SamplesPerRound, Pass.FirstSample / SamplesPerRound);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+FRay FScene::GenerateCameraRay(int32_t X, int32_t Y, uint32_t Sample, const FSampleSet& PixelSet) const
+{
+	// Without supersampling, progressive passes would only retrace the center
+	if (mSuperSamplingLevel <= 1 && !IsProgressive())
+		return mCamera.GenerateRay(X, Y);
+
+	// the cells of a jittered grid are reordered, the first points of a sequence are already spread over the pixel
+	const uint32_t RoundSample = Sample % PixelSet.NumSamples;
+	const uint32_t Point = (PixelSet.Sampler == ESampler::Jittered && mSuperSamplingLevel > 1) ? GetPixelSampleCell(mSuperSamplingLevel, RoundSample) : RoundSample;
+	return mCamera.GenerateSampleRay(X, Y, PixelSet.GetPoint(Point));
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+void FScene::AddRayStats(const FRayStats& Stats)
+{
+	mCameraRays += Stats.CameraRays;
+	mShadowRays += Stats.ShadowRays;
+	mShadowTests += Stats.ShadowTests;
+	mSecondaryRays += Stats.SecondaryRays;
+	mSkippedRays += Stats.SkippedRays;
+	mReusedRays += Stats.ReusedRays;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+bool FScene::IsProgressive() const
+{
+	return mTimeBudget > 0.0f || mTargetNoise > 0.0f;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+void FScene::ReportProgress(uint32_t NumPixels)
+{
+	// progressive renders report each pass instead
+	if (IsProgressive())
+		return;
+
+	// values for calculating progress of completion, progress is displayed every 5%
+	const uint32_t TotalPixels = std::max(mPassPixels, 1u);
+	const uint32_t Completed = mCompletedPixels += NumPixels;
+	const uint32_t PreviousStep = (uint64_t)(Completed - NumPixels) * 20 / TotalPixels;
+	const uint32_t CurrentStep = (uint64_t)Completed * 20 / TotalPixels;
+
+	if (CurrentStep != PreviousStep)
+	{
+		std::lock_guard<std::mutex> Lock(mProgressMutex);
+		std::cout << CurrentStep * 5 << "% Complete" << std::endl;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+FColor FScene::ComputeDirectLight(const Vector3f& SurfaceNormal, const Vector3f& ViewerDirection, const Vector3f& LightDirection, const FColor& LightColor, const FSurfaceProperties& Surface) const
+{
+	const Vector3f& H = ComputeBlinnSpecularReflection(LightDirection, ViewerDirection);
+
+	// Get dot product of surface normal and h for specular lighting
+	const float SpecularFactor = pow(std::max(Vector3f::Dot(SurfaceNormal, H), 0.f), Surface.Glossiness);
+
+	// Get dot product of surface normal and light direction for diffuse lighting
+	const float DiffuseFactor = std::max(Vector3f::Dot(SurfaceNormal, LightDirection), 0.f);
+
+	// Combine material color and light color for diffuse and specular
+	const FColor specularColor(LightColor * Surface.Specular * SpecularFactor);
+	const FColor diffuseColor(LightColor  * Surface.Diffuse * DiffuseFactor);
+
+	return specularColor + diffuseColor;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+FColor FScene::CombineLighting(const FColor* LightColors, const uint32_t NumLights, const FColor& Reflection, const FColor& Refraction, const FSurfaceProperties& Surface) const
+{
+	FColor OutputColor;
+	for (uint32_t i = 0; i < NumLights; i++)
+	{
+		OutputColor += LightColors[i];
+
+		// modify the refraction input by amount of transparency
+		if (Surface.Diffuse.A < 1.0f)
+		{
+			OutputColor *= Surface.Diffuse.A;
+			OutputColor += (1 - Surface.Diffuse.A) * Refraction;
+		}
+
+		// Add mirror reflection contributions
+		OutputColor += Reflection * OutputColor * Surface.Reflectivity;
+	}
+
+	return OutputColor;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+void FScene::ComputeSecondaryWeights(const FColor* LightColors, const uint32_t NumLights, const FSurfaceProperties& Surface, const float Weight, float& ReflectionWeightOut, float& RefractionWeightOut) const
+{
+	FColor DirectLight;
+	for (uint32_t i = 0; i < NumLights; i++)
+	{
+		DirectLight += LightColors[i];
+	}
+
+	// the reflection scales the lit color, which also holds the refraction mixed in by the transparency
+	const float Transparency = (Surface.Diffuse.A < 1.0f) ? 1.0f - Surface.Diffuse.A : 0.0f;
+	const float LitColor = std::max(std::max(DirectLight.R, DirectLight.G), DirectLight.B) + Transparency;
+	ReflectionWeightOut = Weight * Surface.Reflectivity * LitColor;
+
+	// the refraction is mixed in by the transparency, and is part of the color the reflection scales
+	RefractionWeightOut = Weight * Transparency * (1.0f + Surface.Reflectivity);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+
+FColor FScene::TraceSecondaryRay(const FRay& Ray, int32_t Depth, FPixelSampler& Sampler, FRayStats& Stats, float Weight, uint32_t NumLights)
+{
+	if (Depth < 1)
+		return mBackgroundColor;
+
+	// rays that are too weak to matter are not traced and contribute black
+	if (!(Weight > 0.0f && Weight >= mMinRayWeight))
+	{
+		Stats.SkippedRays++;
+		return FColor::Black;
+	}
+
+	Stats.SecondaryRays++;
+	Stats.ReusedRays += NumLights - 1;
+	return TraceRay(Ray, Depth, Sampler, Stats, Weight);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////
@@ -557,12 +1632,16 @@ Vector3f FScene::ComputeRefractionVector(const Vector3f& LightDirection, const V
 	const float& InvRefractive = 1.0f / RefractiveIndex;
 	const float& NDotL = Vector3f::Dot(SurfaceNormal, LightDirection);
 
-	return ((InvRefractive * NDotL - std::sqrtf(1 - InvRefractive * InvRefractive * (1 - (NDotL * NDotL)))) * SurfaceNormal - InvRefractive * LightDirection).Normalize();
+	return ((InvRefractive * NDotL - std::sqrt(1 - InvRefractive * InvRefractive * (1 - (NDotL * NDotL)))) * SurfaceNormal - InvRefractive * LightDirection).Normalize();
 }
 
-bool FScene::IsInShadow(const FRay& LightRay, float MaxDistance)
+bool FScene::IsInShadow(const FRay& LightRay, float MaxDistance, IDrawable** LastOccluder)
 {
-	return mKDTree.IsIntersectingRay(LightRay, &MaxDistance);
+	// neighbouring samples of an area light are usually blocked by the same object
+	if (LastOccluder && *LastOccluder && (*LastOccluder)->IsOccludingRay(LightRay, MaxDistance))
+		return true;
+
+	return mKDTree.IsOccludingRay(LightRay, MaxDistance, LastOccluder);
 
 	// For performance tests
 	//for (const auto& Primitive : mPrimitives)
@@ -576,31 +1655,53 @@ bool FScene::IsInShadow(const FRay& LightRay, float MaxDistance)
 	
 }
 
-float FScene::ComputeShadeFactor(const ILight& Light, const Vector3f& SurfacePoint)
+float FScene::ComputeShadeFactor(const ILight& Light, const Vector3f& SurfacePoint, const IDrawable* SurfaceObject, const uint32_t SurfacePrimitive, FPixelSampler& Sampler, FRayStats& Stats)
 {
-	const float FactorSize = 1.0f / mNumberOfShadowSamples;
-	float ShadeFactor = 1.0f;
 	const float MaxTValue = Light.GetDistance(SurfacePoint);
-	for (FRay ShadowSample : Light.GetRayToLightSamples(SurfacePoint, mNumberOfShadowSamples))
+	IDrawable* LastOccluder = nullptr;
+	uint32_t NumSamples = 0;
+	uint32_t NumShadowed = 0;
+
+	// the light's frame is set up once, then the samples are taken one at a time
+	const FLightSampleFrame SampleFrame = Light.GetSampleFrame(SurfacePoint, mNumberOfShadowSamples);
+	const FSampleSet SampleSet = Sampler.NextSet(SampleFrame.NumSamples);
+	auto TakeSample = [&](const uint32_t Sample)
 	{
+		FRay ShadowSample = Light.GetRayToLightSample(SurfacePoint, SampleFrame, SampleSet.GetPoint(Sample));
+
 		// make sure the ray doesn't start below the surface
 		ShadowSample.origin += ShadowSample.direction * _EPSILON;
-		float tValue = MaxTValue;
-		if (mKDTree.IsIntersectingRay(ShadowSample, &tValue))
+		ShadowSample.ignoreObject = SurfaceObject;
+		ShadowSample.ignorePrimitive = SurfacePrimitive;
+		if (IsInShadow(ShadowSample, MaxTValue, &LastOccluder))
+			NumShadowed++;
+		NumSamples++;
+	};
+
+	if (IsProbingShadows(mUseAdaptiveShadows, SampleSet))
+	{
+		for (uint32_t Probe = 0; Probe < NumShadowProbes; Probe++)
+			TakeSample(GetShadowProbeSample(SampleSet, Probe));
+
+		// the probes agree, so the point is not in a penumbra
+		if (NumShadowed == 0 || NumShadowed == NumSamples)
 		{
-			ShadeFactor -= FactorSize;
+			Stats.ShadowRays += NumSamples;
+			return (NumShadowed == 0) ? 1.0f : 0.0f;
 		}
 
-		//for (const auto& Primitive : mPrimitives)
-		//{
-		//	// If the object is not the reference one and intersects the light
-		//	if (Primitive->IsIntersectingRay(ShadowSample, &MaxTValue))
-		//	{
-		//		ShadeFactor -= FactorSize * Primitive->GetMaterial().GetDiffuse().a;
-		//		break;
-		//	}
-		//}
+		for (uint32_t Sample = 0; Sample < SampleFrame.NumSamples; Sample++)
+		{
+			if (!IsShadowProbeSample(SampleSet, Sample))
+				TakeSample(Sample);
+		}
+	}
+	else
+	{
+		for (uint32_t Sample = 0; Sample < SampleFrame.NumSamples; Sample++)
+			TakeSample(Sample);
 	}
 
-	return ShadeFactor;
+	Stats.ShadowRays += NumSamples;
+	return GetShadeFactor(NumShadowed, NumSamples);
 }
@@ -1,7 +1,6 @@
 #include "Sphere.h"
 #include "Intersection.h"
 #include "Camera.h"
-#include "Texture.h"
 
 FSphere::FSphere(Vector3f Center, float Radius, FMaterial LightingMaterial)
 	: IDrawable(LightingMaterial)
@@ -13,7 +12,8 @@ FSphere::FSphere(Vector3f Center, float Radius, FMaterial LightingMaterial)
 
 bool FSphere::IsIntersectingRay(FRay ray, float* tValueOut, FIntersection* intersectionOut)
 { 
-	if (!IsEnabled())
+	// skip the surface the ray was spawned from
+	if (ray.ignoreObject == this)
 		return false;
 
 	// bring ray into object space
@@ -52,9 +52,10 @@ bool FSphere::IsIntersectingRay(FRay ray, float* tValueOut, FIntersection* inter
 
 			// Construct intersection in world space with t solution
 			Vector3f intersection = rayOrigin + smallestTValue * rayDirection;
+			const Vector2f UV = ComputeUV(intersection);
 			intersection = GetWorldTransform().TransformPosition(intersection);
 
-			ConstructIntersection(intersection, *intersectionOut);
+			ConstructIntersection(intersection, UV, *intersectionOut);
 		}
 		// if we didnt intersection within a given t value, return false
 		else if (smallestTValue > *tValueOut)
@@ -67,41 +68,37 @@ bool FSphere::IsIntersectingRay(FRay ray, float* tValueOut, FIntersection* inter
 		
 }
 
-FMaterial FSphere::GetMaterial(Vector3f SurfacePoint)
+Vector2f FSphere::ComputeUV(Vector3f ObjectSpacePoint) const
 {
-	const FTextureInfo& DiffuseInfo = mMaterial.GetDiffuseTexture();
-	if (!DiffuseInfo.Texture)
-		return mMaterial;
-
-	SurfacePoint = GetWorldInvTransform().TransformPosition(SurfacePoint).Normalize();
+	ObjectSpacePoint.Normalize();
 	const Vector3f Vn(0.0f, 1.0f, 0.0f); // points to north pole
 	const Vector3f Ve(0.0f, 0.0f, 1.0f); // points to equator
 
-	const float& Phi = acosf(-Vector3f::Dot(Vn, SurfacePoint)); // get latitude
-	const float& V = DiffuseInfo.VAxisScale * Phi * mRadius / _PI;
+	const float Phi = acosf(-Vector3f::Dot(Vn, ObjectSpacePoint)); // get latitude
+	const float V = Phi * mRadius / _PI;
 
-	const float& Theta = (acosf(Vector3f::Dot(SurfacePoint, Ve) / sinf(Phi))) / (2 * _PI);
+	const float Theta = (acosf(Vector3f::Dot(ObjectSpacePoint, Ve) / sinf(Phi))) / (2 * _PI);
 	float U;
 
-	if (Vector3f::Dot(Vector3f::Cross(Vn, Ve), SurfacePoint) > 0)
+	if (Vector3f::Dot(Vector3f::Cross(Vn, Ve), ObjectSpacePoint) > 0)
 	{
-		U = Theta * mRadius * DiffuseInfo.UAxisScale;
+		U = Theta * mRadius;
 	}
 	else
 	{
-		U = (1 - Theta) * mRadius * DiffuseInfo.UAxisScale;
+		U = (1 - Theta) * mRadius;
 	}
 
-	mMaterial.SetDiffuse(DiffuseInfo.Texture->GetSample(U, V));
-	
-	return mMaterial;
+	return Vector2f(U, V);
 }
 
-void FSphere::ConstructIntersection(Vector3f IntersectionPoint, FIntersection& IntersectionOut)
+void FSphere::ConstructIntersection(Vector3f IntersectionPoint, const Vector2f& UV, FIntersection& IntersectionOut)
 {
 	IntersectionOut.normal = (IntersectionPoint - GetWorldOrigin()).Normalize();
 	IntersectionOut.point = IntersectionPoint;
 	IntersectionOut.object = this;
+	IntersectionOut.primitive = FRay::AllPrimitives;
+	IntersectionOut.uv = UV;
 }
 
 float FSphere::GetRadius() const
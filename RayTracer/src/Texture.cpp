@@ -3,6 +3,7 @@
 #include <fstream>
 #include <iostream>
 #include <cmath>
+#include <cstring>
 
 FTexture::FTexture(const std::string& Filename)
 {
@@ -41,8 +42,8 @@ FColor FTexture::GetSample(float U, float V) const
 	// use bilinear filtering for texel sample
 	float If, Jf;
 
-	const float& Alpha = modf(uint32_t(U * mWidth) % mWidth - 0.5f, &If);
-	const float& Beta = modf(uint32_t(V * mHeight) % mHeight - 0.5f, &Jf);
+	const float& Alpha = std::modf(uint32_t(U * mWidth) % mWidth - 0.5f, &If);
+	const float& Beta = std::modf(uint32_t(V * mHeight) % mHeight - 0.5f, &Jf);
 	const uint32_t& I = (uint32_t)If;
 	const uint32_t& J = (uint32_t)Jf;
 
@@ -59,7 +60,7 @@ FColor FTexture::GetSample(float U, float V) const
 * @param Filename of .tga image to read.
 * @return False if could not read the image.
 */
-static bool ReadTGAImage(FTexture& Texture, const std::string& Filename)
+bool ReadTGAImage(FTexture& Texture, const std::string& Filename)
 {
 	std::fstream InputFile(Filename, std::ios::in | std::ios::binary);
 	if (!InputFile.is_open())
@@ -1,6 +1,5 @@
 #include "Triangle.h"
 #include "Intersection.h"
-#include "Texture.h"
 
 #include <cmath>
 
@@ -48,7 +47,8 @@ FTriangle::FTriangle(Vector3f V0, Vector3f V1, Vector3f V2, Vector3f Normal, con
 
 bool FTriangle::IsIntersectingRay(FRay Ray, float* tValueOut, FIntersection* IntersectionOut)
 {
-	if (!IsEnabled())
+	// skip the surface the ray was spawned from
+	if (Ray.ignoreObject == this)
 		return false;
 
 	// Ray/Triangle intersection test from 3D Math Primier for Graphics and Game Development
@@ -155,7 +155,10 @@ bool FTriangle::IsIntersectingRay(FRay Ray, float* tValueOut, FIntersection* Int
 		if (IntersectionOut && t < *tValueOut)
 		{
 			*tValueOut = t;
-			ConstructIntersection(Ray.origin + t * Ray.direction, IntersectionOut);
+
+			// interpolate vertex UVs with the barycentric coordinates of the hit
+			const Vector2f UV = gamma * mUV0 + alpha * mUV1 + beta * mUV2;
+			ConstructIntersection(Ray.origin + t * Ray.direction, UV, IntersectionOut);
 		}
 		// if we didnt intersection within a given t value, return false
 		else if (t > *tValueOut)
@@ -167,29 +170,6 @@ bool FTriangle::IsIntersectingRay(FRay Ray, float* tValueOut, FIntersection* Int
 	return true;
 }
 
-FMaterial FTriangle::GetMaterial(Vector3f SurfacePoint)
-{
-	const FTextureInfo& DiffuseInfo = mMaterial.GetDiffuseTexture();
-
-	// if no texture, return default material
-	if (!DiffuseInfo.Texture)
-		return mMaterial;
-
-	// bring the point into object space
-	SurfacePoint = GetWorldInvTransform().TransformPosition(SurfacePoint);
-
-	float B[3];
-	ComputeBarycentric(mV0, mV1, mV2, SurfacePoint, B);
-
-	Vector2f UV = B[0] * mUV0 + B[1] * mUV1 + B[2] * mUV2;
-	UV.x *= DiffuseInfo.UAxisScale;
-	UV.y *= DiffuseInfo.VAxisScale;
-
-	mMaterial.SetDiffuse(DiffuseInfo.Texture->GetSample(UV.x, UV.y));
-	
-	return mMaterial;
-}
-
 void FTriangle::SetUVCoordinates(const Vector2f& UV0, const Vector2f& UV1, const Vector2f& UV2)
 {
 	mUV0 = UV0;
@@ -197,11 +177,13 @@ void FTriangle::SetUVCoordinates(const Vector2f& UV0, const Vector2f& UV1, const
 	mUV2 = UV2;
 }
 
-void FTriangle::ConstructIntersection(Vector3f intersectionPoint, FIntersection* intersectionOut)
+void FTriangle::ConstructIntersection(Vector3f intersectionPoint, const Vector2f& UV, FIntersection* intersectionOut)
 {
 	intersectionOut->object = this;
+	intersectionOut->primitive = FRay::AllPrimitives;
 	intersectionOut->normal = mNormal;
 	intersectionOut->point = intersectionPoint + mNormal * _EPSILON;
+	intersectionOut->uv = UV;
 }
 
 void FTriangle::ConstructAABB(Vector3f Min, Vector3f Max)
@@ -1,76 +1,319 @@
 // RayTracer.cpp : Defines the entry point for the console application.
 //
+// Usage: RayTracer [--config File] [--scene File] [--resolution Width Height] [--supersampling N]
+//                  [--shadow-samples N] [--threads N] [--seed N] [--kdtree SAH|Median]
+//                  [--mesh-leaf-size N] [--packet-size N] [--integrator Recursive|Wavefront]
+//                  [--min-ray-weight W] [--mesh-cache On|Off] [--image-format PPM|PFM]
+//                  [--adaptive-shadows On|Off] [--adaptive-supersampling On|Off] [--supersampling-threshold T]
+//                  [--sampler Jittered|Halton|Sobol|BlueNoise] [--time-budget S] [--target-noise N]
+//                  [--write-interval S] [--output Name]
+// Settings are read from ImageConfig.txt (or --config) first, then overridden by the command line.
 
 #include <iostream>
 #include <istream>
 #include <cstdlib>
-#include <time.h>
+#include <cstring>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <algorithm>
 
 #include "Vector2.h"
 #include "Scene.h"
 
-int main()
-{
-	std::srand((unsigned int)time(nullptr));
-	clock_t t1, t2;
-	t1 = clock();
-	std::filebuf fb;
-	if (fb.open("ImageConfig.txt", std::ios::in))
-	{
-		// read in config data
-		std::istream ConfigStream(&fb);
-		std::string String;
+static const char* DefaultConfigFile = "ImageConfig.txt";
 
-		std::string OutputName, SceneFile;
-		uint16_t ShadowSamples = 1; 
-		uint16_t SuperSampling = 1;
-		Vector2i Resolution(1000, 600);
+/**
+* Render settings, read from the image config file and the command line.
+*/
+struct FRenderSettings
+{
+	std::string OutputName;
+	std::string SceneFile;
+	uint16_t ShadowSamples{ 1 };
+	uint16_t SuperSampling{ 1 };
+	uint16_t Threads{ (uint16_t)std::max(std::thread::hardware_concurrency(), 1u) };
+	uint32_t Seed{ 0 };
+	EKDTreeBuilder TreeBuilder{ EKDTreeBuilder::SAH };
+	uint32_t MeshLeafTriangles{ FMesh::DefaultMaxLeafTriangles };
+	uint32_t PacketSize{ FRayPacket::MaxSize };
+	EIntegrator Integrator{ EIntegrator::Wavefront };
+	float MinRayWeight{ FScene::DefaultMinRayWeight };
+	bool UseMeshCache{ true };
+	EImageFormat ImageFormat{ EImageFormat::PPM };
+	bool UseAdaptiveShadows{ true };
+	bool UseAdaptiveSuperSampling{ false };
+	float SuperSamplingThreshold{ FScene::DefaultSuperSamplingThreshold };
+	ESampler Sampler{ ESampler::Sobol };
+	float TimeBudget{ 0.0f };
+	float TargetNoise{ 0.0f };
+	float WriteInterval{ 0.0f };
+	Vector2i Resolution{ 1000, 600 };
+};
 
-		ConfigStream >> String;
-		while (ConfigStream.good())
-		{
-			if (String == "Resolution:")
-			{
-				ConfigStream >> Resolution.x >> Resolution.y;
-			}
-			else if (String == "SuperSampling:")
-			{
-				ConfigStream >> SuperSampling;
-			}
-			else if (String == "ShadowSamples:")
-			{
-				ConfigStream >> ShadowSamples;
-			}
-			else if (String == "OutputImage:")
-			{
-				ConfigStream >> OutputName;
-			}
-			else if (String == "SceneFile:")
-			{
-				ConfigStream >> SceneFile;
-			}
+/**
+* Reads settings from an image config stream. Keys that are not present keep their current value.
+*/
+static void ReadImageConfig(std::istream& ConfigStream, FRenderSettings& Settings)
+{
+	std::string String;
+	ConfigStream >> String;
+	while (ConfigStream.good())
+	{
+		if (String == "Resolution:")
+		{
+			ConfigStream >> Settings.Resolution.x >> Settings.Resolution.y;
+		}
+		else if (String == "SuperSampling:")
+		{
+			ConfigStream >> Settings.SuperSampling;
+		}
+		else if (String == "ShadowSamples:")
+		{
+			ConfigStream >> Settings.ShadowSamples;
+		}
+		else if (String == "Threads:")
+		{
+			ConfigStream >> Settings.Threads;
+		}
+		else if (String == "Seed:")
+		{
+			ConfigStream >> Settings.Seed;
+		}
+		else if (String == "KDTreeBuilder:")
+		{
 			ConfigStream >> String;
+			Settings.TreeBuilder = (String == "Median") ? EKDTreeBuilder::Median : EKDTreeBuilder::SAH;
 		}
-		fb.close();
+		else if (String == "MeshLeafSize:")
+		{
+			ConfigStream >> Settings.MeshLeafTriangles;
+		}
+		else if (String == "PacketSize:")
+		{
+			ConfigStream >> Settings.PacketSize;
+		}
+		else if (String == "Integrator:")
+		{
+			ConfigStream >> String;
+			Settings.Integrator = (String == "Wavefront") ? EIntegrator::Wavefront : EIntegrator::Recursive;
+		}
+		else if (String == "MinRayWeight:")
+		{
+			ConfigStream >> Settings.MinRayWeight;
+		}
+		else if (String == "MeshCache:")
+		{
+			ConfigStream >> String;
+			Settings.UseMeshCache = (String != "Off");
+		}
+		else if (String == "ImageFormat:")
+		{
+			ConfigStream >> String;
+			Settings.ImageFormat = (String == "PFM") ? EImageFormat::PFM : EImageFormat::PPM;
+		}
+		else if (String == "AdaptiveShadows:")
+		{
+			ConfigStream >> String;
+			Settings.UseAdaptiveShadows = (String != "Off");
+		}
+		else if (String == "AdaptiveSuperSampling:")
+		{
+			ConfigStream >> String;
+			Settings.UseAdaptiveSuperSampling = (String != "Off");
+		}
+		else if (String == "SuperSamplingThreshold:")
+		{
+			ConfigStream >> Settings.SuperSamplingThreshold;
+		}
+		else if (String == "Sampler:")
+		{
+			ConfigStream >> String;
+			FPixelSampler::FindSampler(String, Settings.Sampler);
+		}
+		else if (String == "TimeBudget:")
+		{
+			ConfigStream >> Settings.TimeBudget;
+		}
+		else if (String == "TargetNoise:")
+		{
+			ConfigStream >> Settings.TargetNoise;
+		}
+		else if (String == "WriteInterval:")
+		{
+			ConfigStream >> Settings.WriteInterval;
+		}
+		else if (String == "OutputImage:")
+		{
+			ConfigStream >> Settings.OutputName;
+		}
+		else if (String == "SceneFile:")
+		{
+			ConfigStream >> Settings.SceneFile;
+		}
+		ConfigStream >> String;
+	}
+}
 
-		FScene scene(OutputName, Resolution, ShadowSamples, SuperSampling);
-		if (fb.open(SceneFile, std::ios::in))
+/**
+* Applies command line overrides to the settings.
+* @return False if an argument is not recognized or is missing its value.
+*/
+static bool ReadArguments(int argc, char* argv[], FRenderSettings& Settings)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const int NumValues = argc - i - 1;
+		if (std::strcmp(argv[i], "--config") == 0 && NumValues >= 1)
+			++i; // already read before the other arguments
+		else if (std::strcmp(argv[i], "--scene") == 0 && NumValues >= 1)
+			Settings.SceneFile = argv[++i];
+		else if (std::strcmp(argv[i], "--resolution") == 0 && NumValues >= 2)
 		{
-			std::istream SceneStream(&fb);
-			scene.BuildScene(SceneStream);
-			scene.RenderScene();
+			Settings.Resolution.x = std::atoi(argv[++i]);
+			Settings.Resolution.y = std::atoi(argv[++i]);
 		}
+		else if (std::strcmp(argv[i], "--supersampling") == 0 && NumValues >= 1)
+			Settings.SuperSampling = (uint16_t)std::atoi(argv[++i]);
+		else if (std::strcmp(argv[i], "--shadow-samples") == 0 && NumValues >= 1)
+			Settings.ShadowSamples = (uint16_t)std::atoi(argv[++i]);
+		else if (std::strcmp(argv[i], "--threads") == 0 && NumValues >= 1)
+			Settings.Threads = (uint16_t)std::atoi(argv[++i]);
+		else if (std::strcmp(argv[i], "--seed") == 0 && NumValues >= 1)
+			Settings.Seed = std::strtoul(argv[++i], nullptr, 10);
+		else if (std::strcmp(argv[i], "--kdtree") == 0 && NumValues >= 1)
+			Settings.TreeBuilder = (std::strcmp(argv[++i], "Median") == 0) ? EKDTreeBuilder::Median : EKDTreeBuilder::SAH;
+		else if (std::strcmp(argv[i], "--mesh-leaf-size") == 0 && NumValues >= 1)
+			Settings.MeshLeafTriangles = std::strtoul(argv[++i], nullptr, 10);
+		else if (std::strcmp(argv[i], "--packet-size") == 0 && NumValues >= 1)
+			Settings.PacketSize = std::strtoul(argv[++i], nullptr, 10);
+		else if (std::strcmp(argv[i], "--integrator") == 0 && NumValues >= 1)
+			Settings.Integrator = (std::strcmp(argv[++i], "Wavefront") == 0) ? EIntegrator::Wavefront : EIntegrator::Recursive;
+		else if (std::strcmp(argv[i], "--min-ray-weight") == 0 && NumValues >= 1)
+			Settings.MinRayWeight = std::strtof(argv[++i], nullptr);
+		else if (std::strcmp(argv[i], "--mesh-cache") == 0 && NumValues >= 1)
+			Settings.UseMeshCache = (std::strcmp(argv[++i], "Off") != 0);
+		else if (std::strcmp(argv[i], "--image-format") == 0 && NumValues >= 1)
+			Settings.ImageFormat = (std::strcmp(argv[++i], "PFM") == 0) ? EImageFormat::PFM : EImageFormat::PPM;
+		else if (std::strcmp(argv[i], "--adaptive-shadows") == 0 && NumValues >= 1)
+			Settings.UseAdaptiveShadows = (std::strcmp(argv[++i], "Off") != 0);
+		else if (std::strcmp(argv[i], "--adaptive-supersampling") == 0 && NumValues >= 1)
+			Settings.UseAdaptiveSuperSampling = (std::strcmp(argv[++i], "Off") != 0);
+		else if (std::strcmp(argv[i], "--supersampling-threshold") == 0 && NumValues >= 1)
+			Settings.SuperSamplingThreshold = std::strtof(argv[++i], nullptr);
+		else if (std::strcmp(argv[i], "--sampler") == 0 && NumValues >= 1)
+		{
+			if (!FPixelSampler::FindSampler(argv[++i], Settings.Sampler))
+				return false;
+		}
+		else if (std::strcmp(argv[i], "--time-budget") == 0 && NumValues >= 1)
+			Settings.TimeBudget = std::strtof(argv[++i], nullptr);
+		else if (std::strcmp(argv[i], "--target-noise") == 0 && NumValues >= 1)
+			Settings.TargetNoise = std::strtof(argv[++i], nullptr);
+		else if (std::strcmp(argv[i], "--write-interval") == 0 && NumValues >= 1)
+			Settings.WriteInterval = std::strtof(argv[++i], nullptr);
+		else if (std::strcmp(argv[i], "--output") == 0 && NumValues >= 1)
+			Settings.OutputName = argv[++i];
 		else
+			return false;
+	}
+
+	// the image writer adds the extension, an output name ending in .pfm selects that format
+	const std::string Extensions[] = { ".ppm", ".pfm" };
+	for (const std::string& Extension : Extensions)
+	{
+		if (Settings.OutputName.size() > Extension.size() &&
+			Settings.OutputName.compare(Settings.OutputName.size() - Extension.size(), Extension.size(), Extension) == 0)
 		{
-			std::cout << SceneFile << " scene file could not be opened.";
+			Settings.OutputName.resize(Settings.OutputName.size() - Extension.size());
+			if (Extension == ".pfm")
+				Settings.ImageFormat = EImageFormat::PFM;
 		}
 	}
-	else
+
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	const auto StartTime = std::chrono::steady_clock::now();
+
+	// an explicit config file must exist, the default one is optional when the scene is given on the command line
+	const char* ConfigFile = DefaultConfigFile;
+	bool IsConfigRequired = (argc == 1);
+	for (int i = 1; i + 1 < argc; i++)
 	{
-		std::cout << "ImageConfig.scn file could not be opened.";
+		if (std::strcmp(argv[i], "--config") == 0)
+		{
+			ConfigFile = argv[i + 1];
+			IsConfigRequired = true;
+		}
 	}
-	t2 = clock();
-	std::cout << ((float)t2 - (float)t1) / CLOCKS_PER_SEC << std::endl;
+
+	FRenderSettings Settings;
+	std::filebuf fb;
+	if (fb.open(ConfigFile, std::ios::in))
+	{
+		// read in config data
+		std::istream ConfigStream(&fb);
+		ReadImageConfig(ConfigStream, Settings);
+		fb.close();
+	}
+	else if (IsConfigRequired)
+	{
+		std::cout << ConfigFile << " file could not be opened." << std::endl;
+		return 1;
+	}
+
+	if (!ReadArguments(argc, argv, Settings))
+	{
+		std::cout << "Usage: " << argv[0] << " [--config File] [--scene File] [--resolution Width Height] [--supersampling N]" << std::endl
+			<< "       [--shadow-samples N] [--threads N] [--seed N] [--kdtree SAH|Median] [--mesh-leaf-size N]" << std::endl
+			<< "       [--packet-size N] [--integrator Recursive|Wavefront] [--min-ray-weight W] [--mesh-cache On|Off]" << std::endl
+			<< "       [--image-format PPM|PFM] [--adaptive-shadows On|Off] [--adaptive-supersampling On|Off]" << std::endl
+			<< "       [--supersampling-threshold T] [--sampler Jittered|Halton|Sobol|BlueNoise] [--time-budget S]" << std::endl
+			<< "       [--target-noise N] [--write-interval S] [--output Name]" << std::endl;
+		return 1;
+	}
+
+	if (Settings.OutputName.empty())
+		Settings.OutputName = "Render";
+
+	if (Settings.Resolution.x <= 0 || Settings.Resolution.y <= 0)
+	{
+		std::cout << "Invalid resolution " << Settings.Resolution.x << "x" << Settings.Resolution.y << "." << std::endl;
+		return 1;
+	}
+
+	if (!fb.open(Settings.SceneFile, std::ios::in))
+	{
+		std::cout << Settings.SceneFile << " scene file could not be opened." << std::endl;
+		return 1;
+	}
+
+	FScene scene(Settings.OutputName, Settings.Resolution, Settings.ShadowSamples, Settings.SuperSampling, Settings.Threads, Settings.Seed,
+		Settings.PacketSize, Settings.Integrator, Settings.MinRayWeight, Settings.ImageFormat,
+		Settings.UseAdaptiveShadows, Settings.UseAdaptiveSuperSampling, Settings.SuperSamplingThreshold,
+		Settings.Sampler, Settings.TimeBudget, Settings.TargetNoise, Settings.WriteInterval);
+	try
+	{
+		std::istream SceneStream(&fb);
+		scene.BuildScene(SceneStream, Settings.TreeBuilder, Settings.MeshLeafTriangles, Settings.UseMeshCache);
+	}
+	catch (const std::runtime_error&)
+	{
+		return 1;
+	}
+	scene.RenderScene();
+
+	const FRayStats Stats = scene.GetRayStats();
+	std::cout << "Rays: " << Stats.CameraRays << " camera, " << Stats.ShadowRays << " shadow, " << Stats.SecondaryRays << " secondary" << std::endl;
+	if (Stats.ShadowTests > 0)
+		std::cout << "Shadow rays per shading point and light: " << (double)Stats.ShadowRays / Stats.ShadowTests << std::endl;
+	std::cout << "Secondary rays saved: " << Stats.SkippedRays << " below the weight threshold, " << Stats.ReusedRays << " shared between lights" << std::endl;
+
+	const std::chrono::duration<float> Elapsed = std::chrono::steady_clock::now() - StartTime;
+	std::cout << Elapsed.count() << std::endl;
 
 	return 0;
-}
\ No newline at end of file
+}
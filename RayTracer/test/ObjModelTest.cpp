@@ -0,0 +1,95 @@
+// ObjModelTest.cpp : Checks that models are read the same whatever number of chunks the file is split into.
+//
+// Usage: RayTracerObjModelTest [Directory]
+// Writes a model made of small groups of elements, each followed by faces that refer to the group with
+// negative indices, so the chunk boundaries of every chunk count fall between a group and its faces.
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "ObjModel.h"
+
+/* Groups of elements in the model, enough for a chunk per thread at the largest thread count */
+static const uint32_t NumGroups = 2000;
+/* Triangles that refer to each group */
+static const uint32_t FacesPerGroup = 150;
+/* Largest number of threads the model is read with */
+static const uint32_t MaxThreads = 8;
+
+/**
+* Writes the test model.
+* @return False if the file can't be written.
+*/
+static bool WriteModel(const std::string& Filepath)
+{
+	std::ofstream File(Filepath, std::ios::binary);
+	for (uint32_t Group = 0; Group < NumGroups; Group++)
+	{
+		for (uint32_t i = 0; i < 3; i++)
+		{
+			File << "v " << Group << " " << i << " 0\n";
+			File << "vt " << i << " 0\n";
+			File << "vn 0 0 1\n";
+		}
+		for (uint32_t i = 0; i < FacesPerGroup; i++)
+			File << "f -3/-3/-3 -2/-2/-2 -1/-1/-1\n";
+	}
+
+	return File.good();
+}
+
+/**
+* Checks a model read with a number of threads.
+* @return False if any triangle doesn't refer to its own group.
+*/
+static bool CheckModel(const FObjModel& Model, const uint32_t NumThreads)
+{
+	if (Model.GetNumTriangles() != NumGroups * FacesPerGroup || Model.NumSkippedTriangles != 0)
+	{
+		std::cout << NumThreads << " threads: " << Model.GetNumTriangles() << " triangles read, " << Model.NumSkippedTriangles << " skipped" << std::endl;
+		return false;
+	}
+
+	for (size_t i = 0; i < Model.VertexIndices.size(); i++)
+	{
+		const uint32_t Expected = (uint32_t)(i / (3 * FacesPerGroup) * 3 + i % 3);
+		if (Model.VertexIndices[i] != Expected || Model.UVIndices[i] != Expected || Model.NormalIndices[i] != Expected)
+		{
+			std::cout << NumThreads << " threads: corner " << i << " refers to " << Model.VertexIndices[i] << "/" << Model.UVIndices[i] << "/"
+				<< Model.NormalIndices[i] << ", expected " << Expected << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	const std::string Filepath = std::string(argc > 1 ? argv[1] : ".") + "/ObjModelTest.obj";
+	if (!WriteModel(Filepath))
+	{
+		std::cout << "Could not write " << Filepath << std::endl;
+		return 1;
+	}
+
+	bool Passed = true;
+	for (uint32_t NumThreads = 1; NumThreads <= MaxThreads; NumThreads++)
+	{
+		FObjModel Model;
+		if (!Model.Read(Filepath, NumThreads))
+		{
+			std::cout << "Could not read " << Filepath << std::endl;
+			Passed = false;
+			break;
+		}
+
+		Passed = CheckModel(Model, NumThreads) && Passed;
+	}
+
+	std::remove(Filepath.c_str());
+	std::cout << (Passed ? "Passed" : "Failed") << std::endl;
+	return Passed ? 0 : 1;
+}